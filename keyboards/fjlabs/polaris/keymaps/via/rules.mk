@@ -1 +1,3 @@
 VIA_ENABLE = yes
+USER_NAME := fjlabs
+FJ_WAKE_ENABLE = yes
@@ -1 +1,4 @@
 VIA_ENABLE = yes
+USER_NAME := fjlabs
+FJ_COMPACT_KEYMAP_ENABLE = yes
+FJ_WAKE_ENABLE = yes
@@ -1 +1,4 @@
 VIA_ENABLE = yes
+USER_NAME := fjlabs
+FJ_COMBO_ENABLE = yes
+FJ_WAKE_ENABLE = yes
@@ -0,0 +1,149 @@
+/*
+Copyright 2026 <felix@fjlaboratories.com>
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "fjlabs.h"
+#include "boot.h"
+
+#if defined(FJ_DEFER_RGB_INIT) && !defined(RGB_MATRIX_ENABLE)
+#    error "FJ_DEFER_RGB_INIT only works with RGB Matrix"
+#endif
+
+#ifdef FJ_BOOT_TRACE_ENABLE
+enum boot_phase {
+    BOOT_PRE_INIT,
+    BOOT_POST_INIT,
+    BOOT_USB_CONFIGURED,
+    BOOT_FIRST_KEY,
+    BOOT_PHASE_COUNT,
+};
+
+static const char *const boot_phase_name[BOOT_PHASE_COUNT] = {
+    [BOOT_PRE_INIT]       = "pre_init",
+    [BOOT_POST_INIT]      = "post_init",
+    [BOOT_USB_CONFIGURED] = "usb_configured",
+    [BOOT_FIRST_KEY]      = "first_key",
+};
+
+#    if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+/* keyboard_pre_init runs before timer_init, so the millisecond timer can
+ * not time it. Cortex-M3/M4/M7 count core cycles from there in the DWT
+ * instead, and the timer's start is placed against them at post_init. */
+#        define BOOT_DEMCR (*(volatile uint32_t *)0xE000EDFCu)
+#        define BOOT_DWT_CTRL (*(volatile uint32_t *)0xE0001000u)
+#        define BOOT_DWT_CYCCNT (*(volatile uint32_t *)0xE0001004u)
+#        ifndef FJ_BOOT_CPU_MHZ
+#            if defined(FJ_LATENCY_CPU_MHZ)
+#                define FJ_BOOT_CPU_MHZ FJ_LATENCY_CPU_MHZ
+#            elif defined(STM32_SYSCLK)
+#                define FJ_BOOT_CPU_MHZ (STM32_SYSCLK / 1000000)
+#            endif
+#        endif
+#        ifdef FJ_BOOT_CPU_MHZ
+#            define BOOT_CYCLE_COUNTER
+#        endif
+#    endif
+
+static uint32_t boot_time[BOOT_PHASE_COUNT];
+static uint8_t  boot_seen;
+// Milliseconds from keyboard_pre_init to the timer's start.
+static uint32_t boot_timer_offset;
+
+static void boot_trace_print(void) {
+    for (uint8_t phase = 0; phase < BOOT_PHASE_COUNT; phase++) {
+        if (boot_seen & (1 << phase)) {
+            uprintf("boot: %-15s %5lu ms\n", boot_phase_name[phase], (unsigned long)boot_time[phase]);
+        }
+    }
+}
+
+/* Times count from keyboard_pre_init where the cycle counter is there,
+ * and from timer_init, just after it, elsewhere; only the first hit of a
+ * phase counts. */
+static void boot_trace_mark(uint8_t phase) {
+    if (boot_seen & (1 << phase)) {
+        return;
+    }
+    boot_time[phase] = timer_read32() + boot_timer_offset;
+    boot_seen |= 1 << phase;
+    // The console is rarely attached this early, so dump the whole trace
+    // once the board has been used.
+    if (phase == BOOT_FIRST_KEY) {
+        boot_trace_print();
+    }
+}
+
+static void boot_trace_pre_init(void) {
+#    ifdef BOOT_CYCLE_COUNTER
+    BOOT_DEMCR |= 1u << 24; // TRCENA
+    BOOT_DWT_CYCCNT = 0;
+    BOOT_DWT_CTRL |= 1u; // CYCCNTENA
+    boot_time[BOOT_PRE_INIT] = 0;
+    boot_seen |= 1 << BOOT_PRE_INIT;
+#    endif
+}
+
+static void boot_trace_post_init(void) {
+#    ifdef BOOT_CYCLE_COUNTER
+    // Before latency_init, which restarts the counter.
+    uint32_t since_pre_init = BOOT_DWT_CYCCNT / (FJ_BOOT_CPU_MHZ * 1000u);
+    uint32_t timer          = timer_read32();
+    boot_timer_offset       = since_pre_init > timer ? since_pre_init - timer : 0;
+#    endif
+    boot_trace_mark(BOOT_POST_INIT);
+}
+#else
+#    define boot_trace_mark(phase)
+#    define boot_trace_pre_init()
+#    define boot_trace_post_init()
+#endif
+
+#ifdef FJ_DEFER_RGB_INIT
+/* RGB Matrix renders from the first keyboard task on, which runs after
+ * keyboard_post_init. Turning it off there, without touching EEPROM, keeps
+ * every LED dark until the host has configured the board, so the effects
+ * do not compete with enumeration for power and time. A board that was
+ * configured before keyboard_post_init, or that has RGB turned off, is
+ * left alone. */
+static bool boot_configured;
+static bool boot_rgb_held;
+#endif
+
+void boot_pre_init(void) {
+    boot_trace_pre_init();
+}
+
+void boot_post_init(void) {
+    boot_trace_post_init();
+#ifdef FJ_DEFER_RGB_INIT
+    if (!boot_configured && rgb_matrix_is_enabled()) {
+        rgb_matrix_disable_noeeprom();
+        boot_rgb_held = true;
+    }
+#endif
+}
+
+void boot_usb_configured(void) {
+    boot_trace_mark(BOOT_USB_CONFIGURED);
+#ifdef FJ_DEFER_RGB_INIT
+    boot_configured = true;
+    if (boot_rgb_held) {
+        boot_rgb_held = false;
+        rgb_matrix_enable_noeeprom();
+    }
+#endif
+}
+
+void boot_first_key(void) {
+    boot_trace_mark(BOOT_FIRST_KEY);
+}
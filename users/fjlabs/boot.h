@@ -0,0 +1,21 @@
+/*
+Copyright 2026 <felix@fjlaboratories.com>
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+/* Boot phase hooks, called from the userspace callbacks in fjlabs.c. */
+void boot_pre_init(void);
+void boot_post_init(void);
+void boot_usb_configured(void);
+void boot_first_key(void);
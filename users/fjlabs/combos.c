@@ -0,0 +1,353 @@
+/*
+Copyright 2026 <felix@fjlaboratories.com>
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "fjlabs.h"
+#include "combos.h"
+#include "action_tapping.h"
+#include "via.h"
+#include <string.h>
+
+/* Combos are stored in the VIA custom config as a magic byte followed by
+ * FJ_COMBO_COUNT records of four matrix key indices (row * MATRIX_COLS +
+ * column, COMBOS_NO_KEY when unused) and a big-endian keycode. A combo with
+ * KC_NO as its keycode, or fewer than two keys, is unused.
+ *
+ * Every key has a bitset of the combos it belongs to. A press of a key
+ * whose bitset is empty goes straight through. Otherwise the press is held
+ * back and the candidate set becomes that bitset, then each further press
+ * narrows it with its own bitset. A combo fires once as many keys are held
+ * as it has members and no longer candidate is left. Otherwise the chord
+ * ends when a press matches no candidate, any key is released, or
+ * FJ_COMBO_TERM runs out: then the combo that has exactly the held keys
+ * fires, if there is one, and the held keys are replayed as normal presses
+ * if not.
+ *
+ * Each fired combo keeps the members that are still down. Its keycode is
+ * released with the first of them, and the releases of all of them are
+ * swallowed, so several combos can be held at once. */
+
+#define COMBOS_MAGIC 0xC0
+#define COMBOS_NO_KEY 0xFF
+#define COMBOS_NONE 0xFF
+#define COMBOS_RECORD_SIZE (COMBOS_MAX_KEYS + 2)
+#define COMBOS_KEYS (MATRIX_ROWS * MATRIX_COLS)
+
+_Static_assert(COMBOS_KEYS < COMBOS_NO_KEY, "Matrix too large for one byte key indices.");
+_Static_assert(FJ_COMBO_COUNT < COMBOS_NONE, "Too many combos for one byte slot indices.");
+
+#if FJ_COMBO_COUNT <= 8
+typedef uint8_t combos_word_t;
+#elif FJ_COMBO_COUNT <= 16
+typedef uint16_t combos_word_t;
+#else
+typedef uint32_t combos_word_t;
+#endif
+
+#define COMBOS_WORD_BITS (sizeof(combos_word_t) * 8)
+#define COMBOS_WORDS ((FJ_COMBO_COUNT + COMBOS_WORD_BITS - 1) / COMBOS_WORD_BITS)
+#define COMBOS_BIT(index) ((combos_word_t)1 << ((index) % COMBOS_WORD_BITS))
+#define COMBOS_WORD(set, index) ((set)[(index) / COMBOS_WORD_BITS])
+
+typedef struct {
+    uint8_t  keys[COMBOS_MAX_KEYS];
+    uint8_t  size;
+    uint16_t keycode;
+} combo_record_t;
+
+static combo_record_t combos[FJ_COMBO_COUNT];
+static combos_word_t  combos_index[COMBOS_KEYS][COMBOS_WORDS];
+
+static keyrecord_t   combos_held[COMBOS_MAX_KEYS];
+static uint8_t       combos_held_count;
+static combos_word_t combos_candidates[COMBOS_WORDS];
+static uint8_t       combos_complete = COMBOS_NONE;
+static uint16_t      combos_timer;
+
+// Fired combos with a member still down, and those whose keycode is still registered.
+static combos_word_t combos_active[COMBOS_WORDS];
+static combos_word_t combos_registered[COMBOS_WORDS];
+// Bit n is set while member n of a fired combo is down.
+static uint8_t combos_down[FJ_COMBO_COUNT];
+
+static uint8_t combos_key_index(keypos_t key) {
+    return key.row * MATRIX_COLS + key.col;
+}
+
+static void combos_read(uint8_t index, uint8_t *buf) {
+    via_read_custom_config(buf, FJ_CONFIG_COMBO_OFFSET + 1 + index * COMBOS_RECORD_SIZE, COMBOS_RECORD_SIZE);
+}
+
+static void combos_write(uint8_t index, const uint8_t *buf) {
+    via_update_custom_config(buf, FJ_CONFIG_COMBO_OFFSET + 1 + index * COMBOS_RECORD_SIZE, COMBOS_RECORD_SIZE);
+}
+
+static void combos_load(uint8_t index) {
+    uint8_t buf[COMBOS_RECORD_SIZE];
+    combos_read(index, buf);
+
+    combo_record_t *combo = &combos[index];
+    combo->size           = 0;
+    combo->keycode        = (buf[COMBOS_MAX_KEYS] << 8) | buf[COMBOS_MAX_KEYS + 1];
+    for (uint8_t i = 0; i < COMBOS_MAX_KEYS; i++) {
+        bool duplicate = false;
+        for (uint8_t j = 0; j < combo->size; j++) {
+            duplicate |= combo->keys[j] == buf[i];
+        }
+        if (buf[i] < COMBOS_KEYS && !duplicate) {
+            combo->keys[combo->size++] = buf[i];
+        }
+    }
+    if (combo->keycode == KC_NO || combo->size < 2) {
+        combo->size = 0;
+    }
+}
+
+static void combos_build_index(void) {
+    memset(combos_index, 0, sizeof(combos_index));
+    for (uint8_t index = 0; index < FJ_COMBO_COUNT; index++) {
+        for (uint8_t i = 0; i < combos[index].size; i++) {
+            COMBOS_WORD(combos_index[combos[index].keys[i]], index) |= COMBOS_BIT(index);
+        }
+    }
+}
+
+FJ_COLD void combos_reset(void) {
+    uint8_t buf[COMBOS_RECORD_SIZE];
+    memset(buf, COMBOS_NO_KEY, COMBOS_MAX_KEYS);
+    buf[COMBOS_MAX_KEYS]     = 0;
+    buf[COMBOS_MAX_KEYS + 1] = 0;
+    for (uint8_t index = 0; index < FJ_COMBO_COUNT; index++) {
+        combos_write(index, buf);
+        combos[index].size = 0;
+    }
+    combos_build_index();
+
+    uint8_t magic = COMBOS_MAGIC;
+    via_update_custom_config(&magic, FJ_CONFIG_COMBO_OFFSET, 1);
+}
+
+void combos_init(void) {
+    uint8_t magic;
+    via_read_custom_config(&magic, FJ_CONFIG_COMBO_OFFSET, 1);
+    if (magic != COMBOS_MAGIC) {
+        combos_reset();
+        return;
+    }
+    for (uint8_t index = 0; index < FJ_COMBO_COUNT; index++) {
+        combos_load(index);
+    }
+    combos_build_index();
+}
+
+static void combos_replay_held(void) {
+    uint8_t count     = combos_held_count;
+    combos_held_count = 0;
+    combos_complete   = COMBOS_NONE;
+    for (uint8_t i = 0; i < count; i++) {
+#ifndef NO_ACTION_TAPPING
+        action_tapping_process(combos_held[i]);
+#else
+        process_record(&combos_held[i]);
+#endif
+    }
+}
+
+static void combos_unregister(uint8_t index) {
+    if (COMBOS_WORD(combos_registered, index) & COMBOS_BIT(index)) {
+        COMBOS_WORD(combos_registered, index) &= ~COMBOS_BIT(index);
+        unregister_code16(combos[index].keycode);
+    }
+}
+
+static void combos_fire(uint8_t index) {
+    combos_down[index] = 0;
+    for (uint8_t i = 0; i < combos_held_count; i++) {
+        uint8_t key = combos_key_index(combos_held[i].event.key);
+        for (uint8_t member = 0; member < combos[index].size; member++) {
+            if (combos[index].keys[member] == key) {
+                combos_down[index] |= 1 << member;
+            }
+        }
+    }
+    combos_held_count = 0;
+    combos_complete   = COMBOS_NONE;
+    COMBOS_WORD(combos_active, index) |= COMBOS_BIT(index);
+    COMBOS_WORD(combos_registered, index) |= COMBOS_BIT(index);
+    register_code16(combos[index].keycode);
+}
+
+// Ends the chord being held: fires the combo it completes, or replays it.
+static void combos_flush(void) {
+    if (combos_complete != COMBOS_NONE) {
+        combos_fire(combos_complete);
+    } else {
+        combos_replay_held();
+    }
+}
+
+/* Finds the candidate that has exactly the held keys (every candidate has
+ * all of them, so that is one of the same size) and fires it straight away
+ * unless a longer candidate could still complete. */
+static void combos_check_complete(void) {
+    bool longer     = false;
+    combos_complete = COMBOS_NONE;
+    for (uint8_t word = 0; word < COMBOS_WORDS; word++) {
+        combos_word_t bits = combos_candidates[word];
+        for (uint8_t bit = 0; bits; bit++, bits >>= 1) {
+            uint8_t index = word * COMBOS_WORD_BITS + bit;
+            if (!(bits & 1)) {
+                continue;
+            }
+            if (combos[index].size > combos_held_count) {
+                longer = true;
+            } else if (combos_complete == COMBOS_NONE) {
+                combos_complete = index;
+            }
+        }
+    }
+    if (combos_complete != COMBOS_NONE && !longer) {
+        combos_fire(combos_complete);
+    }
+}
+
+static bool combos_hold(keyrecord_t *record, const combos_word_t *candidates) {
+    bool any = false;
+    for (uint8_t word = 0; word < COMBOS_WORDS; word++) {
+        any |= candidates[word] != 0;
+    }
+    if (!any) {
+        return false;
+    }
+
+    memcpy(combos_candidates, candidates, sizeof(combos_candidates));
+    if (combos_held_count == 0) {
+        combos_timer = timer_read();
+    }
+    combos_held[combos_held_count++] = *record;
+    combos_check_complete();
+    return true;
+}
+
+// Swallows the release of a fired combo's member, ending the combo on the first one.
+static bool combos_release(uint8_t key) {
+    for (uint8_t word = 0; word < COMBOS_WORDS; word++) {
+        combos_word_t bits = combos_index[key][word] & combos_active[word];
+        for (uint8_t bit = 0; bits; bit++, bits >>= 1) {
+            uint8_t index = word * COMBOS_WORD_BITS + bit;
+            if (!(bits & 1)) {
+                continue;
+            }
+            for (uint8_t member = 0; member < combos[index].size; member++) {
+                if (combos[index].keys[member] == key && (combos_down[index] & (1 << member))) {
+                    combos_down[index] &= ~(1 << member);
+                    if (!combos_down[index]) {
+                        COMBOS_WORD(combos_active, index) &= ~COMBOS_BIT(index);
+                    }
+                    combos_unregister(index);
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+FJ_HOT bool combos_pre_process_record(keyrecord_t *record) {
+    if (!IS_KEYEVENT(record->event)) {
+        return true;
+    }
+
+    uint8_t key = combos_key_index(record->event.key);
+
+    if (!record->event.pressed) {
+        // Any release ends the chord, keep the events in the order they came.
+        if (combos_held_count > 0) {
+            combos_flush();
+        }
+        return !combos_release(key);
+    }
+
+    if (combos_held_count > 0) {
+        combos_word_t narrowed[COMBOS_WORDS];
+        for (uint8_t word = 0; word < COMBOS_WORDS; word++) {
+            narrowed[word] = combos_candidates[word] & combos_index[key][word];
+        }
+        if (combos_held_count < COMBOS_MAX_KEYS && combos_hold(record, narrowed)) {
+            return false;
+        }
+        combos_flush();
+    }
+
+    return !combos_hold(record, combos_index[key]);
+}
+
+FJ_HOT void combos_task(void) {
+    if (combos_held_count > 0 && timer_elapsed(combos_timer) > FJ_COMBO_TERM) {
+        combos_flush();
+    }
+}
+
+FJ_COLD bool combos_via_custom_value(uint8_t *data, uint8_t length) {
+    // data = [ command_id, channel_id, value_id, value_data ]
+    uint8_t *command_id = &(data[0]);
+    uint8_t *value_id   = &(data[2]);
+    uint8_t *value_data = &(data[3]);
+
+    switch (*value_id) {
+        case id_fj_combo_count:
+            if (*command_id == id_custom_get_value) {
+                value_data[0] = FJ_COMBO_COUNT;
+            }
+            return true;
+        case id_fj_combo:
+            break;
+        default:
+            return false;
+    }
+
+    // value_data = [ index, row, column x COMBOS_MAX_KEYS, keycode hi, keycode lo ]
+    uint8_t index = value_data[0];
+    if (index >= FJ_COMBO_COUNT || length < 4 + COMBOS_MAX_KEYS * 2 + 2) {
+        *command_id = id_unhandled;
+        return true;
+    }
+
+    uint8_t buf[COMBOS_RECORD_SIZE];
+    if (*command_id == id_custom_get_value) {
+        combos_read(index, buf);
+        for (uint8_t i = 0; i < COMBOS_MAX_KEYS; i++) {
+            value_data[1 + i * 2] = buf[i] < COMBOS_KEYS ? buf[i] / MATRIX_COLS : COMBOS_NO_KEY;
+            value_data[2 + i * 2] = buf[i] < COMBOS_KEYS ? buf[i] % MATRIX_COLS : COMBOS_NO_KEY;
+        }
+        value_data[1 + COMBOS_MAX_KEYS * 2] = buf[COMBOS_MAX_KEYS];
+        value_data[2 + COMBOS_MAX_KEYS * 2] = buf[COMBOS_MAX_KEYS + 1];
+    } else if (*command_id == id_custom_set_value) {
+        for (uint8_t i = 0; i < COMBOS_MAX_KEYS; i++) {
+            uint8_t row    = value_data[1 + i * 2];
+            uint8_t column = value_data[2 + i * 2];
+            buf[i]         = row < MATRIX_ROWS && column < MATRIX_COLS ? row * MATRIX_COLS + column : COMBOS_NO_KEY;
+        }
+        buf[COMBOS_MAX_KEYS]     = value_data[1 + COMBOS_MAX_KEYS * 2];
+        buf[COMBOS_MAX_KEYS + 1] = value_data[2 + COMBOS_MAX_KEYS * 2];
+        combos_write(index, buf);
+        // Keys held for a combo were matched against the old set, so replay
+        // them as plain presses, and release the combo being changed if it is down.
+        combos_replay_held();
+        combos_unregister(index);
+        COMBOS_WORD(combos_active, index) &= ~COMBOS_BIT(index);
+        combos_load(index);
+        combos_build_index();
+    }
+    return true;
+}
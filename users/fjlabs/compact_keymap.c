@@ -0,0 +1,414 @@
+/*
+Copyright 2026 <felix@fjlaboratories.com>
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "fjlabs.h"
+#include "compact_keymap.h"
+#include "keymap_introspection.h"
+#include "via.h"
+#include <string.h>
+
+/* Store layout, all offsets relative to FJ_CONFIG_KEYMAP_OFFSET:
+ *
+ *   magic, layer count        2 bytes
+ *   layer modes               1 byte per layer
+ *   wide keycode dictionary   CK_DICT_SIZE big-endian keycodes
+ *   layer data                packed back to back, in layer order
+ *
+ * An empty layer is all KC_TRNS and takes no space. A byte layer stores one
+ * byte per key: basic keycodes (which include KC_NO and KC_TRNS) as
+ * themselves, anything else as an index into the dictionary using the byte
+ * values no basic keycode occupies. A wide layer stores every key as a
+ * big-endian keycode, like the stock dynamic keymap does. */
+
+#define CK_MAGIC 0xC6
+
+#define CK_KEYS (MATRIX_ROWS * MATRIX_COLS)
+#define CK_DICT_FIRST 0xE8
+#define CK_DICT_SIZE (0x100 - CK_DICT_FIRST)
+
+#define CK_MODE_OFFSET 2
+#define CK_DICT_OFFSET (CK_MODE_OFFSET + FJ_COMPACT_KEYMAP_LAYERS)
+#define CK_DATA_OFFSET (CK_DICT_OFFSET + CK_DICT_SIZE * 2)
+
+#define CK_CHUNK 16
+
+_Static_assert(FJ_COMPACT_KEYMAP_SIZE > CK_DATA_OFFSET, "FJ_COMPACT_KEYMAP_SIZE does not leave room for any layer data.");
+
+// The mode doubles as the number of bytes stored per key.
+enum ck_mode {
+    CK_EMPTY = 0,
+    CK_BYTE  = 1,
+    CK_WIDE  = 2,
+};
+
+static uint8_t  ck_mode[FJ_COMPACT_KEYMAP_LAYERS];
+static uint16_t ck_offset[FJ_COMPACT_KEYMAP_LAYERS + 1];
+static uint16_t ck_dict[CK_DICT_SIZE];
+
+static void ck_read(uint16_t offset, void *buf, uint16_t length) {
+    via_read_custom_config(buf, FJ_CONFIG_KEYMAP_OFFSET + offset, length);
+}
+
+static void ck_write(uint16_t offset, const void *buf, uint16_t length) {
+    via_update_custom_config(buf, FJ_CONFIG_KEYMAP_OFFSET + offset, length);
+}
+
+static void ck_update_offsets(void) {
+    ck_offset[0] = CK_DATA_OFFSET;
+    for (uint8_t layer = 0; layer < FJ_COMPACT_KEYMAP_LAYERS; layer++) {
+        ck_offset[layer + 1] = ck_offset[layer] + ck_mode[layer] * CK_KEYS;
+    }
+}
+
+static void ck_write_mode(uint8_t layer, uint8_t mode) {
+    ck_mode[layer] = mode;
+    ck_write(CK_MODE_OFFSET + layer, &mode, 1);
+    ck_update_offsets();
+}
+
+static int8_t ck_dict_find(uint16_t keycode) {
+    for (uint8_t i = 0; i < CK_DICT_SIZE; i++) {
+        if (ck_dict[i] == keycode) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void ck_dict_write(uint8_t slot, uint16_t keycode) {
+    uint8_t buf[2] = {keycode >> 8, keycode & 0xFF};
+    ck_dict[slot]  = keycode;
+    ck_write(CK_DICT_OFFSET + slot * 2, buf, 2);
+}
+
+// Frees every slot no byte layer refers to any more.
+static void ck_dict_collect(void) {
+    bool    used[CK_DICT_SIZE] = {false};
+    uint8_t buf[CK_CHUNK];
+    for (uint8_t layer = 0; layer < FJ_COMPACT_KEYMAP_LAYERS; layer++) {
+        if (ck_mode[layer] != CK_BYTE) {
+            continue;
+        }
+        for (uint16_t key = 0; key < CK_KEYS; key += CK_CHUNK) {
+            uint8_t count = CK_KEYS - key < CK_CHUNK ? CK_KEYS - key : CK_CHUNK;
+            ck_read(ck_offset[layer] + key, buf, count);
+            for (uint8_t i = 0; i < count; i++) {
+                if (buf[i] >= CK_DICT_FIRST) {
+                    used[buf[i] - CK_DICT_FIRST] = true;
+                }
+            }
+        }
+    }
+    for (uint8_t slot = 0; slot < CK_DICT_SIZE; slot++) {
+        if (!used[slot] && ck_dict[slot] != KC_NO) {
+            ck_dict_write(slot, KC_NO);
+        }
+    }
+}
+
+// Only collects when the dictionary looks full, so a write rarely scans the layers.
+static int8_t ck_dict_free_slot(void) {
+    int8_t slot = ck_dict_find(KC_NO);
+    if (slot < 0) {
+        ck_dict_collect();
+        slot = ck_dict_find(KC_NO);
+    }
+    return slot;
+}
+
+static uint16_t ck_decode_byte(uint8_t value) {
+    return value < CK_DICT_FIRST ? value : ck_dict[value - CK_DICT_FIRST];
+}
+
+// Returns true if the keycode has a byte encoding, adding it to the
+// dictionary if there is room and allocate is set.
+static bool ck_encode_byte(uint16_t keycode, uint8_t *value, bool allocate) {
+    if (keycode < CK_DICT_FIRST) {
+        *value = keycode;
+        return true;
+    }
+    int8_t slot = ck_dict_find(keycode);
+    if (slot < 0) {
+        slot = ck_dict_free_slot();
+        if (slot < 0) {
+            return false;
+        }
+        if (allocate) {
+            ck_dict_write(slot, keycode);
+        }
+    }
+    *value = CK_DICT_FIRST + slot;
+    return true;
+}
+
+static void ck_move(uint16_t to, uint16_t from, uint16_t length) {
+    uint8_t buf[CK_CHUNK];
+    // Copy from the end the data moves towards, so nothing is overwritten before it is read.
+    for (uint16_t done = 0; done < length;) {
+        uint16_t chunk = length - done < CK_CHUNK ? length - done : CK_CHUNK;
+        uint16_t at    = to > from ? length - done - chunk : done;
+        ck_read(from + at, buf, chunk);
+        ck_write(to + at, buf, chunk);
+        done += chunk;
+    }
+}
+
+static void ck_compact(void);
+
+// Re-encode a layer with more bytes per key, shifting the layers after it.
+static bool ck_grow(uint8_t layer, uint8_t mode) {
+    if (ck_offset[FJ_COMPACT_KEYMAP_LAYERS] + (mode - ck_mode[layer]) * CK_KEYS > FJ_COMPACT_KEYMAP_SIZE) {
+        ck_compact();
+        if (ck_offset[FJ_COMPACT_KEYMAP_LAYERS] + (mode - ck_mode[layer]) * CK_KEYS > FJ_COMPACT_KEYMAP_SIZE) {
+            return false;
+        }
+    }
+
+    uint16_t start = ck_offset[layer];
+    uint16_t old   = ck_offset[layer + 1];
+    uint16_t end   = ck_offset[FJ_COMPACT_KEYMAP_LAYERS];
+    uint16_t delta = (mode - ck_mode[layer]) * CK_KEYS;
+
+    ck_move(old + delta, old, end - old);
+
+    uint8_t buf[CK_CHUNK];
+    if (ck_mode[layer] == CK_EMPTY) {
+        for (uint8_t i = 0; i < CK_CHUNK; i++) {
+            // KC_TRNS in either encoding
+            buf[i] = (mode == CK_BYTE || (i & 1)) ? KC_TRNS : 0;
+        }
+        for (uint16_t i = 0; i < delta; i += CK_CHUNK) {
+            ck_write(start + i, buf, delta - i < CK_CHUNK ? delta - i : CK_CHUNK);
+        }
+    } else {
+        // Byte to wide, back to front so nothing is overwritten before it is read.
+        for (uint16_t key = CK_KEYS; key > 0;) {
+            uint8_t count = key < CK_CHUNK / 2 ? key : CK_CHUNK / 2;
+            key -= count;
+            ck_read(start + key, buf, count);
+            for (int8_t i = count - 1; i >= 0; i--) {
+                uint16_t keycode = ck_decode_byte(buf[i]);
+                buf[i * 2]       = keycode >> 8;
+                buf[i * 2 + 1]   = keycode & 0xFF;
+            }
+            ck_write(start + key * 2, buf, count * 2);
+        }
+    }
+
+    ck_write_mode(layer, mode);
+    return true;
+}
+
+static uint16_t ck_default_keycode(uint8_t layer, uint8_t row, uint8_t column) {
+    uint8_t source = DYNAMIC_KEYMAP_LAYER_COUNT + layer;
+    return source < keymap_layer_count_raw() ? keycode_at_keymap_location_raw(source, row, column) : KC_TRNS;
+}
+
+// The fewest bytes per key that can hold the layer keycode_at describes.
+static uint8_t ck_fit_mode(uint8_t layer, uint16_t (*keycode_at)(uint8_t layer, uint8_t row, uint8_t column)) {
+    uint16_t pending[CK_DICT_SIZE];
+    uint8_t  pending_count = 0;
+    uint8_t  free_slots    = 0;
+    uint8_t  mode          = CK_EMPTY;
+
+    for (uint8_t i = 0; i < CK_DICT_SIZE; i++) {
+        free_slots += ck_dict[i] == KC_NO;
+    }
+
+    for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+        for (uint8_t column = 0; column < MATRIX_COLS; column++) {
+            uint16_t keycode = keycode_at(layer, row, column);
+            if (keycode == KC_TRNS) {
+                continue;
+            }
+            mode = CK_BYTE;
+            if (keycode < CK_DICT_FIRST || ck_dict_find(keycode) >= 0) {
+                continue;
+            }
+            bool seen = false;
+            for (uint8_t i = 0; i < pending_count && !seen; i++) {
+                seen = pending[i] == keycode;
+            }
+            if (!seen) {
+                if (pending_count == free_slots) {
+                    return CK_WIDE;
+                }
+                pending[pending_count++] = keycode;
+            }
+        }
+    }
+    return mode;
+}
+
+// Re-encode a layer with fewer bytes per key, shifting the layers after it back.
+static void ck_shrink(uint8_t layer, uint8_t mode) {
+    uint16_t start = ck_offset[layer];
+    uint16_t old   = ck_offset[layer + 1];
+    uint16_t end   = ck_offset[FJ_COMPACT_KEYMAP_LAYERS];
+    uint16_t delta = (ck_mode[layer] - mode) * CK_KEYS;
+
+    if (mode == CK_BYTE) {
+        // Wide to byte, front to back: each byte lands on keys already read.
+        uint8_t buf[CK_CHUNK];
+        for (uint16_t key = 0; key < CK_KEYS;) {
+            uint8_t count = CK_KEYS - key < CK_CHUNK / 2 ? CK_KEYS - key : CK_CHUNK / 2;
+            ck_read(start + key * 2, buf, count * 2);
+            for (uint8_t i = 0; i < count; i++) {
+                ck_encode_byte((buf[i * 2] << 8) | buf[i * 2 + 1], &buf[i], true);
+            }
+            ck_write(start + key, buf, count);
+            key += count;
+        }
+    }
+
+    ck_move(old - delta, old, end - old);
+    ck_write_mode(layer, mode);
+}
+
+/* Gives back what the layers no longer use: dictionary slots nothing refers
+ * to, layers that are all KC_TRNS again, and wide layers whose keycodes fit
+ * in bytes. Only run when a write finds the store full. */
+static void ck_compact(void) {
+    ck_dict_collect();
+    for (uint8_t layer = 0; layer < FJ_COMPACT_KEYMAP_LAYERS; layer++) {
+        if (ck_mode[layer] == CK_EMPTY) {
+            continue;
+        }
+        uint8_t mode = ck_fit_mode(layer, compact_keymap_get_keycode);
+        if (mode < ck_mode[layer]) {
+            ck_shrink(layer, mode);
+        }
+    }
+}
+
+FJ_COLD void compact_keymap_reset(void) {
+    uint8_t header[2] = {0, FJ_COMPACT_KEYMAP_LAYERS};
+    ck_write(0, header, sizeof(header));
+
+    memset(ck_dict, 0, sizeof(ck_dict));
+    for (uint8_t slot = 0; slot < CK_DICT_SIZE; slot++) {
+        ck_dict_write(slot, KC_NO);
+    }
+    for (uint8_t layer = 0; layer < FJ_COMPACT_KEYMAP_LAYERS; layer++) {
+        ck_write_mode(layer, CK_EMPTY);
+    }
+
+    for (uint8_t layer = 0; layer < FJ_COMPACT_KEYMAP_LAYERS; layer++) {
+        uint8_t mode = ck_fit_mode(layer, ck_default_keycode);
+        if (mode == CK_EMPTY || ck_offset[layer] + mode * CK_KEYS > FJ_COMPACT_KEYMAP_SIZE) {
+            continue;
+        }
+        ck_write_mode(layer, mode);
+
+        uint8_t buf[MATRIX_COLS * 2];
+        for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+            for (uint8_t column = 0; column < MATRIX_COLS; column++) {
+                uint16_t keycode = ck_default_keycode(layer, row, column);
+                if (mode == CK_BYTE) {
+                    ck_encode_byte(keycode, &buf[column], true);
+                } else {
+                    buf[column * 2]     = keycode >> 8;
+                    buf[column * 2 + 1] = keycode & 0xFF;
+                }
+            }
+            ck_write(ck_offset[layer] + row * MATRIX_COLS * mode, buf, MATRIX_COLS * mode);
+        }
+    }
+
+    // Mark the store valid last, in case the reset gets interrupted.
+    header[0] = CK_MAGIC;
+    ck_write(0, header, sizeof(header));
+}
+
+void compact_keymap_init(void) {
+    uint8_t header[2];
+    ck_read(0, header, sizeof(header));
+    if (header[0] != CK_MAGIC || header[1] != FJ_COMPACT_KEYMAP_LAYERS) {
+        compact_keymap_reset();
+        return;
+    }
+
+    ck_read(CK_MODE_OFFSET, ck_mode, sizeof(ck_mode));
+    for (uint8_t layer = 0; layer < FJ_COMPACT_KEYMAP_LAYERS; layer++) {
+        if (ck_mode[layer] > CK_WIDE) {
+            compact_keymap_reset();
+            return;
+        }
+    }
+    ck_update_offsets();
+
+    uint8_t buf[CK_DICT_SIZE * 2];
+    ck_read(CK_DICT_OFFSET, buf, sizeof(buf));
+    for (uint8_t slot = 0; slot < CK_DICT_SIZE; slot++) {
+        ck_dict[slot] = (buf[slot * 2] << 8) | buf[slot * 2 + 1];
+    }
+}
+
+FJ_HOT uint16_t compact_keymap_get_keycode(uint8_t layer, uint8_t row, uint8_t column) {
+    if (layer >= FJ_COMPACT_KEYMAP_LAYERS || row >= MATRIX_ROWS || column >= MATRIX_COLS) {
+        return KC_NO;
+    }
+
+    uint16_t key = row * MATRIX_COLS + column;
+    uint8_t  buf[2];
+    switch (ck_mode[layer]) {
+        case CK_BYTE:
+            ck_read(ck_offset[layer] + key, buf, 1);
+            return ck_decode_byte(buf[0]);
+        case CK_WIDE:
+            ck_read(ck_offset[layer] + key * 2, buf, 2);
+            return (buf[0] << 8) | buf[1];
+        default:
+            return KC_TRNS;
+    }
+}
+
+FJ_COLD bool compact_keymap_set_keycode(uint8_t layer, uint8_t row, uint8_t column, uint16_t keycode) {
+    if (layer >= FJ_COMPACT_KEYMAP_LAYERS || row >= MATRIX_ROWS || column >= MATRIX_COLS) {
+        return false;
+    }
+
+    uint16_t key = row * MATRIX_COLS + column;
+    uint8_t  buf[2];
+    if (ck_mode[layer] != CK_WIDE) {
+        if (ck_mode[layer] == CK_EMPTY && keycode == KC_TRNS) {
+            return true;
+        }
+        bool fits = ck_encode_byte(keycode, &buf[0], false);
+        if (!fits && ck_mode[layer] == CK_BYTE) {
+            // The key may hold the last use of a dictionary slot, let go of it and look again.
+            uint8_t old;
+            ck_read(ck_offset[layer] + key, &old, 1);
+            buf[0] = KC_TRNS;
+            ck_write(ck_offset[layer] + key, buf, 1);
+            fits = ck_encode_byte(keycode, &buf[0], false);
+            if (!fits) {
+                ck_write(ck_offset[layer] + key, &old, 1);
+            }
+        }
+        // Making room may hand the slot to another layer, so allocate only after it.
+        if (fits && (ck_mode[layer] == CK_BYTE || ck_grow(layer, CK_BYTE)) && ck_encode_byte(keycode, &buf[0], true)) {
+            ck_write(ck_offset[layer] + key, buf, 1);
+            return true;
+        }
+        if (!ck_grow(layer, CK_WIDE)) {
+            return false;
+        }
+    }
+
+    buf[0] = keycode >> 8;
+    buf[1] = keycode & 0xFF;
+    ck_write(ck_offset[layer] + key * 2, buf, 2);
+    return true;
+}
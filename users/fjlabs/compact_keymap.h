@@ -0,0 +1,25 @@
+/*
+Copyright 2026 <felix@fjlaboratories.com>
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Layers above the stock dynamic keymap, stored in the VIA custom config.
+ * Layer numbers here are relative to the first compact layer. */
+void     compact_keymap_init(void);
+void     compact_keymap_reset(void);
+uint16_t compact_keymap_get_keycode(uint8_t layer, uint8_t row, uint8_t column);
+bool     compact_keymap_set_keycode(uint8_t layer, uint8_t row, uint8_t column, uint16_t keycode);
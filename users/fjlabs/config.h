@@ -0,0 +1,123 @@
+/*
+Copyright 2026 <felix@fjlaboratories.com>
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+/* Tap-hold: layer-tap keys turn into a hold as soon as another key is
+ * pressed, mod-tap keys as soon as an interrupting key is pressed and
+ * released. Either way the decision is made on that event instead of at
+ * the end of TAPPING_TERM, so a tap only waits for its own release. */
+#define HOLD_ON_OTHER_KEY_PRESS_PER_KEY
+#define PERMISSIVE_HOLD
+
+/* Matrix trace recording wants the raw matrix, bounces and all. */
+#ifdef FJ_MATRIX_TRACE_ENABLE
+#    undef DEBOUNCE
+#    define DEBOUNCE 0
+#endif
+
+/* FJ_HOT marks the userspace code that runs for every key event or scan,
+ * FJ_COLD setup and VIA handlers. With FJ_HOT_PATH_OPT the hot functions
+ * are built at -O2 and the cold ones moved out of the way, while the rest
+ * of the firmware stays at -Os; without it both are empty. */
+#ifdef FJ_HOT_PATH_OPT
+#    define FJ_HOT __attribute__((hot, optimize("O2")))
+#    define FJ_COLD __attribute__((cold))
+#else
+#    define FJ_HOT
+#    define FJ_COLD
+#endif
+
+#ifdef FJ_PROFILE_ENABLE
+/* FJ_PROFILE_COUNT banks of FJ_PROFILE_LAYERS layers each, back to back in
+ * whichever store holds the layers. */
+#    ifndef FJ_PROFILE_COUNT
+#        define FJ_PROFILE_COUNT 2
+#    endif
+#    ifndef FJ_PROFILE_LAYERS
+#        define FJ_PROFILE_LAYERS 4
+#    endif
+#    if FJ_PROFILE_COUNT > 16
+#        error "FJ_PROFILE_COUNT must be 16 or fewer"
+#    endif
+#    ifdef FJ_COMPACT_KEYMAP_ENABLE
+#        ifndef FJ_COMPACT_KEYMAP_LAYERS
+#            define FJ_COMPACT_KEYMAP_LAYERS (FJ_PROFILE_COUNT * FJ_PROFILE_LAYERS - 1)
+#        endif
+#    else
+#        undef DYNAMIC_KEYMAP_LAYER_COUNT
+#        define DYNAMIC_KEYMAP_LAYER_COUNT (FJ_PROFILE_COUNT * FJ_PROFILE_LAYERS)
+#    endif
+// The active bank.
+#    define FJ_CONFIG_PROFILE_SIZE 1
+#else
+#    define FJ_CONFIG_PROFILE_SIZE 0
+#endif
+
+#ifdef FJ_COMPACT_KEYMAP_ENABLE
+/* Layer 0 stays in the stock dynamic keymap, the layers above it move to the
+ * compact store. By default the store gets the EEPROM the stock layers 1-3
+ * used to take, so the board keeps the same EEPROM budget. */
+#    undef DYNAMIC_KEYMAP_LAYER_COUNT
+#    define DYNAMIC_KEYMAP_LAYER_COUNT 1
+#    ifndef FJ_COMPACT_KEYMAP_LAYERS
+#        define FJ_COMPACT_KEYMAP_LAYERS 7
+#    endif
+#    if FJ_COMPACT_KEYMAP_LAYERS > 15
+#        error "FJ_COMPACT_KEYMAP_LAYERS must be 15 or fewer"
+#    endif
+#    ifndef FJ_COMPACT_KEYMAP_SIZE
+#        define FJ_COMPACT_KEYMAP_SIZE (3 * MATRIX_ROWS * MATRIX_COLS * 2)
+#    endif
+#    define FJ_CONFIG_KEYMAP_SIZE FJ_COMPACT_KEYMAP_SIZE
+#else
+#    define FJ_CONFIG_KEYMAP_SIZE 0
+#endif
+
+#ifdef FJ_COMBO_ENABLE
+#    ifndef FJ_COMBO_COUNT
+#        define FJ_COMBO_COUNT 16
+#    endif
+#    if FJ_COMBO_COUNT > 255
+#        error "FJ_COMBO_COUNT must be 255 or fewer"
+#    endif
+#    ifndef FJ_COMBO_TERM
+#        define FJ_COMBO_TERM 50
+#    endif
+// Magic byte plus four key indices and a keycode per combo.
+#    define FJ_CONFIG_COMBO_SIZE (1 + FJ_COMBO_COUNT * 6)
+#else
+#    define FJ_CONFIG_COMBO_SIZE 0
+#endif
+
+#ifdef FJ_EXPAND_ENABLE
+/* The compiled trigger trie and expansions, written by util/via_expand.py. */
+#    ifndef FJ_EXPAND_SIZE
+#        define FJ_EXPAND_SIZE 512
+#    endif
+#    define FJ_CONFIG_EXPAND_SIZE FJ_EXPAND_SIZE
+#else
+#    define FJ_CONFIG_EXPAND_SIZE 0
+#endif
+
+/* VIA custom config, shared by the modules above. */
+#define FJ_CONFIG_KEYMAP_OFFSET 0
+#define FJ_CONFIG_COMBO_OFFSET (FJ_CONFIG_KEYMAP_OFFSET + FJ_CONFIG_KEYMAP_SIZE)
+#define FJ_CONFIG_PROFILE_OFFSET (FJ_CONFIG_COMBO_OFFSET + FJ_CONFIG_COMBO_SIZE)
+#define FJ_CONFIG_EXPAND_OFFSET (FJ_CONFIG_PROFILE_OFFSET + FJ_CONFIG_PROFILE_SIZE)
+#define FJ_CONFIG_SIZE (FJ_CONFIG_EXPAND_OFFSET + FJ_CONFIG_EXPAND_SIZE)
+
+#ifdef FJ_VIA_CONFIG_ENABLE
+#    define VIA_EEPROM_CUSTOM_CONFIG_SIZE FJ_CONFIG_SIZE
+#endif
@@ -0,0 +1,238 @@
+/*
+Copyright 2026 <felix@fjlaboratories.com>
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "fjlabs.h"
+#include "expand.h"
+#include "via.h"
+#include "send_string.h"
+
+/* Text expansion. The dictionary is an Aho-Corasick automaton, a trie of
+ * the triggers with failure links, compiled by util/via_expand.py and
+ * stored in the VIA custom config:
+ *
+ *   [ magic ] [ root node ] [ nodes ... ] [ expansions ... ]
+ *   node:  [ children ] [ length ] [ expansion hi, lo ] [ fail hi, lo ]
+ *          then per child, by ascending symbol, [ symbol ] [ node hi, lo ]
+ *
+ * Offsets are from the start of the area; an expansion is a NUL-terminated
+ * ASCII string, offset 0 meaning none. A symbol is the HID keycode a
+ * character is typed with, plus EXPAND_SHIFT when it is shifted.
+ *
+ * The current node stands for the longest trigger prefix the last presses
+ * end with. A press follows the child edge for its symbol, and when there
+ * is none, the failure links to the nodes for ever shorter suffixes until
+ * one has it or the root is reached, so a trigger that starts inside a
+ * partial match of another one is still found. Failure links always point
+ * to an earlier node, so the walk ends. Each link leads to a shallower
+ * node and each press goes at most one level deeper, so a run of presses
+ * follows at most one link per press on average, each a binary search of
+ * a node's children; a single press can still follow as many as the
+ * longest trigger is long. A node where a trigger ends, its own or one that
+ * is a suffix of it, carries that trigger's length and expansion: reaching
+ * it erases the trigger and types the expansion.
+ * Presses of anything but a character (Enter, arrows, Ctrl/Alt/GUI chords,
+ * ...) go back to the root; modifiers and layer keys are ignored. */
+
+#define EXPAND_MAGIC 0xE6
+#define EXPAND_SHIFT 0x80
+#define EXPAND_ROOT 1
+#define EXPAND_NODE_SIZE 6
+#define EXPAND_CHILD_SIZE 3
+// Sending is done in chunks read from the custom config.
+#define EXPAND_CHUNK 16
+
+static bool     expand_enabled;
+static uint16_t expand_node = EXPAND_ROOT;
+
+static void expand_read(uint8_t *buf, uint16_t offset, uint8_t size) {
+    via_read_custom_config(buf, FJ_CONFIG_EXPAND_OFFSET + offset, size);
+}
+
+static uint16_t expand_read_offset(uint16_t at) {
+    uint8_t buf[2];
+    expand_read(buf, at, 2);
+    return (buf[0] << 8) | buf[1];
+}
+
+// Returns the child of `node` for `symbol`, 0 if there is none.
+static uint16_t expand_child(uint16_t node, uint8_t symbol) {
+    uint8_t count;
+    expand_read(&count, node, 1);
+    uint16_t children = node + EXPAND_NODE_SIZE;
+    if (children + count * EXPAND_CHILD_SIZE > FJ_EXPAND_SIZE) {
+        return 0;
+    }
+    uint8_t low = 0, high = count;
+    while (low < high) {
+        uint8_t mid = (low + high) / 2;
+        uint8_t child[EXPAND_CHILD_SIZE];
+        expand_read(child, children + mid * EXPAND_CHILD_SIZE, EXPAND_CHILD_SIZE);
+        if (child[0] == symbol) {
+            uint16_t next = (child[1] << 8) | child[2];
+            return next + EXPAND_NODE_SIZE <= FJ_EXPAND_SIZE ? next : 0;
+        }
+        if (child[0] < symbol) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return 0;
+}
+
+// The node to try after `node` has no edge for a press, the root if the link is broken.
+static uint16_t expand_fail(uint16_t node) {
+    uint16_t fail = expand_read_offset(node + 4);
+    return fail >= EXPAND_ROOT && fail < node ? fail : EXPAND_ROOT;
+}
+
+static void expand_restart(void) {
+    expand_node = EXPAND_ROOT;
+}
+
+static void expand_send(uint16_t text, uint8_t length) {
+    uint8_t mods = get_mods();
+    clear_mods();
+    clear_weak_mods();
+    // The last trigger character was never sent.
+    for (uint8_t i = 1; i < length; i++) {
+        tap_code(KC_BACKSPACE);
+    }
+    while (text < FJ_EXPAND_SIZE) {
+        uint8_t chunk[EXPAND_CHUNK];
+        uint8_t size = FJ_EXPAND_SIZE - text < EXPAND_CHUNK ? FJ_EXPAND_SIZE - text : EXPAND_CHUNK;
+        expand_read(chunk, text, size);
+        for (uint8_t i = 0; i < size; i++) {
+            if (chunk[i] == '\0') {
+                set_mods(mods);
+                send_keyboard_report();
+                return;
+            }
+            send_char(chunk[i]);
+        }
+        text += size;
+    }
+    set_mods(mods);
+    send_keyboard_report();
+}
+
+/* The trie symbol for a press, 0 for presses that end any trigger and
+ * EXPAND_SHIFT alone for presses that do not count. */
+static uint8_t expand_symbol(uint16_t keycode, keyrecord_t *record) {
+    if (IS_QK_MOD_TAP(keycode) || IS_QK_LAYER_TAP(keycode)) {
+        if (record->tap.count == 0) {
+            return EXPAND_SHIFT;
+        }
+        keycode = IS_QK_MOD_TAP(keycode) ? QK_MOD_TAP_GET_TAP_KEYCODE(keycode) : QK_LAYER_TAP_GET_TAP_KEYCODE(keycode);
+    }
+    if (IS_MODIFIER_KEYCODE(keycode) || IS_QK_MOMENTARY(keycode) || IS_QK_TOGGLE_LAYER(keycode) || IS_QK_ONE_SHOT_MOD(keycode)) {
+        return EXPAND_SHIFT;
+    }
+
+    uint8_t mods = get_mods() | get_weak_mods() | get_oneshot_mods();
+    if (IS_QK_MODS(keycode)) {
+        uint8_t extra = QK_MODS_GET_MODS(keycode);
+        // Five-bit mods: bit 4 picks the right-hand side.
+        mods |= extra & 0x10 ? (extra & 0x0F) << 4 : extra;
+        keycode = QK_MODS_GET_BASIC_KEYCODE(keycode);
+    }
+    if (mods & ~MOD_MASK_SHIFT || keycode < KC_A || keycode > KC_SLASH || keycode == KC_ENTER || keycode == KC_ESCAPE || keycode == KC_BACKSPACE || keycode == KC_TAB) {
+        return 0;
+    }
+    return keycode | (mods & MOD_MASK_SHIFT ? EXPAND_SHIFT : 0);
+}
+
+FJ_HOT bool expand_process_record(uint16_t keycode, keyrecord_t *record) {
+    if (!expand_enabled || !record->event.pressed) {
+        return true;
+    }
+    uint8_t symbol = expand_symbol(keycode, record);
+    if (symbol == EXPAND_SHIFT) {
+        return true;
+    }
+    if (symbol == 0) {
+        expand_restart();
+        return true;
+    }
+
+    uint16_t node = expand_node;
+    uint16_t next = expand_child(node, symbol);
+    while (next == 0 && node != EXPAND_ROOT) {
+        node = expand_fail(node);
+        next = expand_child(node, symbol);
+    }
+    expand_node = next ? next : EXPAND_ROOT;
+    if (next == 0) {
+        return true;
+    }
+
+    uint8_t node_head[4];
+    expand_read(node_head, next, sizeof(node_head));
+    uint16_t text = (node_head[2] << 8) | node_head[3];
+    if (text == 0 || text >= FJ_EXPAND_SIZE) {
+        return true;
+    }
+    expand_send(text, node_head[1]);
+    expand_restart();
+    return false;
+}
+
+FJ_COLD void expand_init(void) {
+    uint8_t magic;
+    expand_read(&magic, 0, 1);
+    expand_enabled = magic == EXPAND_MAGIC;
+    expand_restart();
+}
+
+FJ_COLD void expand_reset(void) {
+    uint8_t magic = 0;
+    via_update_custom_config(&magic, FJ_CONFIG_EXPAND_OFFSET, 1);
+    expand_enabled = false;
+}
+
+FJ_COLD bool expand_via_custom_value(uint8_t *data, uint8_t length) {
+    // data = [ command_id, channel_id, value_id, value_data ]
+    uint8_t *command_id = &(data[0]);
+    uint8_t *value_id   = &(data[2]);
+    uint8_t *value_data = &(data[3]);
+
+    switch (*value_id) {
+        case id_fj_expand_size:
+            if (*command_id == id_custom_get_value) {
+                value_data[0] = FJ_EXPAND_SIZE >> 8;
+                value_data[1] = FJ_EXPAND_SIZE & 0xFF;
+            }
+            return true;
+        case id_fj_expand_data:
+            break;
+        default:
+            return false;
+    }
+
+    // value_data = [ offset hi, offset lo, size, bytes ... ]
+    uint16_t offset = (value_data[0] << 8) | value_data[1];
+    uint8_t  size   = value_data[2];
+    if (length < 7 || size > length - 7 || offset + size > FJ_EXPAND_SIZE) {
+        *command_id = id_unhandled;
+        return true;
+    }
+    if (*command_id == id_custom_get_value) {
+        expand_read(&value_data[3], offset, size);
+    } else if (*command_id == id_custom_set_value) {
+        via_update_custom_config(&value_data[3], FJ_CONFIG_EXPAND_OFFSET + offset, size);
+        // The tool writes the magic byte last, once the rest is in place.
+        expand_init();
+    }
+    return true;
+}
@@ -0,0 +1,25 @@
+/*
+Copyright 2026 <felix@fjlaboratories.com>
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+void expand_init(void);
+void expand_reset(void);
+bool expand_process_record(uint16_t keycode, keyrecord_t *record);
+
+// Handles id_fj_expand_* values on the VIA custom channel, returns false for anything else.
+bool expand_via_custom_value(uint8_t *data, uint8_t length);
@@ -0,0 +1,293 @@
+/*
+Copyright 2026 <felix@fjlaboratories.com>
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "fjlabs.h"
+
+#ifdef VIA_ENABLE
+#    include "via.h"
+#endif
+#ifdef FJ_KEYMAP_STORE_ENABLE
+#    include "keymap_store.h"
+#endif
+#ifdef FJ_BOOT_ENABLE
+#    include "boot.h"
+#endif
+#ifdef FJ_COMBO_ENABLE
+#    include "combos.h"
+#endif
+#ifdef FJ_MACRO_COALESCE_ENABLE
+#    include "macros.h"
+#endif
+#ifdef FJ_LAYER_REEVAL_ENABLE
+#    include "layer_reeval.h"
+#endif
+#ifdef FJ_LATENCY_ENABLE
+#    include "latency.h"
+#endif
+#ifdef FJ_WAKE_ENABLE
+#    include "wake.h"
+#endif
+#ifdef FJ_EXPAND_ENABLE
+#    include "expand.h"
+#endif
+#ifdef FJ_MATRIX_TRACE_ENABLE
+#    include "matrix_trace.h"
+#endif
+#ifdef FJ_MOUSE_ENABLE
+#    include "mouse.h"
+#endif
+
+/* A layer-tap on the MO(1) position resolves to the layer the moment a
+ * second key goes down, so chording Fn+key never waits for TAPPING_TERM and
+ * a lone tap is sent on release. Mod-taps keep the permissive-hold rule. */
+FJ_HOT bool get_hold_on_other_key_press(uint16_t keycode, keyrecord_t *record) {
+    return IS_QK_LAYER_TAP(keycode);
+}
+
+void keyboard_pre_init_user(void) {
+#ifdef FJ_BOOT_ENABLE
+    boot_pre_init();
+#endif
+}
+
+void keyboard_post_init_user(void) {
+#ifdef FJ_KEYMAP_STORE_ENABLE
+    keymap_store_init();
+#endif
+#ifdef FJ_COMBO_ENABLE
+    combos_init();
+#endif
+#ifdef FJ_EXPAND_ENABLE
+    expand_init();
+#endif
+#ifdef FJ_BOOT_ENABLE
+    boot_post_init();
+#endif
+#ifdef FJ_LATENCY_ENABLE
+    latency_init();
+#endif
+}
+
+#if defined(FJ_BOOT_ENABLE) || defined(FJ_LATENCY_ENABLE) || defined(FJ_WAKE_ENABLE)
+void notify_usb_device_state_change_user(enum usb_device_state usb_device_state) {
+    bool configured = usb_device_state == USB_DEVICE_STATE_CONFIGURED;
+#    ifdef FJ_BOOT_ENABLE
+    if (configured) {
+        boot_usb_configured();
+    }
+#    endif
+#    ifdef FJ_LATENCY_ENABLE
+    latency_usb_state(configured);
+#    endif
+#    ifdef FJ_WAKE_ENABLE
+    wake_usb_state(configured);
+#    endif
+}
+#endif
+
+#ifdef FJ_WAKE_ENABLE
+void suspend_power_down_user(void) {
+    wake_suspend();
+}
+
+void suspend_wakeup_init_user(void) {
+    wake_resume();
+}
+#endif
+
+#if defined(FJ_COMBO_ENABLE) || defined(FJ_LATENCY_ENABLE) || defined(FJ_WAKE_ENABLE)
+FJ_HOT bool pre_process_record_user(uint16_t keycode, keyrecord_t *record) {
+#    ifdef FJ_WAKE_ENABLE
+    if (!wake_pre_process_record(record)) {
+        return false;
+    }
+#    endif
+#    ifdef FJ_COMBO_ENABLE
+    if (!combos_pre_process_record(record)) {
+        return false;
+    }
+#    endif
+#    ifdef FJ_LATENCY_ENABLE
+    latency_record_start(keycode);
+#    endif
+    return true;
+}
+#endif
+
+#if defined(FJ_COMBO_ENABLE) || defined(FJ_LATENCY_ENABLE) || defined(FJ_WAKE_ENABLE) || defined(FJ_MOUSE_ENABLE)
+FJ_HOT void housekeeping_task_user(void) {
+#    ifdef FJ_WAKE_ENABLE
+    wake_task();
+#    endif
+#    ifdef FJ_COMBO_ENABLE
+    combos_task();
+#    endif
+#    ifdef FJ_MOUSE_ENABLE
+    mouse_task();
+#    endif
+#    ifdef FJ_LATENCY_ENABLE
+    latency_task();
+#    endif
+}
+#endif
+
+#if defined(FJ_LATENCY_ENABLE) || defined(FJ_WAKE_ENABLE) || defined(FJ_MATRIX_TRACE_ENABLE)
+FJ_HOT void matrix_scan_user(void) {
+#    ifdef FJ_LATENCY_ENABLE
+    latency_scan();
+#    endif
+#    ifdef FJ_WAKE_ENABLE
+    wake_scan();
+#    endif
+#    ifdef FJ_MATRIX_TRACE_ENABLE
+    matrix_trace_scan();
+#    endif
+}
+#endif
+
+#ifdef FJ_LATENCY_ENABLE
+FJ_HOT void post_process_record_user(uint16_t keycode, keyrecord_t *record) {
+    latency_record_end(keycode);
+}
+#endif
+
+static FJ_HOT bool fj_process_record(uint16_t keycode, keyrecord_t *record) {
+#ifdef FJ_BOOT_ENABLE
+    if (record->event.pressed) {
+        boot_first_key();
+    }
+#endif
+#ifdef FJ_LAYER_REEVAL_ENABLE
+    layer_reeval_record(keycode, record);
+#endif
+#ifdef FJ_LATENCY_ENABLE
+    if (!latency_process_record(keycode, record)) {
+        return false;
+    }
+#endif
+#ifdef FJ_PROFILE_ENABLE
+    if (!keymap_store_process_record(keycode, record)) {
+        return false;
+    }
+#endif
+#ifdef FJ_MACRO_COALESCE_ENABLE
+    if (!macros_process_record(keycode, record)) {
+        return false;
+    }
+#endif
+#ifdef FJ_MOUSE_ENABLE
+    if (!mouse_process_record(keycode, record)) {
+        return false;
+    }
+#endif
+#ifdef FJ_EXPAND_ENABLE
+    if (!expand_process_record(keycode, record)) {
+        return false;
+    }
+#endif
+    return true;
+}
+
+FJ_HOT bool process_record_user(uint16_t keycode, keyrecord_t *record) {
+    if (fj_process_record(keycode, record)) {
+        return true;
+    }
+#ifdef FJ_LATENCY_ENABLE
+    // Events handled here never reach post_process_record_user.
+    latency_record_end(keycode);
+#endif
+    return false;
+}
+
+#ifdef FJ_LAYER_REEVAL_ENABLE
+FJ_HOT layer_state_t layer_state_set_user(layer_state_t state) {
+    return layer_reeval_state(state);
+}
+#endif
+
+void eeconfig_init_user(void) {
+    eeconfig_update_user(0);
+#ifdef FJ_KEYMAP_STORE_ENABLE
+    keymap_store_reset();
+#endif
+#ifdef FJ_COMBO_ENABLE
+    combos_reset();
+#endif
+#ifdef FJ_EXPAND_ENABLE
+    expand_reset();
+#endif
+}
+
+#ifdef VIA_ENABLE
+/* Pipelined raw HID: the host may put a request id in the last byte of a
+ * report and keep up to FJ_VIA_PIPELINE_DEPTH requests in flight. Reports
+ * are answered one at a time in the order they arrive, and no handler
+ * touches the last byte of a request whose payload stops short of it, so
+ * the id comes back in the answer. id_fj_protocol tells the host. */
+#    define FJ_VIA_PROTOCOL_VERSION 1
+#    ifndef FJ_VIA_PIPELINE_DEPTH
+#        define FJ_VIA_PIPELINE_DEPTH 4
+#    endif
+
+static FJ_COLD bool fj_via_protocol(uint8_t *data, uint8_t length) {
+    // data = [ command_id, channel_id, value_id, version, depth ]
+    if (data[2] != id_fj_protocol) {
+        return false;
+    }
+    if (data[0] != id_custom_get_value || length < 5) {
+        data[0] = id_unhandled;
+        return true;
+    }
+    data[3] = FJ_VIA_PROTOCOL_VERSION;
+    data[4] = FJ_VIA_PIPELINE_DEPTH;
+    return true;
+}
+
+FJ_COLD bool via_command_kb(uint8_t *data, uint8_t length) {
+#    ifdef FJ_LATENCY_ENABLE
+    latency_via();
+#    endif
+#    ifdef FJ_KEYMAP_STORE_ENABLE
+    if (keymap_store_via_command(data, length)) {
+        return true;
+    }
+#    endif
+    return false;
+}
+
+FJ_COLD void via_custom_value_command_kb(uint8_t *data, uint8_t length) {
+    // data = [ command_id, channel_id, value_id, value_data ]
+    if (data[1] == id_custom_channel) {
+        if (fj_via_protocol(data, length)) {
+            return;
+        }
+#    ifdef FJ_PROFILE_ENABLE
+        if (keymap_store_via_custom_value(data, length)) {
+            return;
+        }
+#    endif
+#    ifdef FJ_COMBO_ENABLE
+        if (combos_via_custom_value(data, length)) {
+            return;
+        }
+#    endif
+#    ifdef FJ_EXPAND_ENABLE
+        if (expand_via_custom_value(data, length)) {
+            return;
+        }
+#    endif
+    }
+    data[0] = id_unhandled;
+}
+#endif
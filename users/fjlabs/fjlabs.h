@@ -0,0 +1,36 @@
+/*
+Copyright 2026 <felix@fjlaboratories.com>
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include QMK_KEYBOARD_H
+
+/* Value ids on VIA's id_custom_channel, answered by the userspace modules. */
+enum fj_custom_value_id {
+    id_fj_combo_count = 0x40,
+    id_fj_combo,
+    id_fj_profile_count,
+    id_fj_profile,
+    id_fj_expand_size,
+    id_fj_expand_data,
+    id_fj_protocol,
+};
+
+/* Userspace keycodes. FJ_PROFILE_0 + n selects profile bank n. */
+enum fj_keycodes {
+    FJ_PROFILE_NEXT = QK_USER,
+    FJ_PROFILE_0,
+    FJ_PROFILE_MAX = FJ_PROFILE_0 + 15,
+    FJ_LATENCY_REPORT,
+};
@@ -0,0 +1,477 @@
+/*
+Copyright 2026 <felix@fjlaboratories.com>
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "fjlabs.h"
+#include "keymap_store.h"
+#include "dynamic_keymap.h"
+#include "raw_hid.h"
+#include "via.h"
+
+#ifdef FJ_COMPACT_KEYMAP_ENABLE
+#    include "compact_keymap.h"
+#    define KEYMAP_STORE_LAYERS (DYNAMIC_KEYMAP_LAYER_COUNT + FJ_COMPACT_KEYMAP_LAYERS)
+#else
+#    define KEYMAP_STORE_LAYERS DYNAMIC_KEYMAP_LAYER_COUNT
+#endif
+
+#define KEYMAP_STORE_KEYS (MATRIX_ROWS * MATRIX_COLS)
+
+#ifdef FJ_KEYMAP_MIRROR_ENABLE
+#    include <string.h>
+#endif
+
+#ifdef FJ_PROFILE_ENABLE
+_Static_assert(KEYMAP_STORE_LAYERS >= FJ_PROFILE_COUNT * FJ_PROFILE_LAYERS, "Not enough stored layers for FJ_PROFILE_COUNT banks.");
+
+/* Profile banks are runs of FJ_PROFILE_LAYERS stored layers. Everything
+ * above the raw accessors sees the active bank only, so switching banks is
+ * a change of keymap_store_base and nothing is copied. The active bank is
+ * kept in one byte of the VIA custom config, KEYMAP_STORE_UNSEEDED after a
+ * reset until the banks have been filled from the first one. */
+#    define KEYMAP_STORE_UNSEEDED 0xFF
+#    define KEYMAP_STORE_VISIBLE_LAYERS FJ_PROFILE_LAYERS
+
+static uint8_t keymap_store_profile = 0;
+static uint8_t keymap_store_base    = 0;
+#else
+#    define KEYMAP_STORE_VISIBLE_LAYERS KEYMAP_STORE_LAYERS
+#    define keymap_store_base 0
+#endif
+
+static uint16_t keymap_store_get_raw(uint8_t layer, uint8_t row, uint8_t column) {
+    if (layer < DYNAMIC_KEYMAP_LAYER_COUNT) {
+        return dynamic_keymap_get_keycode(layer, row, column);
+    }
+#ifdef FJ_COMPACT_KEYMAP_ENABLE
+    return compact_keymap_get_keycode(layer - DYNAMIC_KEYMAP_LAYER_COUNT, row, column);
+#else
+    return KC_NO;
+#endif
+}
+
+// Returns false if the key could not be stored.
+static bool keymap_store_set_raw(uint8_t layer, uint8_t row, uint8_t column, uint16_t keycode) {
+    if (layer < DYNAMIC_KEYMAP_LAYER_COUNT) {
+        dynamic_keymap_set_keycode(layer, row, column, keycode);
+        return true;
+    }
+#ifdef FJ_COMPACT_KEYMAP_ENABLE
+    return compact_keymap_set_keycode(layer - DYNAMIC_KEYMAP_LAYER_COUNT, row, column, keycode);
+#else
+    return false;
+#endif
+}
+
+#ifdef FJ_KEYMAP_MIRROR_ENABLE
+/* A RAM copy of the visible layers, so a keycode lookup never reads EEPROM.
+ * The lowest FJ_KEYMAP_MIRROR_LAYERS are copied whole. The layers above
+ * them keep a bitmap of their non-transparent keys, a running count of set
+ * bits per bitmap byte, and those keys' keycodes packed into a pool of
+ * FJ_KEYMAP_MIRROR_ENTRIES shared by all of them. Keys that do not fit the
+ * pool are read from the store as before. Every write goes through
+ * keymap_store_set_keycode, so the copy only changes with the store. */
+#    ifndef FJ_KEYMAP_MIRROR_LAYERS
+#        ifdef __AVR__
+#            define FJ_KEYMAP_MIRROR_LAYERS 1
+#        else
+#            define FJ_KEYMAP_MIRROR_LAYERS KEYMAP_STORE_VISIBLE_LAYERS
+#        endif
+#    endif
+#    if FJ_KEYMAP_MIRROR_LAYERS < 1 || FJ_KEYMAP_MIRROR_LAYERS > KEYMAP_STORE_VISIBLE_LAYERS
+#        error "FJ_KEYMAP_MIRROR_LAYERS must be between 1 and the layers VIA can see"
+#    endif
+#    define KEYMAP_MIRROR_SPARSE_LAYERS (KEYMAP_STORE_VISIBLE_LAYERS - FJ_KEYMAP_MIRROR_LAYERS)
+#    ifndef FJ_KEYMAP_MIRROR_ENTRIES
+#        define FJ_KEYMAP_MIRROR_ENTRIES KEYMAP_STORE_KEYS
+#    endif
+
+static uint16_t keymap_mirror[FJ_KEYMAP_MIRROR_LAYERS][KEYMAP_STORE_KEYS];
+
+#    if KEYMAP_MIRROR_SPARSE_LAYERS > 0
+_Static_assert(KEYMAP_STORE_KEYS <= 255, "The sparse keymap mirror counts keys in a byte.");
+
+#        define KEYMAP_MIRROR_BITMAP_BYTES ((KEYMAP_STORE_KEYS + 7) / 8)
+
+static uint8_t  keymap_mirror_used[KEYMAP_MIRROR_SPARSE_LAYERS][KEYMAP_MIRROR_BITMAP_BYTES];
+static uint8_t  keymap_mirror_rank[KEYMAP_MIRROR_SPARSE_LAYERS][KEYMAP_MIRROR_BITMAP_BYTES];
+static uint16_t keymap_mirror_start[KEYMAP_MIRROR_SPARSE_LAYERS];
+static uint8_t  keymap_mirror_count[KEYMAP_MIRROR_SPARSE_LAYERS];
+static uint16_t keymap_mirror_pool[FJ_KEYMAP_MIRROR_ENTRIES];
+static bool     keymap_mirror_dirty = false;
+
+// Packs the sparse layers into the pool, in layer order.
+static FJ_COLD void keymap_mirror_pack(void) {
+    uint16_t next = 0;
+    for (uint8_t sparse = 0; sparse < KEYMAP_MIRROR_SPARSE_LAYERS; sparse++) {
+        uint8_t layer = keymap_store_base + FJ_KEYMAP_MIRROR_LAYERS + sparse;
+        uint8_t rank  = 0;
+        uint8_t count = 0;
+        memset(keymap_mirror_used[sparse], 0, KEYMAP_MIRROR_BITMAP_BYTES);
+        keymap_mirror_start[sparse] = next;
+        for (uint8_t key = 0; key < KEYMAP_STORE_KEYS; key++) {
+            if (key % 8 == 0) {
+                keymap_mirror_rank[sparse][key / 8] = rank;
+            }
+            uint16_t keycode = keymap_store_get_raw(layer, key / MATRIX_COLS, key % MATRIX_COLS);
+            if (keycode == KC_TRNS) {
+                continue;
+            }
+            keymap_mirror_used[sparse][key / 8] |= 1 << (key % 8);
+            rank++;
+            if (next < FJ_KEYMAP_MIRROR_ENTRIES) {
+                keymap_mirror_pool[next++] = keycode;
+                count++;
+            }
+        }
+        keymap_mirror_count[sparse] = count;
+    }
+    keymap_mirror_dirty = false;
+}
+#    endif
+
+static FJ_COLD void keymap_mirror_load(void) {
+    for (uint8_t layer = 0; layer < FJ_KEYMAP_MIRROR_LAYERS; layer++) {
+        for (uint8_t key = 0; key < KEYMAP_STORE_KEYS; key++) {
+            keymap_mirror[layer][key] = keymap_store_get_raw(keymap_store_base + layer, key / MATRIX_COLS, key % MATRIX_COLS);
+        }
+    }
+#    if KEYMAP_MIRROR_SPARSE_LAYERS > 0
+    keymap_mirror_pack();
+#    endif
+}
+
+/* Keys that stay in place are updated where they are, anything that moves
+ * the packed keys marks the pool for keymap_mirror_flush. */
+static void keymap_mirror_set(uint8_t layer, uint8_t key, uint16_t keycode) {
+    if (layer < FJ_KEYMAP_MIRROR_LAYERS) {
+        keymap_mirror[layer][key] = keycode;
+        return;
+    }
+#    if KEYMAP_MIRROR_SPARSE_LAYERS > 0
+    uint8_t sparse = layer - FJ_KEYMAP_MIRROR_LAYERS;
+    uint8_t bits   = keymap_mirror_used[sparse][key / 8];
+    uint8_t bit    = 1 << (key % 8);
+    if ((keycode == KC_TRNS) != !(bits & bit)) {
+        keymap_mirror_dirty = true;
+    } else if (keycode != KC_TRNS) {
+        uint8_t rank = keymap_mirror_rank[sparse][key / 8] + __builtin_popcount(bits & (bit - 1));
+        if (rank < keymap_mirror_count[sparse]) {
+            keymap_mirror_pool[keymap_mirror_start[sparse] + rank] = keycode;
+        }
+    }
+#    endif
+}
+
+static void keymap_mirror_flush(void) {
+#    if KEYMAP_MIRROR_SPARSE_LAYERS > 0
+    if (keymap_mirror_dirty) {
+        keymap_mirror_pack();
+    }
+#    endif
+}
+#endif
+
+#ifdef FJ_PROFILE_ENABLE
+// Every bank starts out as a copy of the first one.
+static void keymap_store_seed_profiles(void) {
+    for (uint8_t layer = FJ_PROFILE_LAYERS; layer < FJ_PROFILE_COUNT * FJ_PROFILE_LAYERS; layer++) {
+        for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+            for (uint8_t column = 0; column < MATRIX_COLS; column++) {
+                keymap_store_set_raw(layer, row, column, keymap_store_get_raw(layer % FJ_PROFILE_LAYERS, row, column));
+            }
+        }
+    }
+}
+
+uint8_t keymap_store_get_profile(void) {
+    return keymap_store_profile;
+}
+
+void keymap_store_set_profile(uint8_t profile) {
+    if (profile >= FJ_PROFILE_COUNT || profile == keymap_store_profile) {
+        return;
+    }
+    // Keys held now were looked up in the old bank, let go of all of them.
+    layer_clear();
+    clear_keyboard();
+    keymap_store_profile = profile;
+    keymap_store_base    = profile * FJ_PROFILE_LAYERS;
+    via_update_custom_config(&keymap_store_profile, FJ_CONFIG_PROFILE_OFFSET, 1);
+#    ifdef FJ_KEYMAP_MIRROR_ENABLE
+    keymap_mirror_load();
+#    endif
+}
+
+FJ_HOT bool keymap_store_process_record(uint16_t keycode, keyrecord_t *record) {
+    if (keycode == FJ_PROFILE_NEXT) {
+        if (record->event.pressed) {
+            keymap_store_set_profile((keymap_store_profile + 1) % FJ_PROFILE_COUNT);
+        }
+        return false;
+    }
+    if (keycode >= FJ_PROFILE_0 && keycode <= FJ_PROFILE_MAX) {
+        if (record->event.pressed) {
+            keymap_store_set_profile(keycode - FJ_PROFILE_0);
+        }
+        return false;
+    }
+    return true;
+}
+
+FJ_COLD bool keymap_store_via_custom_value(uint8_t *data, uint8_t length) {
+    // data = [ command_id, channel_id, value_id, value_data ]
+    uint8_t *command_id = &(data[0]);
+    uint8_t *value_id   = &(data[2]);
+    uint8_t *value_data = &(data[3]);
+
+    switch (*value_id) {
+        case id_fj_profile_count:
+            if (*command_id == id_custom_get_value) {
+                value_data[0] = FJ_PROFILE_COUNT;
+            }
+            return true;
+        case id_fj_profile:
+            if (*command_id == id_custom_get_value) {
+                value_data[0] = keymap_store_profile;
+            } else if (*command_id == id_custom_set_value) {
+                keymap_store_set_profile(value_data[0]);
+            }
+            return true;
+        default:
+            return false;
+    }
+}
+#endif
+
+void keymap_store_init(void) {
+#ifdef FJ_COMPACT_KEYMAP_ENABLE
+    compact_keymap_init();
+#endif
+#ifdef FJ_PROFILE_ENABLE
+    uint8_t profile;
+    via_read_custom_config(&profile, FJ_CONFIG_PROFILE_OFFSET, 1);
+    if (profile == KEYMAP_STORE_UNSEEDED) {
+        keymap_store_seed_profiles();
+    }
+    if (profile >= FJ_PROFILE_COUNT) {
+        profile = 0;
+        via_update_custom_config(&profile, FJ_CONFIG_PROFILE_OFFSET, 1);
+    }
+    keymap_store_profile = profile;
+    keymap_store_base    = profile * FJ_PROFILE_LAYERS;
+#endif
+#ifdef FJ_KEYMAP_MIRROR_ENABLE
+    keymap_mirror_load();
+#endif
+}
+
+/* Called from eeconfig_init_user, which may run before the stock dynamic
+ * keymap is reset, so the banks are seeded by the next keymap_store_init. */
+FJ_COLD void keymap_store_reset(void) {
+#ifdef FJ_COMPACT_KEYMAP_ENABLE
+    compact_keymap_reset();
+#endif
+#ifdef FJ_PROFILE_ENABLE
+    uint8_t profile = KEYMAP_STORE_UNSEEDED;
+    via_update_custom_config(&profile, FJ_CONFIG_PROFILE_OFFSET, 1);
+#endif
+}
+
+uint8_t keymap_store_layer_count(void) {
+    return KEYMAP_STORE_VISIBLE_LAYERS;
+}
+
+FJ_HOT uint16_t keymap_store_get_keycode(uint8_t layer, uint8_t row, uint8_t column) {
+    if (layer >= KEYMAP_STORE_VISIBLE_LAYERS || row >= MATRIX_ROWS || column >= MATRIX_COLS) {
+        return KC_NO;
+    }
+#ifdef FJ_KEYMAP_MIRROR_ENABLE
+    uint8_t key = row * MATRIX_COLS + column;
+    if (layer < FJ_KEYMAP_MIRROR_LAYERS) {
+        return keymap_mirror[layer][key];
+    }
+#    if KEYMAP_MIRROR_SPARSE_LAYERS > 0
+    uint8_t sparse = layer - FJ_KEYMAP_MIRROR_LAYERS;
+    uint8_t bits   = keymap_mirror_used[sparse][key / 8];
+    uint8_t bit    = 1 << (key % 8);
+    if (!(bits & bit)) {
+        return KC_TRNS;
+    }
+    uint8_t rank = keymap_mirror_rank[sparse][key / 8] + __builtin_popcount(bits & (bit - 1));
+    if (rank < keymap_mirror_count[sparse]) {
+        return keymap_mirror_pool[keymap_mirror_start[sparse] + rank];
+    }
+#    endif
+#endif
+    return keymap_store_get_raw(keymap_store_base + layer, row, column);
+}
+
+// Stores one key; a caller writing several flushes the mirror once after the last.
+static bool keymap_store_set_visible(uint8_t layer, uint8_t row, uint8_t column, uint16_t keycode) {
+    if (layer >= KEYMAP_STORE_VISIBLE_LAYERS || row >= MATRIX_ROWS || column >= MATRIX_COLS) {
+        return false;
+    }
+    bool stored = keymap_store_set_raw(keymap_store_base + layer, row, column, keycode);
+#ifdef FJ_KEYMAP_MIRROR_ENABLE
+    // Read back, the compact store refuses writes it has no room for.
+    keymap_mirror_set(layer, row * MATRIX_COLS + column, keymap_store_get_raw(keymap_store_base + layer, row, column));
+#endif
+    return stored;
+}
+
+FJ_COLD bool keymap_store_set_keycode(uint8_t layer, uint8_t row, uint8_t column, uint16_t keycode) {
+    bool stored = keymap_store_set_visible(layer, row, column, keycode);
+#ifdef FJ_KEYMAP_MIRROR_ENABLE
+    keymap_mirror_flush();
+#endif
+    return stored;
+}
+
+// The VIA keymap buffer is every layer back to back, two big-endian bytes per key.
+static uint16_t keymap_store_get_buffer_key(uint16_t key) {
+    uint8_t layer = key / KEYMAP_STORE_KEYS;
+    key %= KEYMAP_STORE_KEYS;
+    return keymap_store_get_keycode(layer, key / MATRIX_COLS, key % MATRIX_COLS);
+}
+
+static bool keymap_store_set_buffer_key(uint16_t key, uint16_t keycode) {
+    uint8_t layer = key / KEYMAP_STORE_KEYS;
+    key %= KEYMAP_STORE_KEYS;
+    return keymap_store_set_visible(layer, key / MATRIX_COLS, key % MATRIX_COLS, keycode);
+}
+
+static void keymap_store_get_buffer(uint16_t offset, uint8_t size, uint8_t *data) {
+    uint16_t end = KEYMAP_STORE_VISIBLE_LAYERS * KEYMAP_STORE_KEYS * 2;
+    for (uint8_t i = 0; i < size; i++, offset++) {
+        if (offset >= end) {
+            data[i] = 0;
+            continue;
+        }
+        uint16_t keycode = keymap_store_get_buffer_key(offset / 2);
+        data[i]          = (offset & 1) ? keycode & 0xFF : keycode >> 8;
+    }
+}
+
+// Returns false if any key could not be stored; the keys that could are kept.
+static bool keymap_store_set_buffer(uint16_t offset, uint8_t size, const uint8_t *data) {
+    uint16_t end = KEYMAP_STORE_VISIBLE_LAYERS * KEYMAP_STORE_KEYS * 2;
+    if (offset >= end) {
+        return true;
+    }
+    if (size > end - offset) {
+        size = end - offset;
+    }
+
+    // Assemble whole keycodes before storing them, so a half-written key
+    // never forces the compact store to widen a layer.
+    bool stored = true;
+    for (uint8_t i = 0; i < size;) {
+        uint16_t key     = (offset + i) / 2;
+        uint16_t keycode = ((offset + i) & 1) || i + 1 == size ? keymap_store_get_buffer_key(key) : 0;
+        do {
+            if ((offset + i) & 1) {
+                keycode = (keycode & 0xFF00) | data[i];
+            } else {
+                keycode = (keycode & 0x00FF) | (data[i] << 8);
+            }
+            i++;
+        } while (i < size && (offset + i) & 1);
+        stored &= keymap_store_set_buffer_key(key, keycode);
+    }
+#ifdef FJ_KEYMAP_MIRROR_ENABLE
+    keymap_mirror_flush();
+#endif
+    return stored;
+}
+
+FJ_COLD bool keymap_store_via_command(uint8_t *data, uint8_t length) {
+    uint8_t *command_id   = &(data[0]);
+    uint8_t *command_data = &(data[1]);
+
+    switch (*command_id) {
+        case id_dynamic_keymap_get_keycode: {
+            uint16_t keycode = keymap_store_get_keycode(command_data[0], command_data[1], command_data[2]);
+            command_data[3]  = keycode >> 8;
+            command_data[4]  = keycode & 0xFF;
+            break;
+        }
+        case id_dynamic_keymap_set_keycode: {
+            // A key the store has no room for is reported, so VIA does not show it as saved.
+            if (!keymap_store_set_keycode(command_data[0], command_data[1], command_data[2], (command_data[3] << 8) | command_data[4])) {
+                *command_id = id_unhandled;
+            }
+            break;
+        }
+        case id_dynamic_keymap_reset: {
+            dynamic_keymap_reset();
+            keymap_store_reset();
+            keymap_store_init();
+            break;
+        }
+        case id_dynamic_keymap_get_layer_count: {
+            command_data[0] = keymap_store_layer_count();
+            break;
+        }
+        case id_dynamic_keymap_get_buffer: {
+            uint16_t offset = (command_data[0] << 8) | command_data[1];
+            uint8_t  size   = command_data[2];
+            if (size > length - 4) {
+                size = length - 4;
+            }
+            keymap_store_get_buffer(offset, size, &command_data[3]);
+            break;
+        }
+        case id_dynamic_keymap_set_buffer: {
+            uint16_t offset = (command_data[0] << 8) | command_data[1];
+            uint8_t  size   = command_data[2];
+            if (size > length - 4) {
+                size = length - 4;
+            }
+            if (!keymap_store_set_buffer(offset, size, &command_data[3])) {
+                *command_id = id_unhandled;
+            }
+            break;
+        }
+        case id_eeprom_reset: {
+            // The stock reset, then the store and everything loaded from it.
+            via_eeprom_set_valid(false);
+            eeconfig_init_via();
+            keymap_store_reset();
+            keymap_store_init();
+            break;
+        }
+        default:
+            return false;
+    }
+
+    raw_hid_send(data, length);
+    return true;
+}
+
+/* Keycode lookups go through the store so the layers above the stock
+ * dynamic keymap resolve like any other layer. */
+FJ_HOT uint16_t keymap_key_to_keycode(uint8_t layer, keypos_t key) {
+    if (key.row < MATRIX_ROWS && key.col < MATRIX_COLS) {
+        return keymap_store_get_keycode(layer, key.row, key.col);
+    }
+#if defined(ENCODER_ENABLE) && defined(ENCODER_MAP_ENABLE)
+    if (key.row == KEYLOC_ENCODER_CW && key.col < NUM_ENCODERS) {
+        return keycode_at_encodermap_location(layer, key.col, true);
+    }
+    if (key.row == KEYLOC_ENCODER_CCW && key.col < NUM_ENCODERS) {
+        return keycode_at_encodermap_location(layer, key.col, false);
+    }
+#endif
+    return KC_NO;
+}
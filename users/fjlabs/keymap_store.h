@@ -0,0 +1,40 @@
+/*
+Copyright 2026 <felix@fjlaboratories.com>
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Every keymap layer VIA can see, whichever store it lives in. */
+void     keymap_store_init(void);
+void     keymap_store_reset(void);
+uint8_t  keymap_store_layer_count(void);
+uint16_t keymap_store_get_keycode(uint8_t layer, uint8_t row, uint8_t column);
+bool     keymap_store_set_keycode(uint8_t layer, uint8_t row, uint8_t column, uint16_t keycode);
+
+// Handles the VIA dynamic keymap commands, returns false for anything else.
+bool keymap_store_via_command(uint8_t *data, uint8_t length);
+
+#ifdef FJ_PROFILE_ENABLE
+/* Profile banks: only the active bank is visible through the calls above. */
+uint8_t keymap_store_get_profile(void);
+void    keymap_store_set_profile(uint8_t profile);
+
+// Handles the FJ_PROFILE_* keycodes, returns false if the keycode was consumed.
+bool keymap_store_process_record(uint16_t keycode, keyrecord_t *record);
+
+// Handles id_fj_profile* values on the VIA custom channel, returns false for anything else.
+bool keymap_store_via_custom_value(uint8_t *data, uint8_t length);
+#endif
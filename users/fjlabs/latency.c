@@ -0,0 +1,245 @@
+/*
+Copyright 2026 <felix@fjlaboratories.com>
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "fjlabs.h"
+#include "latency.h"
+
+/* Keeps the worst time seen for each stage of the main loop and prints a
+ * line on the console whenever one goes over its bound. The stages are cut
+ * at the userspace hooks:
+ *
+ *   scan    end of the previous loop to matrix_scan_user: USB events,
+ *           matrix scan and debounce;
+ *   gesc, layer, lighting, macro, key
+ *           pre_process_record_user to post_process_record_user (or to
+ *           process_record_user returning false) for one event, by the
+ *           keycode it resolved to, including the reports it sent;
+ *   via     a raw HID command reaching via_command_kb to the end of that
+ *           loop, so the stock handlers and their EEPROM writes count;
+ *   loop    one whole pass of the main loop. Passes that played a macro or
+ *           answered VIA only count under those stages.
+ *
+ * Bounds are FJ_LATENCY_BOUND_<STAGE> in microseconds. */
+
+#ifndef FJ_LATENCY_BOUND_SCAN
+#    define FJ_LATENCY_BOUND_SCAN 1000
+#endif
+#ifndef FJ_LATENCY_BOUND_KEY
+#    define FJ_LATENCY_BOUND_KEY 1000
+#endif
+#ifndef FJ_LATENCY_BOUND_MACRO
+#    define FJ_LATENCY_BOUND_MACRO 250000
+#endif
+#ifndef FJ_LATENCY_BOUND_VIA
+#    define FJ_LATENCY_BOUND_VIA 50000
+#endif
+#ifndef FJ_LATENCY_BOUND_LOOP
+#    define FJ_LATENCY_BOUND_LOOP 5000
+#endif
+
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+/* Cortex-M3/M4/M7 count core cycles in the DWT. */
+#    define LATENCY_DEMCR (*(volatile uint32_t *)0xE000EDFCu)
+#    define LATENCY_DWT_CTRL (*(volatile uint32_t *)0xE0001000u)
+#    define LATENCY_DWT_CYCCNT (*(volatile uint32_t *)0xE0001004u)
+#    ifndef FJ_LATENCY_CPU_MHZ
+#        ifdef STM32_SYSCLK
+#            define FJ_LATENCY_CPU_MHZ (STM32_SYSCLK / 1000000)
+#        else
+#            error "FJ_LATENCY_CPU_MHZ must be set to the core clock in MHz"
+#        endif
+#    endif
+#    define LATENCY_RESOLUTION 1
+
+static inline uint32_t latency_now(void) {
+    return LATENCY_DWT_CYCCNT;
+}
+
+static inline uint32_t latency_us(uint32_t ticks) {
+    return ticks / FJ_LATENCY_CPU_MHZ;
+}
+#else
+/* Elsewhere only the millisecond timer is there, so short stages read as
+ * 0 or 1000 us. */
+#    define LATENCY_RESOLUTION 1000
+
+static inline uint32_t latency_now(void) {
+    return timer_read32();
+}
+
+static inline uint32_t latency_us(uint32_t ticks) {
+    return ticks * 1000;
+}
+#endif
+
+enum latency_stage {
+    LATENCY_SCAN,
+    LATENCY_GESC,
+    LATENCY_LAYER,
+    LATENCY_LIGHTING,
+    LATENCY_MACRO,
+    LATENCY_KEY,
+    LATENCY_VIA,
+    LATENCY_LOOP,
+    LATENCY_STAGE_COUNT,
+};
+
+static const char *const latency_name[LATENCY_STAGE_COUNT] = {
+    [LATENCY_SCAN]     = "scan",
+    [LATENCY_GESC]     = "gesc",
+    [LATENCY_LAYER]    = "layer",
+    [LATENCY_LIGHTING] = "lighting",
+    [LATENCY_MACRO]    = "macro",
+    [LATENCY_KEY]      = "key",
+    [LATENCY_VIA]      = "via",
+    [LATENCY_LOOP]     = "loop",
+};
+
+static const uint32_t latency_bound[LATENCY_STAGE_COUNT] = {
+    [LATENCY_SCAN]     = FJ_LATENCY_BOUND_SCAN,
+    [LATENCY_GESC]     = FJ_LATENCY_BOUND_KEY,
+    [LATENCY_LAYER]    = FJ_LATENCY_BOUND_KEY,
+    [LATENCY_LIGHTING] = FJ_LATENCY_BOUND_KEY,
+    [LATENCY_MACRO]    = FJ_LATENCY_BOUND_MACRO,
+    [LATENCY_KEY]      = FJ_LATENCY_BOUND_KEY,
+    [LATENCY_VIA]      = FJ_LATENCY_BOUND_VIA,
+    [LATENCY_LOOP]     = FJ_LATENCY_BOUND_LOOP,
+};
+
+static uint32_t latency_worst[LATENCY_STAGE_COUNT];
+
+static uint32_t latency_loop_start;
+static uint32_t latency_record_at;
+static uint32_t latency_via_at;
+static uint16_t latency_keycode;
+static bool     latency_configured = true;
+static bool     latency_pending;
+static bool     latency_via_pending;
+// The current pass is not a plain loop: first pass, USB change, macro or VIA.
+static bool latency_loop_excused = true;
+
+static void latency_print(uint8_t stage) {
+    uprintf("latency: %-8s %7lu us, bound %7lu us\n", latency_name[stage], (unsigned long)latency_worst[stage], (unsigned long)latency_bound[stage]);
+}
+
+static void latency_add(uint8_t stage, uint32_t start) {
+    uint32_t us = latency_us(latency_now() - start);
+    if (us <= latency_worst[stage]) {
+        return;
+    }
+    latency_worst[stage] = us;
+    if (us > latency_bound[stage]) {
+        latency_print(stage);
+    }
+}
+
+static uint8_t latency_stage_of(uint16_t keycode) {
+    if (keycode == QK_GRAVE_ESCAPE) {
+        return LATENCY_GESC;
+    }
+    // Not the one-shot ranges, which sit between the layer ones.
+    if (IS_QK_LAYER_TAP(keycode) || IS_QK_LAYER_MOD(keycode) || IS_QK_TO(keycode) || IS_QK_MOMENTARY(keycode) || IS_QK_DEF_LAYER(keycode) || IS_QK_TOGGLE_LAYER(keycode) || IS_QK_LAYER_TAP_TOGGLE(keycode)) {
+        return LATENCY_LAYER;
+    }
+    if (IS_QK_LIGHTING(keycode)) {
+        return LATENCY_LIGHTING;
+    }
+    if (IS_QK_MACRO(keycode)) {
+        return LATENCY_MACRO;
+    }
+    return LATENCY_KEY;
+}
+
+FJ_COLD void latency_init(void) {
+#if LATENCY_RESOLUTION == 1
+    LATENCY_DEMCR |= 1u << 24; // TRCENA
+    LATENCY_DWT_CYCCNT = 0;
+    LATENCY_DWT_CTRL |= 1u; // CYCCNTENA
+#endif
+    latency_loop_start   = latency_now();
+    latency_loop_excused = true;
+}
+
+// Suspend and enumeration stall the loop on purpose, and the suspend loop
+// scans the matrix without running the main loop.
+FJ_COLD void latency_usb_state(bool configured) {
+    latency_configured   = configured;
+    latency_loop_excused = true;
+}
+
+FJ_HOT void latency_scan(void) {
+    if (latency_configured) {
+        latency_add(LATENCY_SCAN, latency_loop_start);
+    }
+    // Events held back by the tapping or combo buffers from earlier loops
+    // are processed from a timer, not an event; they are not timed.
+    latency_pending = false;
+}
+
+FJ_HOT void latency_record_start(uint16_t keycode) {
+    latency_keycode   = keycode;
+    latency_record_at = latency_now();
+    latency_pending   = true;
+}
+
+/* Buffered events (a tap-hold key waiting for the next press, keys held by
+ * a combo) are processed inside a later event, whose time then includes
+ * them. Their own end does not match the pending keycode and is ignored. */
+FJ_HOT void latency_record_end(uint16_t keycode) {
+    if (!latency_pending || keycode != latency_keycode) {
+        return;
+    }
+    latency_pending = false;
+    uint8_t stage   = latency_stage_of(keycode);
+    latency_add(stage, latency_record_at);
+    if (stage == LATENCY_MACRO) {
+        latency_loop_excused = true;
+    }
+}
+
+FJ_COLD void latency_via(void) {
+    if (!latency_via_pending) {
+        latency_via_at      = latency_now();
+        latency_via_pending = true;
+    }
+    latency_loop_excused = true;
+}
+
+FJ_HOT void latency_task(void) {
+    if (latency_via_pending) {
+        latency_add(LATENCY_VIA, latency_via_at);
+        latency_via_pending = false;
+    }
+    if (!latency_loop_excused) {
+        latency_add(LATENCY_LOOP, latency_loop_start);
+    }
+    latency_loop_excused = false;
+    latency_pending      = false;
+    latency_loop_start   = latency_now();
+}
+
+FJ_HOT bool latency_process_record(uint16_t keycode, keyrecord_t *record) {
+    if (keycode != FJ_LATENCY_REPORT) {
+        return true;
+    }
+    // Printing the report is not a key worth timing.
+    latency_pending = false;
+    if (record->event.pressed) {
+        uprintf("latency: resolution %u us\n", (unsigned)LATENCY_RESOLUTION);
+        for (uint8_t stage = 0; stage < LATENCY_STAGE_COUNT; stage++) {
+            latency_print(stage);
+        }
+    }
+    return false;
+}
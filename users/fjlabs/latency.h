@@ -0,0 +1,27 @@
+/*
+Copyright 2026 <felix@fjlaboratories.com>
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+void latency_init(void);
+void latency_usb_state(bool configured);
+void latency_scan(void);
+void latency_record_start(uint16_t keycode);
+void latency_record_end(uint16_t keycode);
+void latency_via(void);
+void latency_task(void);
+bool latency_process_record(uint16_t keycode, keyrecord_t *record);
@@ -0,0 +1,90 @@
+/*
+Copyright 2026 <felix@fjlaboratories.com>
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "fjlabs.h"
+#include "layer_reeval.h"
+
+/* Keys held across a layer change normally keep the keycode they were
+ * pressed with until they are released. This keeps a short list of the
+ * held keys that sent a basic keycode or a modifier, and when the layer
+ * state changes it looks each of them up again: a key whose keycode
+ * changed is released and pressed as the new one, and its source layer is
+ * moved so its release resolves to the new keycode too. Keys that resolve
+ * to anything else (layer keys, lighting, macros, ...) are left as they
+ * were. The cost depends on the number of held keys and layers, not on
+ * the matrix size. */
+
+#ifndef FJ_LAYER_REEVAL_KEYS
+#    define FJ_LAYER_REEVAL_KEYS 8
+#endif
+
+typedef struct {
+    keypos_t key;
+    uint8_t  keycode;
+} layer_reeval_key_t;
+
+static layer_reeval_key_t layer_reeval_keys[FJ_LAYER_REEVAL_KEYS];
+static uint8_t            layer_reeval_count;
+
+static bool layer_reeval_plain(uint16_t keycode) {
+    return keycode == KC_NO || IS_BASIC_KEYCODE(keycode) || IS_MODIFIER_KEYCODE(keycode);
+}
+
+FJ_HOT void layer_reeval_record(uint16_t keycode, keyrecord_t *record) {
+    if (!IS_KEYEVENT(record->event)) {
+        return;
+    }
+    keypos_t key = record->event.key;
+
+    for (uint8_t i = 0; i < layer_reeval_count; i++) {
+        if (layer_reeval_keys[i].key.row == key.row && layer_reeval_keys[i].key.col == key.col) {
+            layer_reeval_keys[i] = layer_reeval_keys[--layer_reeval_count];
+            break;
+        }
+    }
+    if (record->event.pressed && layer_reeval_plain(keycode) && layer_reeval_count < FJ_LAYER_REEVAL_KEYS) {
+        layer_reeval_keys[layer_reeval_count++] = (layer_reeval_key_t){.key = key, .keycode = keycode};
+    }
+}
+
+FJ_HOT layer_state_t layer_reeval_state(layer_state_t state) {
+    layer_state_t active = state | default_layer_state;
+
+    for (uint8_t i = 0; i < layer_reeval_count; i++) {
+        layer_reeval_key_t *held    = &layer_reeval_keys[i];
+        uint8_t             layer   = 0;
+        uint16_t            keycode = KC_TRNS;
+        for (int8_t l = get_highest_layer(active); l >= 0 && keycode == KC_TRNS; l--) {
+            if (active & ((layer_state_t)1 << l)) {
+                layer   = l;
+                keycode = keymap_key_to_keycode(l, held->key);
+            }
+        }
+        if (keycode == KC_TRNS || keycode == held->keycode || !layer_reeval_plain(keycode)) {
+            continue;
+        }
+
+        if (held->keycode != KC_NO) {
+            unregister_code(held->keycode);
+        }
+        if (keycode != KC_NO) {
+            register_code(keycode);
+        }
+        held->keycode = keycode;
+#ifndef STRICT_LAYER_RELEASE
+        update_source_layers_cache(held->key, layer);
+#endif
+    }
+    return state;
+}
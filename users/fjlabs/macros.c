@@ -0,0 +1,242 @@
+/*
+Copyright 2026 <felix@fjlaboratories.com>
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "fjlabs.h"
+#include "macros.h"
+#include "dynamic_keymap.h"
+#include "send_string.h"
+
+/* Plays VIA macros like dynamic_keymap_macro_send, but each character's key
+ * stays down until the report that presses the next one releases it, so a
+ * character costs one report instead of a press and a release. Only one
+ * key goes down per report, so the host cannot type them out of order. A
+ * repeated key is released on its own first, and a change of shift/AltGr
+ * goes out with the release, before the next key, as send_char sends it.
+ * Every escape code (tap, down, up, delay) releases the held key before it
+ * is played, so sequences that depend on order are played exactly as
+ * written. Macros with escape codes this player does not know are left to
+ * the stock player.
+ *
+ * FJ_MACRO_BATCH above 1 also presses runs of characters with the same
+ * shift/AltGr state and strictly ascending keycodes together. That relies
+ * on the host typing the keys of one report in ascending order, which
+ * neither the 6KRO array nor the NKRO bitmap promises; check it on every
+ * host before turning it on. */
+
+#ifndef FJ_MACRO_BATCH
+#    define FJ_MACRO_BATCH 1
+#endif
+
+// Same default as the stock player.
+#ifndef DYNAMIC_KEYMAP_MACRO_DELAY
+#    define DYNAMIC_KEYMAP_MACRO_DELAY TAP_CODE_DELAY
+#endif
+
+#define MACROS_CHUNK 16
+
+typedef struct {
+    uint16_t offset;
+    uint16_t end;
+    uint8_t  chunk[MACROS_CHUNK];
+    uint16_t chunk_offset;
+} macros_reader_t;
+
+static uint8_t macros_read(macros_reader_t *reader) {
+    if (reader->offset >= reader->end) {
+        return 0;
+    }
+    if (reader->offset < reader->chunk_offset || reader->offset >= reader->chunk_offset + MACROS_CHUNK) {
+        reader->chunk_offset = reader->offset;
+        dynamic_keymap_macro_get_buffer(reader->offset, MACROS_CHUNK, reader->chunk);
+    }
+    return reader->chunk[reader->offset++ - reader->chunk_offset];
+}
+
+// Positions the reader at the start of macro `id`, false if there is no such macro.
+static bool macros_seek(macros_reader_t *reader, uint8_t id) {
+    reader->offset       = 0;
+    reader->end          = dynamic_keymap_macro_get_buffer_size();
+    reader->chunk_offset = 0xFFFF;
+    if (id >= dynamic_keymap_macro_get_count()) {
+        return false;
+    }
+    while (id > 0 && reader->offset < reader->end) {
+        id -= macros_read(reader) == 0;
+    }
+    return id == 0;
+}
+
+// The characters for the next report, and the keys the last one holds down.
+static uint8_t macros_batch[FJ_MACRO_BATCH];
+static uint8_t macros_batch_count;
+static uint8_t macros_batch_mods;
+static uint8_t macros_down[FJ_MACRO_BATCH];
+static uint8_t macros_down_count;
+static uint8_t macros_down_mods;
+
+static uint8_t macros_batch_limit(void) {
+#ifdef NKRO_ENABLE
+    if (keymap_config.nkro) {
+        return FJ_MACRO_BATCH;
+    }
+#endif
+    return KEYBOARD_REPORT_KEYS < FJ_MACRO_BATCH ? KEYBOARD_REPORT_KEYS : FJ_MACRO_BATCH;
+}
+
+// Takes the held keys out of the report without sending it.
+static void macros_lift(void) {
+    for (uint8_t i = 0; i < macros_down_count; i++) {
+        del_key(macros_down[i]);
+    }
+    del_weak_mods(macros_down_mods);
+    macros_down_count = 0;
+    macros_down_mods  = 0;
+}
+
+static void macros_release(void) {
+    if (macros_down_count > 0) {
+        macros_lift();
+        send_keyboard_report();
+    }
+}
+
+// Presses the pending characters in the report that releases the previous ones.
+static void macros_flush(void) {
+    if (macros_batch_count == 0) {
+        return;
+    }
+    bool repeat = false;
+    for (uint8_t i = 0; i < macros_batch_count; i++) {
+        for (uint8_t j = 0; j < macros_down_count; j++) {
+            repeat |= macros_batch[i] == macros_down[j];
+        }
+    }
+    uint8_t mods = macros_down_mods;
+    macros_lift();
+    /* A key that stayed down would not be typed again, and, as send_char
+     * does, modifiers change in a report of their own before the keys they
+     * apply to go down. One report releases the held keys for both. */
+    if (repeat || macros_batch_mods != mods) {
+        add_weak_mods(macros_batch_mods);
+        send_keyboard_report();
+    }
+    for (uint8_t i = 0; i < macros_batch_count; i++) {
+        add_key(macros_batch[i]);
+        macros_down[i] = macros_batch[i];
+    }
+    add_weak_mods(macros_batch_mods);
+    send_keyboard_report();
+    macros_down_count  = macros_batch_count;
+    macros_down_mods   = macros_batch_mods;
+    macros_batch_count = 0;
+#if TAP_CODE_DELAY > 0
+    wait_ms(TAP_CODE_DELAY);
+#endif
+#if DYNAMIC_KEYMAP_MACRO_DELAY > 0
+    wait_ms(DYNAMIC_KEYMAP_MACRO_DELAY);
+#endif
+}
+
+// Sends everything pending and lets go of it.
+static void macros_finish(void) {
+    macros_flush();
+    macros_release();
+}
+
+static void macros_send_char(uint8_t ascii) {
+    uint8_t keycode = pgm_read_byte(&ascii_to_keycode_lut[ascii]);
+    if (keycode == KC_NO) {
+        return;
+    }
+    uint8_t mods = 0;
+    if (PGM_LOADBIT(ascii_to_shift_lut, ascii)) {
+        mods |= MOD_BIT(KC_LEFT_SHIFT);
+    }
+    if (PGM_LOADBIT(ascii_to_altgr_lut, ascii)) {
+        mods |= MOD_BIT(KC_RIGHT_ALT);
+    }
+
+    if (macros_batch_count > 0 && (mods != macros_batch_mods || keycode <= macros_batch[macros_batch_count - 1] || macros_batch_count == macros_batch_limit())) {
+        macros_flush();
+    }
+    macros_batch_mods                  = mods;
+    macros_batch[macros_batch_count++] = keycode;
+}
+
+/* Walks macro `id`. With send false nothing is sent and the result tells
+ * whether every escape code in it is one this player handles. */
+static bool macros_play(uint8_t id, bool send) {
+    macros_reader_t reader;
+    if (!macros_seek(&reader, id)) {
+        return false;
+    }
+
+    for (uint8_t c = macros_read(&reader); c != 0; c = macros_read(&reader)) {
+        if (c != SS_QMK_PREFIX) {
+            if (send && c < 0x80) {
+                macros_send_char(c);
+            }
+            continue;
+        }
+
+        uint8_t code = macros_read(&reader);
+        if (code == SS_TAP_CODE || code == SS_DOWN_CODE || code == SS_UP_CODE) {
+            uint8_t keycode = macros_read(&reader);
+            if (keycode == 0) {
+                break;
+            }
+            if (send) {
+                macros_finish();
+                if (code == SS_TAP_CODE) {
+                    tap_code(keycode);
+                } else if (code == SS_DOWN_CODE) {
+                    register_code(keycode);
+                } else {
+                    unregister_code(keycode);
+                }
+            }
+        } else if (code == SS_DELAY_CODE) {
+            uint16_t ms = 0;
+            for (c = macros_read(&reader); c >= '0' && c <= '9'; c = macros_read(&reader)) {
+                ms = ms * 10 + c - '0';
+            }
+            if (c != '|') {
+                break;
+            }
+            if (send) {
+                macros_finish();
+                wait_ms(ms);
+            }
+        } else {
+            return false;
+        }
+    }
+
+    if (send) {
+        macros_finish();
+    }
+    return true;
+}
+
+FJ_HOT bool macros_process_record(uint16_t keycode, keyrecord_t *record) {
+    // The stock player does nothing on release either.
+    if (!IS_QK_MACRO(keycode) || !record->event.pressed) {
+        return true;
+    }
+    if (!macros_play(keycode - QK_MACRO, false)) {
+        return true;
+    }
+    macros_play(keycode - QK_MACRO, true);
+    return false;
+}
@@ -0,0 +1,45 @@
+/*
+Copyright 2026 <felix@fjlaboratories.com>
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "fjlabs.h"
+#include "matrix_trace.h"
+
+/* Records raw switch behaviour for util/timing_tune.py. The build turns
+ * debouncing off (config.h), so the matrix matrix_scan_user sees is the raw
+ * one, and every key change is printed on the console as
+ *
+ *     matrix: <ms> <scan> <row> <col> <0|1>
+ *
+ * with the scan count, which gives the tuner the scan interval. Bounces
+ * show up as extra changes; this build is for recording only. */
+
+static matrix_row_t matrix_trace_rows[MATRIX_ROWS];
+static uint32_t     matrix_trace_scans;
+
+FJ_HOT void matrix_trace_scan(void) {
+    matrix_trace_scans++;
+    for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+        matrix_row_t now     = matrix_get_row(row);
+        matrix_row_t changed = now ^ matrix_trace_rows[row];
+        if (!changed) {
+            continue;
+        }
+        matrix_trace_rows[row] = now;
+        for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+            if (changed & ((matrix_row_t)1 << col)) {
+                uprintf("matrix: %lu %lu %u %u %u\n", (unsigned long)timer_read32(), (unsigned long)matrix_trace_scans, row, col, (unsigned)((now >> col) & 1));
+            }
+        }
+    }
+}
@@ -0,0 +1,216 @@
+/*
+Copyright 2026 <felix@fjlaboratories.com>
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "fjlabs.h"
+#include "mouse.h"
+
+/* Mouse keys with fixed-point motion, in place of the stock mousekey.c.
+ * Velocity is kept in 1/65536 px per ms and ramps linearly from
+ * FJ_MOUSE_SPEED_MIN to FJ_MOUSE_SPEED_MAX px/s over FJ_MOUSE_ACCEL_TIME ms.
+ * Each report moves the cursor by the distance actually covered since the
+ * last one, and the fraction of a pixel left over is carried to the next,
+ * so the speed is exact at any report rate. Reports go out every
+ * FJ_MOUSE_INTERVAL ms from housekeeping, after the keyboard task, and only
+ * while something is moving; keyboard reports never wait for them.
+ *
+ * MS_ACL0 and MS_ACL1 cap the speed at a quarter and a half while held,
+ * MS_ACL2 goes to full speed at once. */
+
+#ifndef FJ_MOUSE_INTERVAL
+#    define FJ_MOUSE_INTERVAL 2
+#endif
+#ifndef FJ_MOUSE_SPEED_MIN
+#    define FJ_MOUSE_SPEED_MIN 120
+#endif
+#ifndef FJ_MOUSE_SPEED_MAX
+#    define FJ_MOUSE_SPEED_MAX 1600
+#endif
+#ifndef FJ_MOUSE_ACCEL_TIME
+#    define FJ_MOUSE_ACCEL_TIME 500
+#endif
+#ifndef FJ_MOUSE_WHEEL_SPEED
+#    define FJ_MOUSE_WHEEL_SPEED 16
+#endif
+
+#define MOUSE_ONE 65536L
+// px (or wheel steps) per second to MOUSE_ONE units per ms.
+#define MOUSE_PER_MS(speed) ((int32_t)((speed) * MOUSE_ONE / 1000))
+#define MOUSE_ACCEL ((MOUSE_PER_MS(FJ_MOUSE_SPEED_MAX) - MOUSE_PER_MS(FJ_MOUSE_SPEED_MIN)) / FJ_MOUSE_ACCEL_TIME)
+// A long main loop pass is not made up for in one jump.
+#define MOUSE_MAX_STEP 32
+#ifdef MOUSE_EXTENDED_REPORT
+#    define MOUSE_XY_MAX INT16_MAX
+#else
+#    define MOUSE_XY_MAX INT8_MAX
+#endif
+
+_Static_assert(MOUSE_PER_MS(FJ_MOUSE_SPEED_MAX) * MOUSE_MAX_STEP < INT32_MAX / 2, "FJ_MOUSE_SPEED_MAX is too high.");
+_Static_assert(FJ_MOUSE_SPEED_MIN <= FJ_MOUSE_SPEED_MAX, "FJ_MOUSE_SPEED_MIN is above FJ_MOUSE_SPEED_MAX.");
+
+enum mouse_direction {
+    MOUSE_UP    = 1 << 0,
+    MOUSE_DOWN  = 1 << 1,
+    MOUSE_LEFT  = 1 << 2,
+    MOUSE_RIGHT = 1 << 3,
+};
+
+static report_mouse_t mouse_report;
+static uint8_t        mouse_cursor;
+static uint8_t        mouse_wheel;
+static uint8_t        mouse_accel;
+static int32_t        mouse_speed;
+static int32_t        mouse_x, mouse_y, mouse_v, mouse_h;
+static uint16_t       mouse_timer;
+
+static int8_t mouse_axis(uint8_t held, uint8_t negative, uint8_t positive) {
+    return !!(held & positive) - !!(held & negative);
+}
+
+static int32_t mouse_speed_cap(void) {
+    if (mouse_accel & (1 << 0)) {
+        return MOUSE_PER_MS(FJ_MOUSE_SPEED_MAX) / 4;
+    }
+    if (mouse_accel & (1 << 1)) {
+        return MOUSE_PER_MS(FJ_MOUSE_SPEED_MAX) / 2;
+    }
+    return MOUSE_PER_MS(FJ_MOUSE_SPEED_MAX);
+}
+
+// Takes the whole units out of an accumulator, up to what a report can carry.
+static int16_t mouse_take(int32_t *accumulator, int16_t limit) {
+    int32_t whole = *accumulator / MOUSE_ONE;
+    if (whole > limit) {
+        whole = limit;
+    } else if (whole < -limit) {
+        whole = -limit;
+    }
+    *accumulator -= whole * MOUSE_ONE;
+    return whole;
+}
+
+static void mouse_send(void) {
+    host_mouse_send(&mouse_report);
+    mouse_report.x = mouse_report.y = mouse_report.v = mouse_report.h = 0;
+}
+
+FJ_HOT bool mouse_process_record(uint16_t keycode, keyrecord_t *record) {
+    if (keycode < QK_MOUSE_CURSOR_UP || keycode > QK_MOUSE_ACCELERATION_2) {
+        return true;
+    }
+    bool pressed = record->event.pressed;
+    if (keycode <= QK_MOUSE_CURSOR_RIGHT) {
+        uint8_t bit = 1 << (keycode - QK_MOUSE_CURSOR_UP);
+        if (pressed) {
+            if (!mouse_cursor) {
+                mouse_speed = MOUSE_PER_MS(FJ_MOUSE_SPEED_MIN);
+            }
+            if (!mouse_cursor && !mouse_wheel) {
+                mouse_timer = timer_read();
+            }
+            mouse_cursor |= bit;
+            // A tap moves one pixel right away, for nudging.
+            int8_t x = mouse_axis(bit, MOUSE_LEFT, MOUSE_RIGHT);
+            int8_t y = mouse_axis(bit, MOUSE_UP, MOUSE_DOWN);
+            mouse_x += x * MOUSE_ONE;
+            mouse_y += y * MOUSE_ONE;
+        } else {
+            mouse_cursor &= ~bit;
+            if (!mouse_cursor) {
+                // A tap released before mouse_task runs still moves its pixel.
+                mouse_report.x = mouse_take(&mouse_x, MOUSE_XY_MAX);
+                mouse_report.y = mouse_take(&mouse_y, MOUSE_XY_MAX);
+                mouse_x = mouse_y = 0;
+                if (mouse_report.x || mouse_report.y) {
+                    mouse_send();
+                }
+            }
+        }
+    } else if (keycode <= QK_MOUSE_BUTTON_8) {
+        uint8_t bit = 1 << (keycode - QK_MOUSE_BUTTON_1);
+        mouse_report.buttons = pressed ? mouse_report.buttons | bit : mouse_report.buttons & ~bit;
+        mouse_send();
+    } else if (keycode <= QK_MOUSE_WHEEL_RIGHT) {
+        uint8_t bit = 1 << (keycode - QK_MOUSE_WHEEL_UP);
+        if (pressed) {
+            if (!mouse_cursor && !mouse_wheel) {
+                mouse_timer = timer_read();
+            }
+            mouse_wheel |= bit;
+            // The first step goes out with the next report.
+            mouse_v += mouse_axis(bit, MOUSE_DOWN, MOUSE_UP) * MOUSE_ONE;
+            mouse_h += mouse_axis(bit, MOUSE_LEFT, MOUSE_RIGHT) * MOUSE_ONE;
+        } else {
+            mouse_wheel &= ~bit;
+            if (!mouse_wheel) {
+                mouse_report.v = mouse_take(&mouse_v, INT8_MAX);
+                mouse_report.h = mouse_take(&mouse_h, INT8_MAX);
+                mouse_v = mouse_h = 0;
+                if (mouse_report.v || mouse_report.h) {
+                    mouse_send();
+                }
+            }
+        }
+    } else {
+        uint8_t bit = 1 << (keycode - QK_MOUSE_ACCELERATION_0);
+        mouse_accel = pressed ? mouse_accel | bit : mouse_accel & ~bit;
+    }
+    return false;
+}
+
+FJ_HOT void mouse_task(void) {
+    if (!mouse_cursor && !mouse_wheel) {
+        return;
+    }
+    uint16_t elapsed = timer_elapsed(mouse_timer);
+    if (elapsed < FJ_MOUSE_INTERVAL) {
+        return;
+    }
+    mouse_timer += elapsed;
+    if (elapsed > MOUSE_MAX_STEP) {
+        elapsed = MOUSE_MAX_STEP;
+    }
+
+    if (mouse_cursor) {
+        int32_t cap   = mouse_speed_cap();
+        int32_t speed = mouse_accel & (1 << 2) ? cap : mouse_speed + MOUSE_ACCEL * elapsed;
+        if (speed > cap) {
+            speed = cap;
+        }
+        // The distance under the ramp, not the end speed times the time.
+        int32_t distance = (mouse_speed + speed) / 2 * elapsed;
+        mouse_speed      = speed;
+
+        int8_t x = mouse_axis(mouse_cursor, MOUSE_LEFT, MOUSE_RIGHT);
+        int8_t y = mouse_axis(mouse_cursor, MOUSE_UP, MOUSE_DOWN);
+        if (x && y) {
+            // 181/256 is 1/sqrt(2), so diagonals move at the same speed.
+            distance = distance / 256 * 181;
+        }
+        mouse_x += x * distance;
+        mouse_y += y * distance;
+    }
+    if (mouse_wheel) {
+        int32_t steps = MOUSE_PER_MS(FJ_MOUSE_WHEEL_SPEED) * elapsed;
+        mouse_v += mouse_axis(mouse_wheel, MOUSE_DOWN, MOUSE_UP) * steps;
+        mouse_h += mouse_axis(mouse_wheel, MOUSE_LEFT, MOUSE_RIGHT) * steps;
+    }
+
+    mouse_report.x = mouse_take(&mouse_x, MOUSE_XY_MAX);
+    mouse_report.y = mouse_take(&mouse_y, MOUSE_XY_MAX);
+    mouse_report.v = mouse_take(&mouse_v, INT8_MAX);
+    mouse_report.h = mouse_take(&mouse_h, INT8_MAX);
+    if (mouse_report.x || mouse_report.y || mouse_report.v || mouse_report.h) {
+        mouse_send();
+    }
+}
@@ -0,0 +1,126 @@
+SRC += fjlabs.c
+
+FJ_COMPACT_KEYMAP_ENABLE ?= no
+FJ_BOOT_TRACE_ENABLE ?= no
+FJ_DEFER_RGB_INIT ?= no
+FJ_COMBO_ENABLE ?= no
+FJ_PROFILE_ENABLE ?= no
+FJ_MACRO_COALESCE_ENABLE ?= no
+FJ_LAYER_REEVAL_ENABLE ?= no
+FJ_HOT_PATH_OPT ?= no
+FJ_LATENCY_ENABLE ?= no
+FJ_WAKE_ENABLE ?= no
+FJ_EXPAND_ENABLE ?= no
+FJ_KEYMAP_MIRROR_ENABLE ?= no
+FJ_MATRIX_TRACE_ENABLE ?= no
+FJ_MOUSE_ENABLE ?= no
+
+ifeq ($(strip $(FJ_COMPACT_KEYMAP_ENABLE)), yes)
+    ifneq ($(strip $(VIA_ENABLE)), yes)
+        $(error FJ_COMPACT_KEYMAP_ENABLE requires VIA_ENABLE)
+    endif
+    OPT_DEFS += -DFJ_COMPACT_KEYMAP_ENABLE
+    SRC += compact_keymap.c
+    FJ_KEYMAP_STORE_ENABLE = yes
+    FJ_VIA_CONFIG_ENABLE = yes
+endif
+
+ifeq ($(strip $(FJ_COMBO_ENABLE)), yes)
+    ifneq ($(strip $(VIA_ENABLE)), yes)
+        $(error FJ_COMBO_ENABLE requires VIA_ENABLE)
+    endif
+    OPT_DEFS += -DFJ_COMBO_ENABLE
+    SRC += combos.c
+    FJ_VIA_CONFIG_ENABLE = yes
+endif
+
+ifeq ($(strip $(FJ_PROFILE_ENABLE)), yes)
+    ifneq ($(strip $(VIA_ENABLE)), yes)
+        $(error FJ_PROFILE_ENABLE requires VIA_ENABLE)
+    endif
+    OPT_DEFS += -DFJ_PROFILE_ENABLE
+    FJ_KEYMAP_STORE_ENABLE = yes
+    FJ_VIA_CONFIG_ENABLE = yes
+endif
+
+ifeq ($(strip $(FJ_EXPAND_ENABLE)), yes)
+    ifneq ($(strip $(VIA_ENABLE)), yes)
+        $(error FJ_EXPAND_ENABLE requires VIA_ENABLE)
+    endif
+    OPT_DEFS += -DFJ_EXPAND_ENABLE
+    SRC += expand.c
+    FJ_VIA_CONFIG_ENABLE = yes
+endif
+
+ifeq ($(strip $(FJ_KEYMAP_MIRROR_ENABLE)), yes)
+    ifneq ($(strip $(VIA_ENABLE)), yes)
+        $(error FJ_KEYMAP_MIRROR_ENABLE requires VIA_ENABLE)
+    endif
+    OPT_DEFS += -DFJ_KEYMAP_MIRROR_ENABLE
+    FJ_KEYMAP_STORE_ENABLE = yes
+endif
+
+ifeq ($(strip $(FJ_MACRO_COALESCE_ENABLE)), yes)
+    ifneq ($(strip $(VIA_ENABLE)), yes)
+        $(error FJ_MACRO_COALESCE_ENABLE requires VIA_ENABLE)
+    endif
+    OPT_DEFS += -DFJ_MACRO_COALESCE_ENABLE
+    SRC += macros.c
+endif
+
+ifeq ($(strip $(FJ_LAYER_REEVAL_ENABLE)), yes)
+    OPT_DEFS += -DFJ_LAYER_REEVAL_ENABLE
+    SRC += layer_reeval.c
+endif
+
+ifeq ($(strip $(FJ_LATENCY_ENABLE)), yes)
+    OPT_DEFS += -DFJ_LATENCY_ENABLE
+    SRC += latency.c
+    CONSOLE_ENABLE = yes
+endif
+
+ifeq ($(strip $(FJ_WAKE_ENABLE)), yes)
+    OPT_DEFS += -DFJ_WAKE_ENABLE
+    SRC += wake.c
+endif
+
+ifeq ($(strip $(FJ_MOUSE_ENABLE)), yes)
+    OPT_DEFS += -DFJ_MOUSE_ENABLE
+    SRC += mouse.c
+    MOUSE_ENABLE = yes
+endif
+
+ifeq ($(strip $(FJ_MATRIX_TRACE_ENABLE)), yes)
+    OPT_DEFS += -DFJ_MATRIX_TRACE_ENABLE
+    SRC += matrix_trace.c
+    CONSOLE_ENABLE = yes
+endif
+
+ifeq ($(strip $(FJ_KEYMAP_STORE_ENABLE)), yes)
+    OPT_DEFS += -DFJ_KEYMAP_STORE_ENABLE
+    SRC += keymap_store.c
+endif
+
+ifeq ($(strip $(FJ_BOOT_TRACE_ENABLE)), yes)
+    OPT_DEFS += -DFJ_BOOT_TRACE_ENABLE
+    CONSOLE_ENABLE = yes
+    FJ_BOOT_ENABLE = yes
+endif
+
+ifeq ($(strip $(FJ_DEFER_RGB_INIT)), yes)
+    OPT_DEFS += -DFJ_DEFER_RGB_INIT
+    FJ_BOOT_ENABLE = yes
+endif
+
+ifeq ($(strip $(FJ_BOOT_ENABLE)), yes)
+    OPT_DEFS += -DFJ_BOOT_ENABLE
+    SRC += boot.c
+endif
+
+ifeq ($(strip $(FJ_VIA_CONFIG_ENABLE)), yes)
+    OPT_DEFS += -DFJ_VIA_CONFIG_ENABLE
+endif
+
+ifeq ($(strip $(FJ_HOT_PATH_OPT)), yes)
+    OPT_DEFS += -DFJ_HOT_PATH_OPT
+endif
@@ -0,0 +1,155 @@
+/*
+Copyright 2026 <felix@fjlaboratories.com>
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "fjlabs.h"
+#include "wake.h"
+
+/* While the host has the bus suspended the main loop stops, but the stock
+ * wakeup check keeps scanning the matrix, and matrix_scan_user with it.
+ * Every key edge seen there is recorded. Once the board is back, the
+ * events matrix_task makes for those keys are dropped, and the recorded
+ * edges and any new events are held until the host has configured the
+ * board and FJ_WAKE_SETTLE ms have passed. Then they are replayed in the
+ * order they happened, so the key that woke the host is typed even if it
+ * was released before the host was listening. Edges beyond FJ_WAKE_KEYS
+ * are not recorded; the replay ends with whatever events bring the keys
+ * to their current state.
+ *
+ * Layers, the matrix and the lighting state already stay in RAM across
+ * suspend, and the stock resume brings the LEDs back on its own. */
+
+#ifndef FJ_WAKE_KEYS
+#    define FJ_WAKE_KEYS 16
+#endif
+#ifndef FJ_WAKE_SETTLE
+#    define FJ_WAKE_SETTLE 10
+#endif
+
+enum wake_state {
+    WAKE_IDLE,
+    WAKE_SUSPENDED,
+    WAKE_WAITING,
+};
+
+typedef struct {
+    keypos_t key;
+    bool     pressed;
+} wake_edge_t;
+
+static uint8_t      wake_state;
+static bool         wake_configured = true;
+static bool         wake_replaying;
+static uint16_t     wake_timer;
+static wake_edge_t  wake_edges[FJ_WAKE_KEYS];
+static uint8_t      wake_edge_count;
+// The matrix as the recorded edges leave it.
+static matrix_row_t wake_matrix[MATRIX_ROWS];
+
+static bool wake_is_pressed(keypos_t key) {
+    return wake_matrix[key.row] & ((matrix_row_t)1 << key.col);
+}
+
+static bool wake_record(keypos_t key, bool pressed) {
+    if (wake_edge_count >= FJ_WAKE_KEYS) {
+        return false;
+    }
+    wake_edges[wake_edge_count++] = (wake_edge_t){.key = key, .pressed = pressed};
+    wake_matrix[key.row] ^= (matrix_row_t)1 << key.col;
+    return true;
+}
+
+FJ_COLD void wake_suspend(void) {
+    // Called on every pass of the suspend loop, only the first one counts.
+    if (wake_state == WAKE_SUSPENDED) {
+        return;
+    }
+    if (wake_state == WAKE_IDLE) {
+        for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+            wake_matrix[row] = matrix_get_row(row);
+        }
+        wake_edge_count = 0;
+    }
+    wake_state = WAKE_SUSPENDED;
+}
+
+FJ_COLD void wake_resume(void) {
+    if (wake_state != WAKE_SUSPENDED) {
+        return;
+    }
+    wake_state = WAKE_WAITING;
+    wake_timer = timer_read();
+}
+
+FJ_COLD void wake_usb_state(bool configured) {
+    wake_configured = configured;
+}
+
+FJ_HOT void wake_scan(void) {
+    if (wake_state != WAKE_SUSPENDED) {
+        return;
+    }
+    for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+        matrix_row_t changed = matrix_get_row(row) ^ wake_matrix[row];
+        for (uint8_t col = 0; changed; col++, changed >>= 1) {
+            if (changed & 1) {
+                keypos_t key = {.row = row, .col = col};
+                wake_record(key, !wake_is_pressed(key));
+            }
+        }
+    }
+}
+
+FJ_HOT bool wake_pre_process_record(keyrecord_t *record) {
+    if (wake_state != WAKE_WAITING || wake_replaying || !IS_KEYEVENT(record->event)) {
+        return true;
+    }
+    keypos_t key = record->event.key;
+    // matrix_task catching up with an edge that is already recorded.
+    if (wake_is_pressed(key) == record->event.pressed) {
+        return false;
+    }
+    wake_record(key, record->event.pressed);
+    return false;
+}
+
+static void wake_replay(keypos_t key, bool pressed) {
+    action_exec(MAKE_KEYEVENT(key.row, key.col, pressed));
+}
+
+static FJ_COLD void wake_finish(void) {
+    wake_replaying = true;
+    for (uint8_t i = 0; i < wake_edge_count; i++) {
+        wake_replay(wake_edges[i].key, wake_edges[i].pressed);
+    }
+    // Bring keys whose edges did not fit, or that changed after the last
+    // suspended scan without matrix_task seeing a change, to their state.
+    for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+        matrix_row_t now     = matrix_get_row(row);
+        matrix_row_t changed = now ^ wake_matrix[row];
+        for (uint8_t col = 0; changed; col++, changed >>= 1) {
+            if (changed & 1) {
+                wake_replay((keypos_t){.row = row, .col = col}, now & ((matrix_row_t)1 << col));
+            }
+        }
+    }
+    wake_replaying  = false;
+    wake_edge_count = 0;
+    wake_state      = WAKE_IDLE;
+}
+
+FJ_HOT void wake_task(void) {
+    if (wake_state == WAKE_WAITING && wake_configured && timer_elapsed(wake_timer) >= FJ_WAKE_SETTLE) {
+        wake_finish();
+    }
+}
@@ -0,0 +1,108 @@
+#!/usr/bin/env python3
+"""Checks every keymap in the userspace without cross-compiling anything.
+
+Each LAYOUT_* call is checked against the key count of that layout in the
+keyboard's definition, and every keycode expression is resolved against
+qmk_firmware's keycode headers plus the userspace headers, so typos, bad
+arguments to MO()/LT()/... and missing or extra keys are reported with
+their line numbers. Layer keys (MO, LT, TG, TO, TT, OSL, DF, LM) must name
+a layer the keymap has, or with VIA one of the layers VIA can see.
+
+    util/check_keymaps.py                  # every via keymap
+    util/check_keymaps.py -kb fjlabs/kf87  # one board
+"""
+import argparse
+import sys
+import time
+
+import qmk_tree
+
+# Layer keycode ranges, and how to get the layer out of a keycode in them.
+LAYER_KEYS = {
+    'QK_MOMENTARY': lambda keycode: keycode & 0x1F,
+    'QK_LAYER_TAP': lambda keycode: (keycode >> 8) & 0xF,
+    'QK_TOGGLE_LAYER': lambda keycode: keycode & 0x1F,
+    'QK_TO': lambda keycode: keycode & 0x1F,
+    'QK_LAYER_TAP_TOGGLE': lambda keycode: keycode & 0x1F,
+    'QK_ONE_SHOT_LAYER': lambda keycode: keycode & 0x1F,
+    'QK_DEF_LAYER': lambda keycode: keycode & 0x1F,
+    'QK_LAYER_MOD': lambda keycode: (keycode >> 5) & 0xF,
+}
+
+
+def layer_of(keycode, keycodes):
+    """Returns the layer a layer keycode switches to, None for any other keycode.
+    """
+    for name, layer in LAYER_KEYS.items():
+        if keycodes.known(f'{name}_MAX') and keycodes.value(name) <= keycode <= keycodes.value(f'{name}_MAX'):
+            return layer(keycode)
+    return None
+
+
+def check(keyboard, keymap_c, info, keycodes):
+    """Returns a list of (line, message) problems for one keymap.
+    """
+    problems = []
+    layers = qmk_tree.parse_keymap(keymap_c)
+    if not layers:
+        return [(1, 'no LAYOUT_* calls found')]
+
+    keycodes = keycodes.with_source(keymap_c)
+    count = qmk_tree.via_layer_count(keymap_c, info, len(layers))
+    for layer in layers:
+        keys = qmk_tree.layout(info, layer.macro)
+        if keys is None:
+            problems.append((layer.line, f'{keyboard} has no layout {layer.macro}'))
+        elif len(layer.keys) != len(keys):
+            problems.append((layer.line, f'layer {layer.name}: {layer.macro} takes {len(keys)} keys, got {len(layer.keys)}'))
+
+        for expr, line in layer.keys:
+            if not expr:
+                problems.append((line, f'layer {layer.name}: empty key'))
+                continue
+            try:
+                target = layer_of(keycodes.value(expr), keycodes)
+            except ValueError as e:
+                problems.append((line, f'layer {layer.name}: {expr}: {e}'))
+                continue
+            if target is not None and target >= count:
+                problems.append((line, f'layer {layer.name}: {expr}: layer {target} does not exist, only 0 to {count - 1} do'))
+
+    return problems
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('-kb', '--keyboard', action='append', help='only check these keyboards')
+    parser.add_argument('-km', '--keymap', default='via')
+    args = parser.parse_args()
+
+    start = time.perf_counter()
+    home = qmk_tree.qmk_home()
+    keycodes = qmk_tree.KeycodeTable(home, extra=sorted((qmk_tree.USERSPACE / 'users').glob('*/*.h')))
+    if not keycodes.known('KC_NO'):
+        print(f'no keycode headers found under {home}, set QMK_FIRMWARE_ROOT', file=sys.stderr)
+        return 2
+
+    checked = 0
+    failed = 0
+    for keyboard, keymap_c in qmk_tree.keymaps(args.keymap):
+        if args.keyboard and keyboard not in args.keyboard:
+            continue
+        try:
+            info = qmk_tree.keyboard_info(keyboard, home)
+            problems = check(keyboard, keymap_c, info, keycodes)
+        except (FileNotFoundError, ValueError) as e:
+            problems = [(1, str(e))]
+
+        checked += 1
+        failed += bool(problems)
+        for line, message in problems:
+            print(f'{keymap_c.relative_to(qmk_tree.USERSPACE)}:{line}: {message}')
+
+    print(f'{checked} keymaps checked, {failed} with errors, in {time.perf_counter() - start:.2f}s', file=sys.stderr)
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,167 @@
+#!/usr/bin/env python3
+"""Lists the features each via keymap can never reach, and optionally turns them off.
+
+A feature is prunable when it only does something in response to its own
+keycodes (or to tables the keymap has to define), none of those keycodes
+appear in keymap.c, the userspace C sources or the keyboard's own sources
+in qmk_firmware, and VIA can not assign them at runtime either. Every
+userspace source counts, whether the keymap's rules.mk builds it or not.
+Features that drive hardware or change every keypress (lighting, NKRO,
+auto shift, ...) are never pruned.
+
+    util/feature_audit.py                  # report every board
+    util/feature_audit.py -kb fjlabs/kf87  # one board
+    util/feature_audit.py --measure        # also build both ways and compare flash
+    util/feature_audit.py --apply          # write the result into each keymap's rules.mk
+"""
+import argparse
+import re
+import sys
+from pathlib import Path
+
+import qmk_tree
+
+
+class Feature:
+    def __init__(self, rule, prefixes=(), symbols=(), via=False, default='no'):
+        self.rule = rule
+        self.prefixes = prefixes  # keycode names that reach the feature
+        self.symbols = symbols  # keymap definitions that reach the feature
+        self.via = via  # offered by the VIA keycode picker
+        self.default = default  # QMK's own default when the keyboard says nothing
+
+
+# Only keycode-gated features are listed; anything else is left alone.
+FEATURES = (
+    Feature('GRAVE_ESC_ENABLE', prefixes=('QK_GESC', 'QK_GRAVE_ESCAPE'), via=True, default='yes'),
+    Feature('SPACE_CADET_ENABLE', prefixes=('SC_', 'KC_LSPO', 'KC_RSPC', 'KC_LCPO', 'KC_RCPC', 'KC_LAPO', 'KC_RAPC', 'KC_SFTENT'), via=True, default='yes'),
+    Feature('MAGIC_ENABLE', prefixes=('QK_MAGIC', 'MAGIC_', 'CL_', 'AG_', 'GU_', 'GE_', 'NK_', 'EC_', 'CG_', 'LAG_', 'RAG_', 'LCG_', 'RCG_', 'BS_'), via=True, default='yes'),
+    Feature('MOUSEKEY_ENABLE', prefixes=('MS_', 'KC_MS_', 'KC_BTN', 'KC_WH_', 'KC_ACL'), via=True),
+    Feature('EXTRAKEY_ENABLE', prefixes=('KC_AUDIO', 'KC_VOL', 'KC_MUTE', 'KC_MEDIA', 'KC_MPLY', 'KC_MSTP', 'KC_MNXT', 'KC_MPRV', 'KC_MFFD', 'KC_MRWD', 'KC_MSEL', 'KC_EJCT', 'KC_MAIL', 'KC_CALC', 'KC_MYCM', 'KC_WWW', 'KC_WSCH', 'KC_WHOM', 'KC_WBAK', 'KC_WFWD', 'KC_WSTP', 'KC_WREF', 'KC_WFAV', 'KC_BRIU', 'KC_BRID', 'KC_BRIGHTNESS', 'KC_SYSTEM', 'KC_PWR', 'KC_SLEP', 'KC_WAKE', 'KC_CPNL', 'KC_ASST', 'KC_MCTL', 'KC_LPAD'), via=True),
+    Feature('CAPS_WORD_ENABLE', prefixes=('CW_', 'QK_CAPS_WORD'), via=True),
+    Feature('KEY_LOCK_ENABLE', prefixes=('QK_LOCK',), via=True),
+    Feature('LAYER_LOCK_ENABLE', prefixes=('QK_LLCK', 'QK_LAYER_LOCK')),
+    Feature('LEADER_ENABLE', prefixes=('QK_LEAD', 'QK_LEADER')),
+    Feature('DYNAMIC_MACRO_ENABLE', prefixes=('DM_', 'QK_DYNAMIC_MACRO')),
+    Feature('UNICODE_ENABLE', prefixes=('UC(', 'UC_', 'QK_UNICODE')),
+    Feature('UNICODEMAP_ENABLE', prefixes=('UM(', 'UP(', 'QK_UNICODEMAP'), symbols=('unicode_map',)),
+    Feature('UCIS_ENABLE', symbols=('ucis_symbol_table',)),
+    Feature('SWAP_HANDS_ENABLE', prefixes=('SH_', 'QK_SWAP_HANDS'), symbols=('hand_swap_config',)),
+    Feature('TAP_DANCE_ENABLE', prefixes=('TD(', 'QK_TAP_DANCE'), symbols=('tap_dance_actions',)),
+    Feature('COMBO_ENABLE', symbols=('key_combos',)),
+    Feature('KEY_OVERRIDE_ENABLE', symbols=('key_overrides',)),
+    Feature('PROGRAMMABLE_BUTTON_ENABLE', prefixes=('PB_', 'QK_PROGRAMMABLE_BUTTON')),
+    Feature('SECURE_ENABLE', prefixes=('SE_', 'QK_SECURE')),
+    Feature('REPEAT_KEY_ENABLE', prefixes=('QK_REP', 'QK_AREP', 'QK_REPEAT_KEY', 'QK_ALT_REPEAT_KEY')),
+    Feature('TRI_LAYER_ENABLE', prefixes=('TL_', 'QK_TRI_LAYER'), via=True),
+)
+
+
+def used_names(path):
+    """Every identifier, and every function-like macro call, used in a C source.
+    """
+    text = qmk_tree.strip_comments(Path(path).read_text(encoding='utf-8', errors='replace'))
+    names = set(re.findall(r'\b[A-Za-z_]\w*', text))
+    names |= {f'{name}(' for name in re.findall(r'\b([A-Za-z_]\w*)\s*\(', text)}
+    return names
+
+
+def sources(keymap_c, keyboard, rules, home):
+    """Yields (label, path) for keymap.c, the userspace sources and the keyboard's, from its top folder down.
+    """
+    yield 'keymap', keymap_c
+    user = rules.get('USER_NAME')
+    if user:
+        for path in sorted((qmk_tree.USERSPACE / 'users' / user).glob('*.[ch]')):
+            yield f'users/{user}/{path.name}', path
+    folder = home / 'keyboards'
+    for part in keyboard.split('/'):
+        folder /= part
+        for path in sorted(folder.glob('*.[ch]')):
+            yield path.relative_to(home).as_posix(), path
+
+
+def audit(keymap_c, info, keyboard, home, use_via=True):
+    """Returns (prune, keep) lists of (feature, reason) for one keymap.
+    """
+    rules = dict(info['rules'])
+    rules.update(_keymap_rules(keymap_c.parent / 'rules.mk'))
+    found = {}  # name -> the first source it is used in
+    for label, path in sources(keymap_c, keyboard, rules, home):
+        for name in used_names(path):
+            found.setdefault(name, label)
+
+    prune, keep = [], []
+    for feature in FEATURES:
+        if rules.get(feature.rule, feature.default) != 'yes':
+            continue
+        hits = sorted(name for name in found if name.startswith(feature.prefixes)) if feature.prefixes else []
+        hits += sorted(symbol for symbol in feature.symbols if symbol in found)
+        if hits:
+            keep.append((feature.rule, ', '.join(f'{hit} in {found[hit]}' for hit in hits)))
+        elif use_via and feature.via and rules.get('VIA_ENABLE') == 'yes':
+            keep.append((feature.rule, 'assignable from VIA'))
+        else:
+            prune.append((feature.rule, 'unreachable'))
+    return prune, keep
+
+
+def _keymap_rules(path):
+    rules = {}
+    if path.exists():
+        qmk_tree._load_rules(path, rules)
+    return rules
+
+
+def apply(keymap_c, prune):
+    rules_mk = keymap_c.parent / 'rules.mk'
+    existing = _keymap_rules(rules_mk)
+    lines = [f'{rule} = no\n' for rule, _ in prune if existing.get(rule) != 'no']
+    if lines:
+        text = rules_mk.read_text(encoding='utf-8') if rules_mk.exists() else ''
+        rules_mk.write_text(text + ''.join(lines), encoding='utf-8')
+    return len(lines)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('-kb', '--keyboard', action='append', help='only audit these keyboards')
+    parser.add_argument('-km', '--keymap', default='via')
+    parser.add_argument('--no-via', action='store_true', help='ignore what VIA could assign at runtime')
+    parser.add_argument('--measure', action='store_true', help='build with and without the pruned features and report flash')
+    parser.add_argument('--apply', action='store_true', help="turn the pruned features off in each keymap's rules.mk")
+    args = parser.parse_args()
+
+    home = qmk_tree.qmk_home()
+    status = 0
+    for keyboard, keymap_c in qmk_tree.keymaps(args.keymap):
+        if args.keyboard and keyboard not in args.keyboard:
+            continue
+        try:
+            info = qmk_tree.keyboard_info(keyboard, home)
+        except FileNotFoundError as e:
+            print(f'{keyboard}: {e}', file=sys.stderr)
+            status = 1
+            continue
+
+        prune, keep = audit(keymap_c, info, keyboard, home, use_via=not args.no_via)
+        print(keyboard)
+        for rule, reason in prune:
+            print(f'  prune  {rule:<28} {reason}')
+        for rule, reason in keep:
+            print(f'  keep   {rule:<28} {reason}')
+
+        if args.measure and prune:
+            before = qmk_tree.flash_size(qmk_tree.compile(keyboard, args.keymap))
+            after = qmk_tree.flash_size(qmk_tree.compile(keyboard, args.keymap, {rule: 'no' for rule, _ in prune}))
+            print(f'  flash  {before} -> {after} bytes ({after - before:+d})')
+        if args.apply:
+            written = apply(keymap_c, prune)
+            if written:
+                print(f'  wrote  {written} line(s) to {keymap_c.parent / "rules.mk"}')
+
+    return status
+
+
+if __name__ == '__main__':
+    sys.exit(main())
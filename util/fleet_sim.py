@@ -0,0 +1,570 @@
+#!/usr/bin/env python3
+"""Replays key traces through every board's keymap in parallel and diffs the HID reports.
+
+Each keymap is loaded into a small model of QMK's key handling (layers,
+MO/TG/TO/DF, basic keys, modifiers, modded keycodes, grave escape, mod-tap
+and layer-tap with the userspace tap-hold settings, and the userspace
+layer re-evaluation where a board enables it) that emits the 6KRO keyboard
+reports the board would send. The traces under
+util/traces/ name keys by their base-layer keycode, so the same trace
+runs on every board; keys a board does not have are skipped and counted.
+`<time> set <key> = <keycode>` remaps a base-layer key for the rest of
+the trace, as VIA would, and later lines name it by its new keycode.
+Boards run in their own worker process, one per core.
+
+Every trace is also replayed with QMK's stock tap-hold decisions (no
+HOLD_ON_OTHER_KEY_PRESS, no PERMISSIVE_HOLD), and `<time> expect tap` or
+`expect hold` lines give what each tap-hold press was meant as, in order:
+the summary has the mean time to decide a tap-hold key and the presses
+decided against the trace's intent, with the userspace settings and with
+stock.
+
+Traces can also suspend and resume the USB bus. The key that wakes the
+host is timed to the first report carrying it, with the stock resume
+(only the keys still held once the host is back are seen) or the
+userspace wake replay where a board enables FJ_WAKE_ENABLE.
+
+The report streams are compared with util/traces/golden/<board>/<trace>.txt,
+which --update (re)writes. Keycodes that send no keyboard report are
+written by the name the keymap or trace gives them, so the goldens do not
+depend on qmk_firmware's numbering. A trace without a golden fails like
+one that differs.
+
+    util/fleet_sim.py                    # every board, every trace
+    util/fleet_sim.py -kb fjlabs/kf87 -v # one board, print the diffs
+    util/fleet_sim.py --update           # accept the current output as golden
+"""
+import argparse
+import difflib
+import multiprocessing
+import os
+import sys
+import time
+from pathlib import Path
+from statistics import mean
+
+import qmk_tree
+
+TRACES = Path(__file__).resolve().parent / 'traces'
+GOLDEN = TRACES / 'golden'
+TAPPING_TERM = 200
+WAKE_SETTLE = 10
+
+
+class Ranges:
+    """Keycode ranges, read from the keycode headers so they follow qmk_firmware.
+    """
+    NAMES = ('QK_MODS', 'QK_MOD_TAP', 'QK_LAYER_TAP', 'QK_MOMENTARY', 'QK_TOGGLE_LAYER', 'QK_TO', 'QK_DEF_LAYER')
+
+    def __init__(self, keycodes):
+        self.ranges = {name: (keycodes.value(name), keycodes.value(f'{name}_MAX')) for name in self.NAMES}
+        self.trns = keycodes.value('KC_TRNS')
+        self.gesc = keycodes.value('QK_GESC')
+        self.grave = keycodes.value('KC_GRV')
+        self.escape = keycodes.value('KC_ESC')
+
+    def kind(self, keycode):
+        for name, (low, high) in self.ranges.items():
+            if low <= keycode <= high:
+                return name
+        if 0x04 <= keycode <= 0xA4:
+            return 'basic'
+        if 0xE0 <= keycode <= 0xE7:
+            return 'modifier'
+        if keycode == self.gesc:
+            return 'gesc'
+        return 'other'
+
+
+class Board:
+    """One keymap and the reports it sends.
+    """
+    def __init__(self, layers, ranges, reeval=False, wake=False, tapping_term=TAPPING_TERM, stock=False, names=None):
+        self.layers = layers  # [{(row, col): keycode}]
+        self.keymap = dict(layers[0])  # the base layer before any set
+        self.ranges = ranges
+        self.reeval = reeval
+        self.wake = wake
+        self.tapping_term = tapping_term
+        self.stock = stock  # QMK's tap-hold decisions, without the userspace settings
+        self.names = names or {}  # keycode -> the name to print it by
+        self.reset()
+
+    def reset(self):
+        self.layers[0] = dict(self.keymap)
+        self.base = {}
+        for pos, keycode in sorted(self.layers[0].items()):
+            self.base.setdefault(keycode, pos)
+        self.layer_state = 0
+        self.default_layer = 0
+        self.held = {}  # pos -> (keycode, what was registered for it)
+        self.mods = 0
+        self.weak = 0
+        self.keys = []
+        self.output = []
+        self.time = 0
+        self.pending = None  # (pos, keycode, time) of an undecided tap-hold key
+        self.decisions = []  # (pos, press time, hold) for every tap-hold key decided
+        self.delays = []  # ms from press to decision, for each of them
+        self.expected = []  # hold, for each tap-hold press the trace expects
+        self.buffered = []  # (time, pos, pressed) held back while it is undecided
+        self.usb = 'configured'  # or 'suspended', or 'settling' until ready_at
+        self.ready_at = None
+        self.down = set()  # positions physically down
+        self.seen = set()  # positions down when the bus was suspended
+        self.parked = []  # (time, pos, pressed) recorded by the wake module
+        self.wakes = []  # (edge time, waking keycode, output index at the edge)
+        self.asleep = False  # suspended and no key has asked for a wakeup yet
+
+    def _send(self):
+        mods = self.mods | self.weak
+        self.output.append(f'{self.time} {mods:02x} {",".join(f"{k:02x}" for k in self.keys) or "-"}')
+
+    def _event(self, text):
+        self.output.append(f'{self.time} {text}')
+
+    def _name(self, keycode):
+        return self.names.get(keycode, f'{keycode:04x}')
+
+    def remap(self, keycode, new_keycode, name):
+        """Puts new_keycode on the base-layer key that has keycode. Returns False if there is none.
+        """
+        if new_keycode in self.base:
+            return True
+        pos = self.base.pop(keycode, None)
+        if pos is None:
+            return False
+        self.layers[0][pos] = new_keycode
+        self.names.setdefault(new_keycode, name)
+        self.base.setdefault(new_keycode, pos)
+        return True
+
+    def misfires(self):
+        """Returns the tap-hold presses decided against the trace's expect lines.
+        """
+        return sum(hold != expected for (_, _, hold), expected in zip(self.decisions, self.expected))
+
+    def _active(self):
+        return self.layer_state | (1 << self.default_layer)
+
+    def _resolve(self, pos):
+        active = self._active()
+        for layer in range(len(self.layers) - 1, -1, -1):
+            if active & (1 << layer):
+                keycode = self.layers[layer].get(pos, 0)
+                if keycode != self.ranges.trns:
+                    return keycode
+        return 0
+
+    def _plain(self, keycode):
+        return keycode == 0 or self.ranges.kind(keycode) in ('basic', 'modifier')
+
+    def _register(self, keycode):
+        kind = self.ranges.kind(keycode)
+        if kind == 'modifier':
+            self.mods |= 1 << (keycode & 7)
+        elif kind == 'basic':
+            if keycode not in self.keys and len(self.keys) < 6:
+                self.keys.append(keycode)
+        elif kind == 'QK_MODS':
+            # process_action: the mods go out in a report of their own before the key.
+            mods = ((keycode >> 8) & 0xF) << (4 if keycode & 0x1000 else 0)
+            if self.ranges.kind(keycode & 0xFF) == 'modifier' or keycode & 0xFF == 0:
+                self.mods |= mods
+            else:
+                self.weak |= mods
+            self._send()
+            self._register(keycode & 0xFF)
+            return
+        else:
+            return
+        self._send()
+
+    def _unregister(self, keycode):
+        kind = self.ranges.kind(keycode)
+        if kind == 'modifier':
+            self.mods &= ~(1 << (keycode & 7))
+        elif kind == 'basic':
+            if keycode in self.keys:
+                self.keys.remove(keycode)
+        elif kind == 'QK_MODS':
+            # And on release the key goes first, then the mods.
+            mods = ((keycode >> 8) & 0xF) << (4 if keycode & 0x1000 else 0)
+            self._unregister(keycode & 0xFF)
+            if self.ranges.kind(keycode & 0xFF) == 'modifier' or keycode & 0xFF == 0:
+                self.mods &= ~mods
+            else:
+                self.weak &= ~mods
+            self._send()
+            return
+        else:
+            return
+        self._send()
+
+    def _set_layers(self, state):
+        if state == self.layer_state:
+            return
+        self.layer_state = state
+        if not self.reeval:
+            return
+        # Mirrors users/fjlabs/layer_reeval.c: plain held keys follow the new layer state.
+        for pos, (keycode, _) in list(self.held.items()):
+            new_keycode = self._resolve(pos)
+            if not self._plain(keycode) or not self._plain(new_keycode) or new_keycode == keycode:
+                continue
+            if keycode:
+                self._unregister(keycode)
+            if new_keycode:
+                self._register(new_keycode)
+            self.held[pos] = (new_keycode, new_keycode)
+
+    def suspend(self, stamp):
+        self.finish()
+        self.usb = 'suspended'
+        self.asleep = True
+        self.seen = set(self.down)
+
+    def resume(self, stamp):
+        """The host has resumed the bus and configured the board.
+        """
+        if self.usb != 'suspended':
+            return
+        self.time = stamp
+        # suspend_wakeup_init clears the keyboard report.
+        self.keys, self.mods, self.weak = [], 0, 0
+        self._send()
+        if self.wake:
+            self.usb, self.ready_at = 'settling', stamp + WAKE_SETTLE
+            return
+        # Stock: matrix_task only sees the difference since the suspend.
+        self.usb = 'configured'
+        for pos in sorted(self.seen - self.down):
+            self.event(stamp, pos, False)
+        for pos in sorted(self.down - self.seen):
+            self.event(stamp, pos, True)
+
+    def _replay(self):
+        """Mirrors users/fjlabs/wake.c: the recorded edges, in order, once the host is ready.
+        """
+        self.usb = 'configured'
+        parked, self.parked = self.parked, []
+        for _, pos, pressed in parked:
+            self.event(self.ready_at, pos, pressed)
+
+    def event(self, stamp, pos, pressed):
+        """Feeds one matrix event, holding events back while a tap-hold key is undecided.
+        """
+        if self.usb == 'settling' and stamp >= self.ready_at:
+            self._replay()
+        if self.usb != 'configured':
+            if pressed and self.usb == 'suspended' and self.asleep:
+                # Remote wakeup on the first key edge.
+                self.asleep = False
+                self.wakes.append((stamp, self._resolve(pos), len(self.output)))
+            if self.wake:
+                self.parked.append((stamp, pos, pressed))
+            (self.down.add if pressed else self.down.discard)(pos)
+            return
+        (self.down.add if pressed else self.down.discard)(pos)
+        if self.pending and stamp >= self.pending[2] + self.tapping_term:
+            self._decide(True, self.pending[2] + self.tapping_term)
+        if not self.pending:
+            self.time = stamp
+            if not pressed:
+                self._release(pos)
+                return
+            keycode = self._resolve(pos)
+            if self.ranges.kind(keycode) in ('QK_MOD_TAP', 'QK_LAYER_TAP'):
+                self.pending = (pos, keycode, stamp)
+            else:
+                self._press(pos, keycode)
+            return
+
+        pending_pos, keycode, _ = self.pending
+        if pos == pending_pos and not pressed:
+            self._decide(False, stamp)
+            self.time = stamp
+            self._release(pos)
+        elif pressed and not self.stock and self.ranges.kind(keycode) == 'QK_LAYER_TAP':
+            # HOLD_ON_OTHER_KEY_PRESS_PER_KEY: layer-taps hold on the next press.
+            self._decide(True, stamp)
+            self.event(stamp, pos, pressed)
+        elif not pressed and not self.stock and any(p == pos and down for _, p, down in self.buffered):
+            # PERMISSIVE_HOLD: another key tapped inside the hold makes it a hold.
+            self.buffered.append((stamp, pos, pressed))
+            self._decide(True, stamp)
+        else:
+            self.buffered.append((stamp, pos, pressed))
+
+    def finish(self):
+        if self.usb == 'settling':
+            self._replay()
+        if self.pending:
+            self._decide(True, self.pending[2] + self.tapping_term)
+
+    def wake_latencies(self):
+        """Returns the ms from each waking key edge to the first report carrying it, None if it never came.
+        """
+        latencies = []
+        for edge, keycode, index in self.wakes:
+            kind = self.ranges.kind(keycode)
+            for line in self.output[index:]:
+                stamp, first, rest = line.split(' ', 2)
+                if first == 'key':
+                    carried = rest.split()[0] == self._name(keycode)
+                elif kind == 'modifier':
+                    carried = bool(int(first, 16) & (1 << (keycode & 7)))
+                elif kind == 'basic':
+                    carried = rest != '-' and keycode in (int(k, 16) for k in rest.split(','))
+                else:
+                    carried = first != '00' or rest != '-'
+                if carried:
+                    latencies.append(int(stamp) - edge)
+                    break
+            else:
+                latencies.append(None)
+        return latencies
+
+    def _decide(self, hold, stamp):
+        pos, keycode, pressed_at = self.pending
+        self.pending = None
+        self.decisions.append((pos, pressed_at, hold))
+        self.delays.append(stamp - pressed_at)
+        self.time = stamp
+        if not hold:
+            self.held[pos] = (keycode, keycode & 0xFF)
+            self._register(keycode & 0xFF)
+        elif self.ranges.kind(keycode) == 'QK_LAYER_TAP':
+            layer = (keycode >> 8) & 0xF
+            self.held[pos] = (keycode, None)
+            self._set_layers(self.layer_state | (1 << layer))
+        else:
+            mods = (keycode >> 8) & 0x1F
+            modifier = 0xE0 | (4 if mods & 0x10 else 0) | ((mods & 0xF).bit_length() - 1)
+            self.held[pos] = (keycode, modifier)
+            self._register(modifier)
+        buffered, self.buffered = self.buffered, []
+        for when, pos, pressed in buffered:
+            self.event(max(when, stamp), pos, pressed)
+
+    def _press(self, pos, keycode):
+        self.held[pos] = (keycode, keycode)
+        kind = self.ranges.kind(keycode)
+        if kind == 'QK_MOMENTARY':
+            self._set_layers(self.layer_state | (1 << (keycode & 0x1F)))
+        elif kind == 'QK_TOGGLE_LAYER':
+            self._set_layers(self.layer_state ^ (1 << (keycode & 0x1F)))
+        elif kind == 'QK_TO':
+            self._set_layers(1 << (keycode & 0x1F))
+        elif kind == 'QK_DEF_LAYER':
+            self.default_layer = keycode & 0x1F
+        elif kind == 'gesc':
+            shifted = (self.mods | self.weak) & 0x22 or (self.mods | self.weak) & 0x88
+            sent = self.ranges.grave if shifted else self.ranges.escape
+            self.held[pos] = (keycode, sent)
+            self._register(sent)
+        elif kind == 'other':
+            self._event(f'key {self._name(keycode)} down')
+        else:
+            self._register(keycode)
+
+    def _release(self, pos):
+        if pos not in self.held:
+            return
+        keycode, sent = self.held.pop(pos)
+        kind = self.ranges.kind(keycode)
+        if kind == 'QK_LAYER_TAP' and sent is None:
+            self._set_layers(self.layer_state & ~(1 << ((keycode >> 8) & 0xF)))
+        elif kind == 'QK_MOMENTARY':
+            self._set_layers(self.layer_state & ~(1 << (keycode & 0x1F)))
+        elif kind == 'other':
+            self._event(f'key {self._name(keycode)} up')
+        elif kind not in ('QK_TOGGLE_LAYER', 'QK_TO', 'QK_DEF_LAYER'):
+            self._unregister(sent)
+
+
+def load_trace(path, keycodes):
+    """Returns [(time ms, action, keycode)] from a trace file.
+
+    The keycode is None for suspend and resume, (keycode, new keycode, its
+    name) for set, and True for expect hold, False for expect tap.
+    """
+    events = []
+    for number, line in enumerate(path.read_text(encoding='utf-8').splitlines(), 1):
+        line = line.partition('#')[0].strip()
+        if not line:
+            continue
+        try:
+            stamp, action, *key = line.split(None, 2)
+            if action in ('suspend', 'resume') and not key:
+                events.append((int(stamp), action, None))
+                continue
+            if action == 'expect' and key and key[0] in ('tap', 'hold'):
+                events.append((int(stamp), action, key[0] == 'hold'))
+                continue
+            if action == 'set' and key and '=' in key[0]:
+                old, new = (expr.strip() for expr in key[0].split('=', 1))
+                events.append((int(stamp), action, (keycodes.value(old), keycodes.value(new), new)))
+                continue
+            if action not in ('down', 'up') or not key:
+                raise ValueError(f'expected down <key>, up <key>, set <key> = <keycode>, expect tap|hold, suspend or resume, got {line}')
+            events.append((int(stamp), action, keycodes.value(key[0])))
+        except ValueError as e:
+            raise ValueError(f'{path.name}:{number}: {e}')
+    return events
+
+
+def load_board(keyboard, keymap_c, home, keycodes, cls=Board, **options):
+    info = qmk_tree.keyboard_info(keyboard, home)
+    table = keycodes.with_source(keymap_c)
+    layers = []
+    names = {}
+    for layer in qmk_tree.parse_keymap(keymap_c):
+        keys = qmk_tree.layout(info, layer.macro)
+        if keys is None or len(keys) != len(layer.keys):
+            raise ValueError(f'{layer.macro} does not match the keyboard, run check_keymaps.py')
+        layers.append({})
+        for key, (expr, _) in zip(keys, layer.keys):
+            keycode = table.value(expr)
+            layers[-1][tuple(key['matrix'])] = keycode
+            names.setdefault(keycode, expr)
+
+    rules = {}
+    rules_mk = keymap_c.parent / 'rules.mk'
+    if rules_mk.exists():
+        qmk_tree._load_rules(rules_mk, rules)
+    return cls(layers, Ranges(keycodes), reeval=rules.get('FJ_LAYER_REEVAL_ENABLE') == 'yes', wake=rules.get('FJ_WAKE_ENABLE') == 'yes', names=names, **options)
+
+
+_worker = {}
+
+
+def _init_worker(home):
+    _worker['home'] = home
+    _worker['keycodes'] = qmk_tree.KeycodeTable(home, extra=sorted((qmk_tree.USERSPACE / 'users').glob('*/*.h')))
+
+
+def replay(board, events, result):
+    """Replays one trace on the board, counting into result.
+    """
+    board.reset()
+    for stamp, action, keycode in events:
+        if action == 'set':
+            result['skipped'] += not board.remap(*keycode)
+            continue
+        if action == 'expect':
+            board.expected.append(keycode)
+            continue
+        if keycode is None:
+            getattr(board, action)(stamp)
+            continue
+        pos = board.base.get(keycode)
+        if pos is None:
+            result['skipped'] += 1
+            continue
+        before = time.perf_counter()
+        board.event(stamp, pos, action == 'down')
+        result['worst'] = max(result['worst'], time.perf_counter() - before)
+        result['events'] += 1
+    board.finish()
+
+
+def run_board(job):
+    """Worker: replays every trace on one board, and with stock tap-hold. Returns a result dict.
+    """
+    keyboard, keymap_c, traces, update = job
+    keycodes = _worker['keycodes']
+    result = {'keyboard': keyboard, 'events': 0, 'skipped': 0, 'reports': 0, 'seconds': 0.0, 'worst': 0.0, 'wake': [], 'delays': [], 'misfires': 0, 'stock_delays': [], 'stock_misfires': 0, 'diffs': [], 'new': [], 'error': None}
+    try:
+        board = load_board(keyboard, Path(keymap_c), _worker['home'], keycodes)
+        stock = load_board(keyboard, Path(keymap_c), _worker['home'], keycodes, stock=True)
+        for trace in traces:
+            events = load_trace(Path(trace), keycodes)
+            start = time.perf_counter()
+            replay(board, events, result)
+            result['seconds'] += time.perf_counter() - start
+            result['wake'] += board.wake_latencies()
+            result['reports'] += len(board.output)
+            result['delays'] += board.delays
+            result['misfires'] += board.misfires()
+            replay(stock, events, {'skipped': 0, 'events': 0, 'worst': 0.0})
+            result['stock_delays'] += stock.delays
+            result['stock_misfires'] += stock.misfires()
+
+            golden = GOLDEN / keyboard.replace('/', '_') / f'{Path(trace).stem}.txt'
+            output = '\n'.join(board.output) + '\n'
+            if update:
+                golden.parent.mkdir(parents=True, exist_ok=True)
+                golden.write_text(output, encoding='utf-8')
+            elif not golden.exists():
+                result['new'].append(Path(trace).stem)
+            elif golden.read_text(encoding='utf-8') != output:
+                diff = difflib.unified_diff(golden.read_text(encoding='utf-8').splitlines(), board.output, f'golden/{Path(trace).stem}', 'now', lineterm='')
+                result['diffs'].append((Path(trace).stem, list(diff)))
+    except (FileNotFoundError, ValueError, KeyError) as e:
+        result['error'] = str(e)
+    return result
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('-kb', '--keyboard', action='append', help='only run these keyboards')
+    parser.add_argument('-km', '--keymap', default='via')
+    parser.add_argument('-t', '--trace', action='append', help='only replay these traces (file stems)')
+    parser.add_argument('-j', '--jobs', type=int, default=os.cpu_count(), help='worker processes (default: one per core)')
+    parser.add_argument('-v', '--verbose', action='store_true', help='print the report diffs')
+    parser.add_argument('--update', action='store_true', help='write the current output as the golden files')
+    args = parser.parse_args()
+
+    traces = [str(path) for path in sorted(TRACES.glob('*.trace')) if not args.trace or path.stem in args.trace]
+    if not traces:
+        print(f'no traces found in {TRACES}', file=sys.stderr)
+        return 2
+    jobs = [(keyboard, str(keymap_c), traces, args.update) for keyboard, keymap_c in qmk_tree.keymaps(args.keymap) if not args.keyboard or keyboard in args.keyboard]
+
+    start = time.perf_counter()
+    home = qmk_tree.qmk_home()
+    with multiprocessing.Pool(min(args.jobs, len(jobs)) or 1, _init_worker, (home,)) as pool:
+        results = pool.map(run_board, jobs)
+
+    failed = 0
+    # Tap-hold columns are the userspace settings / stock QMK.
+    print(f'{"board":<24} {"events":>7} {"skipped":>7} {"reports":>7} {"events/s":>9} {"worst us":>8} {"wake ms":>7} {"decide ms":>11} {"misfires":>8}  result')
+    for result in results:
+        if result['error']:
+            failed += 1
+            print(f'{result["keyboard"]:<24} error: {result["error"]}')
+            continue
+        rate = result['events'] / result['seconds'] if result['seconds'] else 0
+        if args.update:
+            status = 'updated'
+        elif result['diffs']:
+            status = 'differs: ' + ', '.join(name for name, _ in result['diffs'])
+        else:
+            status = 'ok'
+        if result['new'] and not args.update:
+            status = ('missing golden, run --update: ' if status == 'ok' else status + '; missing golden: ') + ', '.join(result['new'])
+        failed += bool(result['diffs'] or (result['new'] and not args.update))
+        # Worst wake-to-first-report time; a waking key that never reached the host is lost.
+        if None in result['wake']:
+            wake = 'lost'
+        elif result['wake']:
+            wake = str(max(result['wake']))
+        else:
+            wake = '-'
+        if result['delays']:
+            decide = f'{mean(result["delays"]):.0f}/{mean(result["stock_delays"]):.0f}'
+            misfires = f'{result["misfires"]}/{result["stock_misfires"]}'
+        else:
+            decide = misfires = '-'
+        print(f'{result["keyboard"]:<24} {result["events"]:>7} {result["skipped"]:>7} {result["reports"]:>7} {rate:>9.0f} {result["worst"] * 1e6:>8.1f} {wake:>7} {decide:>11} {misfires:>8}  {status}')
+        if args.verbose:
+            for _, diff in result['diffs']:
+                print('\n'.join('    ' + line for line in diff))
+
+    print(f'{len(results)} boards x {len(traces)} traces in {time.perf_counter() - start:.2f}s, {failed} failing', file=sys.stderr)
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
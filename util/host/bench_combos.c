@@ -0,0 +1,42 @@
+// build: combos.c -DFJ_COMBO_ENABLE -DFJ_COMBO_COUNT=128
+
+#include "fjlabs.h"
+#include "combos.h"
+#include "via.h"
+#include "host.h"
+
+/* Time per key event through combos_pre_process_record with 1, 32 and 128
+ * two-key combos defined, tapping every key of the matrix in turn. */
+
+static volatile uint32_t replayed;
+
+void action_tapping_process(keyrecord_t record) {
+    replayed++;
+}
+
+static void define(uint8_t count) {
+    combos_reset();
+    for (uint8_t index = 0; index < count; index++) {
+        uint8_t data[32] = {id_custom_set_value, id_custom_channel, id_fj_combo, index, 1, index % MATRIX_COLS, 2, (index / MATRIX_COLS) % MATRIX_COLS, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0, KC_A};
+        combos_via_custom_value(data, sizeof(data));
+    }
+}
+
+int main(void) {
+    host_init();
+    combos_init();
+    const uint8_t counts[] = {1, 32, 128};
+    for (uint8_t i = 0; i < sizeof(counts); i++) {
+        define(counts[i]);
+        enum { TAPS = 10000000 };
+        uint64_t start = host_clock_ns();
+        for (uint32_t tap = 0; tap < TAPS; tap++) {
+            keyrecord_t record = {.event = MAKE_KEYEVENT(tap % MATRIX_ROWS, (tap / MATRIX_ROWS) % MATRIX_COLS, true)};
+            combos_pre_process_record(&record);
+            record.event.pressed = false;
+            combos_pre_process_record(&record);
+        }
+        printf("%3u combos: %5.1f ns per event\n", counts[i], (host_clock_ns() - start) / (2.0 * TAPS));
+    }
+    return 0;
+}
@@ -0,0 +1,83 @@
+// build: expand.c -DFJ_EXPAND_ENABLE -DFJ_EXPAND_SIZE=65535
+// setup: for n in 10 100 1000; do python3 -c "import random; random.seed($n); [print(';' + ''.join(random.choices('abcdefghijklmnopqrstuvwxyz', k=random.randint(2, 6))), 'expansion', i) for i in range($n)]" > expand$n.txt && python3 "$USERSPACE/util/via_expand.py" expand$n.txt -n -o expand$n.bin > /dev/null 2>&1 || exit 1; done; python3 -c "print('a' * 31 + 'b', 'deep')" > deep.txt && python3 "$USERSPACE/util/via_expand.py" deep.txt -n -o deep.bin > /dev/null 2>&1
+
+#include <string.h>
+#include "fjlabs.h"
+#include "expand.h"
+#include "send_string.h"
+#include "host.h"
+
+/* Time per key press through expand_process_record with 10, 100 and 1000
+ * random `;` triggers, typing 4 KB of random words with a `;` now and then.
+ * Then the worst case for the failure links: with a single trigger of 31
+ * a's and a b, each c after 31 a's walks a link per a back to the root,
+ * and is timed on its own, clock reads included. The dictionaries outgrow
+ * host_config, so the area is read from here, and typing the expansions is
+ * left out. */
+
+static uint8_t area[65536];
+
+static size_t load(const char *name) {
+    FILE *file = fopen(name, "rb");
+    HOST_CHECK(file != NULL);
+    memset(area, 0, sizeof(area));
+    size_t size = fread(area, 1, sizeof(area), file);
+    fclose(file);
+    expand_init();
+    return size;
+}
+
+static bool press(char c) {
+    keyrecord_t record = {.event = MAKE_KEYEVENT(0, 0, true)};
+    return expand_process_record(ascii_to_keycode_lut[(uint8_t)c], &record);
+}
+
+void via_read_custom_config(void *buf, uint32_t offset, uint32_t length) {
+    memcpy(buf, area + offset - FJ_CONFIG_EXPAND_OFFSET, length);
+}
+
+void send_char(char ascii) {}
+
+void tap_code(uint8_t kc) {}
+
+int main(void) {
+    host_init();
+    static char text[4096];
+    srand(2);
+    for (size_t i = 0; i < sizeof(text) - 1; i++) {
+        int pick = rand() % 8;
+        text[i] = pick == 0 ? ';' : pick == 1 ? ' ' : 'a' + rand() % 26;
+    }
+
+    const unsigned counts[] = {10, 100, 1000};
+    for (uint8_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "expand%u.bin", counts[i]);
+        size_t size = load(name);
+
+        enum { ROUNDS = 200 };
+        uint32_t expanded = 0;
+        uint64_t start    = host_clock_ns();
+        for (uint32_t round = 0; round < ROUNDS; round++) {
+            for (const char *c = text; *c; c++) {
+                expanded += !press(*c);
+            }
+        }
+        printf("%4u entries: %5.1f ns per key, %5zu bytes, %lu expansions\n", counts[i], (host_clock_ns() - start) / ((double)ROUNDS * (sizeof(text) - 1)), size, (unsigned long)expanded);
+    }
+
+    enum { DEEP = 31, WALKS = 100000 };
+    load("deep.bin");
+    uint64_t worst = 0;
+    uint64_t start = host_clock_ns();
+    for (uint32_t walk = 0; walk < WALKS; walk++) {
+        for (uint8_t a = 0; a < DEEP; a++) {
+            press('a');
+        }
+        uint64_t before = host_clock_ns();
+        press('c');
+        worst += host_clock_ns() - before;
+    }
+    printf("  deep trie: %5.1f ns per key, %5.1f ns for a press that walks %u links\n", (host_clock_ns() - start) / ((double)WALKS * (DEEP + 1)), worst / (double)WALKS, DEEP);
+    return 0;
+}
@@ -0,0 +1,66 @@
+// build: -DFJ_KEYMAP_STORE_ENABLE
+// build: -DFJ_KEYMAP_MIRROR_ENABLE -DFJ_KEYMAP_STORE_ENABLE
+// build: -DFJ_KEYMAP_MIRROR_ENABLE -DFJ_KEYMAP_STORE_ENABLE -DFJ_KEYMAP_MIRROR_LAYERS=1
+// build: compact_keymap.c -DFJ_KEYMAP_STORE_ENABLE -DFJ_COMPACT_KEYMAP_ENABLE -DFJ_VIA_CONFIG_ENABLE
+// build: compact_keymap.c -DFJ_KEYMAP_MIRROR_ENABLE -DFJ_KEYMAP_STORE_ENABLE -DFJ_COMPACT_KEYMAP_ENABLE -DFJ_VIA_CONFIG_ENABLE
+
+/* Time per keycode lookup as QMK's layer_switch_get_layer does it, from
+ * the highest active layer down past KC_TRNS, with layer 0 alone and with
+ * layer 1 on top of it. Layer 0 is all keys, the layers above it a quarter.
+ * The dynamic keymap reads its bytes one at a time through a bounds check,
+ * like the cached read of the wear-leveling EEPROM driver. */
+#include "keymap_store.c"
+#include "host.h"
+
+__attribute__((noinline)) static uint8_t eeprom_read_byte(uint16_t address) {
+    const uint8_t *bytes = (const uint8_t *)host_dynamic_keymap;
+    return address < sizeof(host_dynamic_keymap) ? bytes[address] : 0;
+}
+
+uint16_t dynamic_keymap_get_keycode(uint8_t layer, uint8_t row, uint8_t column) {
+    if (layer >= DYNAMIC_KEYMAP_LAYER_COUNT || row >= MATRIX_ROWS || column >= MATRIX_COLS) {
+        return KC_NO;
+    }
+    uint16_t address = ((layer * MATRIX_ROWS + row) * MATRIX_COLS + column) * 2;
+    return eeprom_read_byte(address) | (eeprom_read_byte(address + 1) << 8);
+}
+
+int main(void) {
+    host_init();
+    keymap_store_reset();
+    keymap_store_init();
+    srand(3);
+    for (uint8_t layer = 0; layer < KEYMAP_STORE_VISIBLE_LAYERS; layer++) {
+        for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+            for (uint8_t column = 0; column < MATRIX_COLS; column++) {
+                keymap_store_set_keycode(layer, row, column, layer == 0 ? KC_A + rand() % 100 : rand() % 4 == 0 ? KC_A + rand() % 200 : KC_TRNS);
+            }
+        }
+    }
+
+    static keypos_t keys[4096];
+    for (uint16_t i = 0; i < 4096; i++) {
+        keys[i] = (keypos_t){.row = rand() % MATRIX_ROWS, .col = rand() % MATRIX_COLS};
+    }
+    enum { LOOKUPS = 20000000 };
+    volatile uint16_t sink = 0;
+    for (uint8_t top = 0; top < 2; top++) {
+        uint64_t start = host_clock_ns();
+        for (uint32_t i = 0; i < LOOKUPS; i++) {
+            uint16_t keycode = KC_TRNS;
+            for (int8_t layer = top; layer >= 0 && keycode == KC_TRNS; layer--) {
+                keycode = keymap_key_to_keycode(layer, keys[i % 4096]);
+            }
+            sink += keycode;
+        }
+        printf("  up to layer %u: %5.1f ns per lookup\n", top, (host_clock_ns() - start) / (double)LOOKUPS);
+    }
+#ifdef FJ_KEYMAP_MIRROR_ENABLE
+    size_t ram = sizeof(keymap_mirror);
+#    if KEYMAP_MIRROR_SPARSE_LAYERS > 0
+    ram += sizeof(keymap_mirror_used) + sizeof(keymap_mirror_rank) + sizeof(keymap_mirror_start) + sizeof(keymap_mirror_count) + sizeof(keymap_mirror_pool);
+#    endif
+    printf("  mirror RAM: %zu bytes\n", ram);
+#endif
+    return 0;
+}
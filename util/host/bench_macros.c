@@ -0,0 +1,46 @@
+// build: macros.c -DFJ_MACRO_COALESCE_ENABLE
+
+#include "fjlabs.h"
+#include "macros.h"
+#include "host.h"
+
+/* Reports needed to play a paragraph of prose as a VIA macro, against the
+ * stock player (send_string's send_char per character), and what that
+ * makes at one report per millisecond. */
+
+static const char *const prose = "Lorem ipsum dolor sit amet, consectetur adipiscing elit. Sed do eiusmod tempor incididunt ut labore et dolore magna aliqua. Ut enim ad minim veniam, quis nostrud exercitation ullamco laboris nisi ut aliquip ex ea commodo consequat.\n";
+
+uint8_t dynamic_keymap_macro_get_count(void) {
+    return 1;
+}
+
+uint16_t dynamic_keymap_macro_get_buffer_size(void) {
+    return strlen(prose) + 1;
+}
+
+void dynamic_keymap_macro_get_buffer(uint16_t offset, uint16_t size, uint8_t *data) {
+    for (uint16_t i = 0; i < size; i++) {
+        data[i] = offset + i < strlen(prose) ? prose[offset + i] : 0;
+    }
+}
+
+static void print(const char *player, uint32_t reports) {
+    size_t length = strlen(prose);
+    printf("%-6s %zu characters in %3u reports, %.2f per character, %4.0f characters/s at 1 kHz polling\n", player, length, (unsigned)reports, (double)reports / length, length * 1000.0 / reports);
+}
+
+int main(void) {
+    host_init();
+    keyrecord_t record = {.event = MAKE_KEYEVENT(0, 0, true)};
+    macros_process_record(QK_MACRO, &record);
+    HOST_EXPECT_STR(host_text(), prose);
+    print("fj", host_report_count);
+
+    host_init();
+    for (const char *c = prose; *c; c++) {
+        send_char(*c);
+    }
+    HOST_EXPECT_STR(host_text(), prose);
+    print("stock", host_report_count);
+    return 0;
+}
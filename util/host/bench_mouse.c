@@ -0,0 +1,126 @@
+// build: mouse.c -DFJ_MOUSE_ENABLE
+
+#include <math.h>
+#include "fjlabs.h"
+#include "mouse.h"
+#include "host.h"
+
+/* Holding one direction for 1.5 s with mouse.c and with a model of the
+ * stock mousekey.c in its default accelerated mode (MOUSEKEY_DELAY 10,
+ * INTERVAL 20, MOVE_DELTA 8, MAX_SPEED 10, TIME_TO_MAX 30), the cursor
+ * position after every report, and what mouse_task costs per call. */
+
+#define HOLD 1500
+
+static struct {
+    uint32_t time;
+    int32_t  x;
+} reports[HOLD + 1];
+static uint16_t report_count;
+static bool     recording = true;
+
+static void add_report(int8_t x) {
+    host_mouse_x += x;
+    if (recording && report_count < HOLD + 1) {
+        reports[report_count].time = host_time - 1000;
+        reports[report_count].x    = host_mouse_x;
+        report_count++;
+    }
+}
+
+void host_mouse_send(report_mouse_t *report) {
+    add_report(report->x);
+}
+
+static int      stock_repeat;
+static uint8_t  stock_moving;
+static uint16_t stock_last;
+
+static int stock_unit(void) {
+    int unit = stock_repeat == 0 ? 8 : stock_repeat >= 30 ? 80 : 8 * 10 * stock_repeat / 30;
+    return unit > 127 ? 127 : unit ? unit : 1;
+}
+
+static void stock_task(void) {
+    if (stock_moving && (uint16_t)(host_time - stock_last) > (stock_repeat ? 20 : 100)) {
+        stock_repeat += stock_repeat < 255;
+        stock_last = host_time;
+        add_report(stock_unit());
+    }
+}
+
+static int32_t position_at(uint32_t time) {
+    int32_t x = 0;
+    for (uint16_t i = 0; i < report_count && reports[i].time <= time; i++) {
+        x = reports[i].x;
+    }
+    return x;
+}
+
+static void print(const char *name) {
+    int32_t largest = 0;
+    for (uint16_t i = 0; i < report_count; i++) {
+        int32_t jump = reports[i].x - (i ? reports[i - 1].x : 0);
+        largest      = jump > largest ? jump : largest;
+    }
+    printf("%-6s %4u reports, first at %2lu ms, largest jump %2ld px, at 250/500/1000 ms %3ld/%3ld/%4ld px", name, report_count, (unsigned long)reports[0].time, (long)largest, (long)position_at(250), (long)position_at(500), (long)position_at(1000));
+    // Travel per 60 Hz display frame over the last 800 ms, at top speed.
+    double frame = 1000.0 / 60, sum = 0, squares = 0;
+    int    frames = 0;
+    for (double t = HOLD - 800; t + frame <= HOLD; t += frame, frames++) {
+        double travel = position_at(t + frame) - position_at(t);
+        sum += travel;
+        squares += travel * travel;
+    }
+    printf(", 60 Hz frames %4.1f +- %4.1f px\n", sum / frames, sqrt(squares / frames - (sum / frames) * (sum / frames)));
+}
+
+int main(void) {
+    host_init();
+    keyrecord_t record = {.event = MAKE_KEYEVENT(0, 0, true)};
+
+    host_time = 1000;
+    mouse_process_record(QK_MOUSE_CURSOR_RIGHT, &record);
+    for (uint16_t t = 0; t < HOLD; t++, host_time++) {
+        mouse_task();
+    }
+    record.event.pressed = false;
+    mouse_process_record(QK_MOUSE_CURSOR_RIGHT, &record);
+    print("fj");
+
+    report_count = 0;
+    host_mouse_x = 0;
+    host_time    = 1000;
+    stock_moving = 1;
+    add_report(stock_unit());
+    stock_last = host_time;
+    for (uint16_t t = 0; t < HOLD; t++, host_time++) {
+        stock_task();
+    }
+    print("stock");
+
+    enum { CALLS = 20000000 };
+    recording            = false;
+    record.event.pressed = true;
+    mouse_process_record(QK_MOUSE_CURSOR_RIGHT, &record);
+    uint64_t start = host_clock_ns();
+    for (uint32_t i = 0; i < CALLS; i++) {
+        host_time += 2;
+        mouse_task();
+    }
+    printf("mouse_task with a report due: %4.1f ns\n", (host_clock_ns() - start) / (double)CALLS);
+    start = host_clock_ns();
+    for (uint32_t i = 0; i < CALLS; i++) {
+        mouse_task();
+    }
+    printf("mouse_task between reports:   %4.1f ns\n", (host_clock_ns() - start) / (double)CALLS);
+    record.event.pressed = false;
+    mouse_process_record(QK_MOUSE_CURSOR_RIGHT, &record);
+    start = host_clock_ns();
+    for (uint32_t i = 0; i < CALLS; i++) {
+        host_time++;
+        mouse_task();
+    }
+    printf("mouse_task idle:              %4.1f ns\n", (host_clock_ns() - start) / (double)CALLS);
+    return 0;
+}
@@ -0,0 +1,32 @@
+// build: keymap_store.c -DFJ_PROFILE_ENABLE -DFJ_KEYMAP_STORE_ENABLE
+// build: keymap_store.c -DFJ_PROFILE_ENABLE -DFJ_KEYMAP_STORE_ENABLE -DFJ_KEYMAP_MIRROR_ENABLE
+// build: keymap_store.c -DFJ_PROFILE_ENABLE -DFJ_KEYMAP_STORE_ENABLE -DFJ_KEYMAP_MIRROR_ENABLE -DFJ_KEYMAP_MIRROR_LAYERS=1
+
+#include "fjlabs.h"
+#include "keymap_store.h"
+#include "host.h"
+
+/* Time per bank switch, back and forth between the first two, including
+ * the byte written to the custom config. Releasing held keys is left out:
+ * on a board that is one report, whatever the bank size. With the keymap
+ * mirror, the switch also reloads it from the new bank. */
+
+#ifdef FJ_KEYMAP_MIRROR_ENABLE
+#    define SWITCHES 100000
+#else
+#    define SWITCHES 10000000
+#endif
+
+void clear_keyboard(void) {}
+
+int main(void) {
+    host_init();
+    keymap_store_reset();
+    keymap_store_init();
+    uint64_t start = host_clock_ns();
+    for (uint32_t i = 0; i < SWITCHES; i++) {
+        keymap_store_set_profile(i & 1);
+    }
+    printf("%8.1f ns per switch, %u banks of %u layers\n", (host_clock_ns() - start) / (double)SWITCHES, FJ_PROFILE_COUNT, FJ_PROFILE_LAYERS);
+    return 0;
+}
@@ -0,0 +1,59 @@
+/* What util/host tests see of the fake keyboard in qmk.c: the clock, the
+ * VIA custom config, and the reports the code under test sent. */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "qmk.h"
+
+#define HOST_CONFIG_SIZE 4096
+
+extern uint32_t host_time;
+extern uint8_t  host_config[HOST_CONFIG_SIZE];
+
+// Keyboard reports sent since the last host_reports(), and in total.
+extern uint32_t host_report_count;
+// The most keys that went down together in one report.
+extern uint8_t host_most_new_keys;
+
+extern report_mouse_t host_mouse_report;
+extern uint32_t       host_mouse_count;
+extern int32_t        host_mouse_x;
+extern int32_t        host_mouse_y;
+
+/* The stock dynamic keymap in RAM, which host_init() and
+ * dynamic_keymap_reset() fill from keycode_at_keymap_location_raw (KC_A +
+ * column on layer 0, transparent above, unless a test replaces it). Every
+ * read is counted, as it would be an EEPROM read on a board. */
+extern uint16_t host_dynamic_keymap[DYNAMIC_KEYMAP_LAYER_COUNT][MATRIX_ROWS][MATRIX_COLS];
+extern uint32_t host_dynamic_keymap_reads;
+
+// Clears the reports, the clock and the config, resets the dynamic keymap, and fills the US send_string tables.
+void host_init(void);
+
+/* Every keyboard report since the last call as "mods:keys" in hex, separated
+ * by spaces, e.g. "02:04,05 00:" for shift+a+b then nothing. */
+const char *host_reports(void);
+
+// Whether the last report sent has the key or modifier down.
+bool host_is_down(uint8_t keycode);
+
+/* The text a host would type from the reports so far: each key that goes
+ * down, in report order, through the US layout and the shift state.
+ * Backspace deletes. */
+const char *host_text(void);
+void        host_text_clear(void);
+
+// A monotonic clock for the benchmarks.
+uint64_t host_clock_ns(void);
+
+// Print where and what failed, and exit with 1.
+void host_check(bool ok, const char *what, const char *file, int line);
+void host_expect_str(const char *got, const char *want, const char *what, const char *file, int line);
+
+#define HOST_CHECK(cond) host_check((cond), #cond, __FILE__, __LINE__)
+#define HOST_EXPECT_STR(got, want) host_expect_str((got), (want), #got, __FILE__, __LINE__)
+#define HOST_EXPECT_REPORTS(want) HOST_EXPECT_STR(host_reports(), want)
@@ -0,0 +1,3 @@
+#pragma once
+
+void action_tapping_process(keyrecord_t record);
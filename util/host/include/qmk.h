@@ -0,0 +1,205 @@
+/* The parts of qmk_firmware's API the userspace modules use, for building
+ * them on the host with util/host_test.py. Keycode values match
+ * quantum/keycodes.h; the functions are implemented in ../qmk.c. */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef MATRIX_ROWS
+#    define MATRIX_ROWS 5
+#endif
+#ifndef MATRIX_COLS
+#    define MATRIX_COLS 15
+#endif
+#ifndef DYNAMIC_KEYMAP_LAYER_COUNT
+#    define DYNAMIC_KEYMAP_LAYER_COUNT 4
+#endif
+#ifndef TAP_CODE_DELAY
+#    define TAP_CODE_DELAY 0
+#endif
+#define KEYBOARD_REPORT_KEYS 6
+#define PROGMEM
+
+/* Keycodes */
+
+#define KC_NO 0x0000
+#define KC_TRNS 0x0001
+#define KC_TRANSPARENT KC_TRNS
+#define KC_A 0x0004
+#define KC_1 0x001E
+#define KC_0 0x0027
+#define KC_ENTER 0x0028
+#define KC_ESCAPE 0x0029
+#define KC_BACKSPACE 0x002A
+#define KC_TAB 0x002B
+#define KC_SPACE 0x002C
+#define KC_SLASH 0x0038
+#define KC_LEFT_CTRL 0x00E0
+#define KC_LEFT_SHIFT 0x00E1
+#define KC_LEFT_ALT 0x00E2
+#define KC_LEFT_GUI 0x00E3
+#define KC_RIGHT_ALT 0x00E6
+#define KC_RIGHT_GUI 0x00E7
+
+#define QK_MOUSE_CURSOR_UP 0x00CD
+#define QK_MOUSE_CURSOR_DOWN 0x00CE
+#define QK_MOUSE_CURSOR_LEFT 0x00CF
+#define QK_MOUSE_CURSOR_RIGHT 0x00D0
+#define QK_MOUSE_BUTTON_1 0x00D1
+#define QK_MOUSE_BUTTON_8 0x00D8
+#define QK_MOUSE_WHEEL_UP 0x00D9
+#define QK_MOUSE_WHEEL_DOWN 0x00DA
+#define QK_MOUSE_WHEEL_LEFT 0x00DB
+#define QK_MOUSE_WHEEL_RIGHT 0x00DC
+#define QK_MOUSE_ACCELERATION_0 0x00DD
+#define QK_MOUSE_ACCELERATION_1 0x00DE
+#define QK_MOUSE_ACCELERATION_2 0x00DF
+
+#define QK_MODS 0x0100
+#define QK_MOD_TAP 0x2000
+#define QK_LAYER_TAP 0x4000
+#define QK_MOMENTARY 0x5220
+#define QK_MACRO 0x7700
+#define QK_MACRO_MAX 0x777F
+#define QK_GRAVE_ESCAPE 0x7C16
+#define QK_USER 0x7E40
+
+#define MOD_LCTL 0x01
+#define MOD_LSFT 0x02
+#define MOD_LALT 0x04
+#define MOD_LGUI 0x08
+#define MOD_BIT(kc) (1 << ((kc) & 0x07))
+#define MOD_MASK_SHIFT (MOD_BIT(KC_LEFT_SHIFT) | MOD_BIT(0x00E5))
+
+#define MO(layer) (QK_MOMENTARY | ((layer) & 0x1F))
+#define LT(layer, kc) (QK_LAYER_TAP | (((layer) & 0xF) << 8) | ((kc) & 0xFF))
+#define MT(mod, kc) (QK_MOD_TAP | (((mod) & 0x1F) << 8) | ((kc) & 0xFF))
+#define LSFT(kc) (QK_MODS | (MOD_LSFT << 8) | (kc))
+
+#define IS_BASIC_KEYCODE(kc) ((kc) >= 0x0004 && (kc) <= 0x00A4)
+#define IS_MODIFIER_KEYCODE(kc) ((kc) >= 0x00E0 && (kc) <= 0x00E7)
+#define IS_QK_MODS(kc) ((kc) >= 0x0100 && (kc) <= 0x1FFF)
+#define IS_QK_MOD_TAP(kc) ((kc) >= 0x2000 && (kc) <= 0x3FFF)
+#define IS_QK_LAYER_TAP(kc) ((kc) >= 0x4000 && (kc) <= 0x4FFF)
+#define IS_QK_LAYER_MOD(kc) ((kc) >= 0x5000 && (kc) <= 0x51FF)
+#define IS_QK_TO(kc) ((kc) >= 0x5200 && (kc) <= 0x521F)
+#define IS_QK_MOMENTARY(kc) ((kc) >= 0x5220 && (kc) <= 0x523F)
+#define IS_QK_DEF_LAYER(kc) ((kc) >= 0x5240 && (kc) <= 0x525F)
+#define IS_QK_TOGGLE_LAYER(kc) ((kc) >= 0x5260 && (kc) <= 0x527F)
+#define IS_QK_ONE_SHOT_MOD(kc) ((kc) >= 0x52A0 && (kc) <= 0x52BF)
+#define IS_QK_LAYER_TAP_TOGGLE(kc) ((kc) >= 0x52C0 && (kc) <= 0x52DF)
+#define IS_QK_MACRO(kc) ((kc) >= QK_MACRO && (kc) <= QK_MACRO_MAX)
+#define IS_QK_LIGHTING(kc) ((kc) >= 0x7800 && (kc) <= 0x78FF)
+
+#define QK_MODS_GET_MODS(kc) (((kc) >> 8) & 0x1F)
+#define QK_MODS_GET_BASIC_KEYCODE(kc) ((kc) & 0xFF)
+#define QK_MOD_TAP_GET_TAP_KEYCODE(kc) ((kc) & 0xFF)
+#define QK_LAYER_TAP_GET_TAP_KEYCODE(kc) ((kc) & 0xFF)
+
+/* Key events */
+
+typedef struct {
+    uint8_t col;
+    uint8_t row;
+} keypos_t;
+
+typedef struct {
+    keypos_t key;
+    bool     pressed;
+    uint16_t time;
+    uint8_t  type;
+} keyevent_t;
+
+typedef struct {
+    bool    interrupted;
+    bool    speculated;
+    uint8_t count;
+} tap_t;
+
+typedef struct {
+    keyevent_t event;
+    tap_t      tap;
+    uint16_t   keycode;
+} keyrecord_t;
+
+#define IS_KEYEVENT(event) ((event).type != 0)
+#define MAKE_KEYEVENT(r, c, p) ((keyevent_t){.key = (keypos_t){.row = (r), .col = (c)}, .pressed = (p), .time = timer_read(), .type = 1})
+
+typedef uint16_t matrix_row_t;
+typedef uint32_t layer_state_t;
+
+typedef struct {
+    bool nkro;
+} keymap_config_t;
+
+enum usb_device_state {
+    USB_DEVICE_STATE_NO_INIT    = 0,
+    USB_DEVICE_STATE_INIT       = 1,
+    USB_DEVICE_STATE_CONFIGURED = 2,
+    USB_DEVICE_STATE_SUSPEND    = 3,
+};
+
+typedef int8_t mouse_xy_report_t;
+
+typedef struct {
+    uint8_t           buttons;
+    mouse_xy_report_t x;
+    mouse_xy_report_t y;
+    int8_t            v;
+    int8_t            h;
+} report_mouse_t;
+
+extern layer_state_t   layer_state;
+extern layer_state_t   default_layer_state;
+extern keymap_config_t keymap_config;
+
+/* Timer */
+
+uint16_t timer_read(void);
+uint32_t timer_read32(void);
+uint16_t timer_elapsed(uint16_t last);
+uint32_t timer_elapsed32(uint32_t last);
+void     wait_ms(uint32_t ms);
+
+/* Reports */
+
+void    register_code(uint8_t kc);
+void    unregister_code(uint8_t kc);
+void    tap_code(uint8_t kc);
+void    register_code16(uint16_t kc);
+void    unregister_code16(uint16_t kc);
+void    add_key(uint8_t kc);
+void    del_key(uint8_t kc);
+uint8_t get_mods(void);
+void    set_mods(uint8_t mods);
+void    clear_mods(void);
+uint8_t get_weak_mods(void);
+void    add_weak_mods(uint8_t mods);
+void    del_weak_mods(uint8_t mods);
+void    clear_weak_mods(void);
+uint8_t get_oneshot_mods(void);
+void    send_keyboard_report(void);
+void    clear_keyboard(void);
+void    send_char(char ascii);
+void    host_mouse_send(report_mouse_t *report);
+
+/* Actions and layers, left to each test */
+
+void         action_exec(keyevent_t event);
+void         process_record(keyrecord_t *record);
+uint16_t     keymap_key_to_keycode(uint8_t layer, keypos_t key);
+uint8_t      get_highest_layer(layer_state_t state);
+void         layer_clear(void);
+void         update_source_layers_cache(keypos_t key, uint8_t layer);
+uint8_t      read_source_layers_cache(keypos_t key);
+matrix_row_t matrix_get_row(uint8_t row);
+
+/* Everything else */
+
+void eeconfig_update_user(uint32_t val);
+void uprintf(const char *fmt, ...);
+void rgb_matrix_set_suspend_state(bool state);
@@ -0,0 +1,5 @@
+#pragma once
+
+#include <stdint.h>
+
+void raw_hid_send(uint8_t *data, uint8_t length);
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdint.h>
+
+#define SS_QMK_PREFIX 1
+#define SS_TAP_CODE 1
+#define SS_DOWN_CODE 2
+#define SS_UP_CODE 3
+#define SS_DELAY_CODE 4
+
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define PGM_LOADBIT(mem, pos) ((pgm_read_byte(&((mem)[(pos) / 8])) >> ((pos) % 8)) & 0x01)
+
+/* US ANSI, filled in by host_init(). */
+extern uint8_t ascii_to_shift_lut[16];
+extern uint8_t ascii_to_altgr_lut[16];
+extern uint8_t ascii_to_keycode_lut[128];
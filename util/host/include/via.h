@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+enum via_command_id {
+    id_get_protocol_version                 = 0x01,
+    id_get_keyboard_value                   = 0x02,
+    id_set_keyboard_value                   = 0x03,
+    id_dynamic_keymap_get_keycode           = 0x04,
+    id_dynamic_keymap_set_keycode           = 0x05,
+    id_dynamic_keymap_reset                 = 0x06,
+    id_custom_set_value                     = 0x07,
+    id_custom_get_value                     = 0x08,
+    id_custom_save                          = 0x09,
+    id_eeprom_reset                         = 0x0A,
+    id_bootloader_jump                      = 0x0B,
+    id_dynamic_keymap_macro_get_count       = 0x0C,
+    id_dynamic_keymap_macro_get_buffer_size = 0x0D,
+    id_dynamic_keymap_macro_get_buffer      = 0x0E,
+    id_dynamic_keymap_macro_set_buffer      = 0x0F,
+    id_dynamic_keymap_macro_reset           = 0x10,
+    id_dynamic_keymap_get_layer_count       = 0x11,
+    id_dynamic_keymap_get_buffer            = 0x12,
+    id_dynamic_keymap_set_buffer            = 0x13,
+    id_dynamic_keymap_get_encoder           = 0x14,
+    id_dynamic_keymap_set_encoder           = 0x15,
+    id_unhandled                            = 0xFF,
+};
+
+enum via_channel_id {
+    id_custom_channel = 0,
+};
+
+void via_read_custom_config(void *buf, uint32_t offset, uint32_t length);
+void via_update_custom_config(const void *buf, uint32_t offset, uint32_t length);
+void via_eeprom_set_valid(bool valid);
+void eeconfig_init_via(void);
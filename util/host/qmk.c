@@ -0,0 +1,419 @@
+/* A fake keyboard for util/host tests: a millisecond clock that only moves
+ * when a test moves it, a RAM VIA custom config and dynamic keymap, and a
+ * keyboard report that is logged every time it is sent. Every function is
+ * weak, so a test can replace any of them. */
+
+#include <stdarg.h>
+#include <time.h>
+#include "qmk.h"
+#include "host.h"
+#include "send_string.h"
+#include "via.h"
+#include "dynamic_keymap.h"
+#include "keymap_introspection.h"
+#include "raw_hid.h"
+
+#define HOST_WEAK __attribute__((weak))
+#define HOST_LOG_SIZE 65536
+#define HOST_TEXT_SIZE 65536
+
+uint32_t        host_time;
+uint8_t         host_config[HOST_CONFIG_SIZE];
+uint32_t        host_report_count;
+uint8_t         host_most_new_keys;
+report_mouse_t  host_mouse_report;
+uint32_t        host_mouse_count;
+int32_t         host_mouse_x;
+int32_t         host_mouse_y;
+uint16_t        host_dynamic_keymap[DYNAMIC_KEYMAP_LAYER_COUNT][MATRIX_ROWS][MATRIX_COLS];
+uint32_t        host_dynamic_keymap_reads;
+layer_state_t   layer_state;
+layer_state_t   default_layer_state = 1;
+keymap_config_t keymap_config;
+
+uint8_t ascii_to_shift_lut[16];
+uint8_t ascii_to_altgr_lut[16];
+uint8_t ascii_to_keycode_lut[128];
+
+static uint8_t host_keys[KEYBOARD_REPORT_KEYS * 4];
+static uint8_t host_key_count;
+static uint8_t host_mods;
+static uint8_t host_weak_mods;
+static uint8_t host_sent[sizeof(host_keys)];
+static uint8_t host_sent_count;
+static uint8_t host_sent_mods;
+static char    host_log[HOST_LOG_SIZE];
+static size_t  host_log_length;
+static char    host_typed[HOST_TEXT_SIZE];
+static size_t  host_typed_length;
+
+static void host_lut(char ascii, uint8_t keycode, bool shifted) {
+    ascii_to_keycode_lut[(uint8_t)ascii] = keycode;
+    if (shifted) {
+        ascii_to_shift_lut[(uint8_t)ascii / 8] |= 1 << ((uint8_t)ascii % 8);
+    }
+}
+
+HOST_WEAK void host_init(void) {
+    host_time          = 0;
+    host_report_count  = 0;
+    host_most_new_keys = 0;
+    host_mouse_count   = 0;
+    host_mouse_x       = 0;
+    host_mouse_y       = 0;
+    host_key_count     = 0;
+    host_sent_count    = 0;
+    host_sent_mods     = 0;
+    host_mods          = 0;
+    host_weak_mods     = 0;
+    host_log_length    = 0;
+    host_log[0]        = 0;
+    host_text_clear();
+    memset(host_config, 0, sizeof(host_config));
+    dynamic_keymap_reset();
+    host_dynamic_keymap_reads = 0;
+
+    memset(ascii_to_shift_lut, 0, sizeof(ascii_to_shift_lut));
+    memset(ascii_to_altgr_lut, 0, sizeof(ascii_to_altgr_lut));
+    memset(ascii_to_keycode_lut, 0, sizeof(ascii_to_keycode_lut));
+    for (uint8_t i = 0; i < 26; i++) {
+        host_lut('a' + i, KC_A + i, false);
+        host_lut('A' + i, KC_A + i, true);
+    }
+    for (uint8_t i = 0; i < 9; i++) {
+        host_lut('1' + i, KC_1 + i, false);
+        host_lut("!@#$%^&*("[i], KC_1 + i, true);
+    }
+    host_lut('0', KC_0, false);
+    host_lut(')', KC_0, true);
+    host_lut('\n', KC_ENTER, false);
+    host_lut('\e', KC_ESCAPE, false);
+    host_lut('\b', KC_BACKSPACE, false);
+    host_lut('\t', KC_TAB, false);
+    host_lut(' ', 0x2C, false);
+    const char *plain = "-=[]\\";
+    const char *shift = "_+{}|";
+    for (uint8_t i = 0; i < 5; i++) {
+        host_lut(plain[i], 0x2D + i, false);
+        host_lut(shift[i], 0x2D + i, true);
+    }
+    plain = ";'`,./";
+    shift = ":\"~<>?";
+    for (uint8_t i = 0; i < 6; i++) {
+        host_lut(plain[i], 0x33 + i, false);
+        host_lut(shift[i], 0x33 + i, true);
+    }
+}
+
+static char host_ascii(uint8_t keycode, bool shifted) {
+    for (uint8_t ascii = 1; ascii < 128; ascii++) {
+        if (ascii_to_keycode_lut[ascii] == keycode && PGM_LOADBIT(ascii_to_shift_lut, ascii) == shifted) {
+            return ascii;
+        }
+    }
+    return 0;
+}
+
+static void host_type(uint8_t keycode) {
+    char ascii = host_ascii(keycode, (host_mods | host_weak_mods) & MOD_MASK_SHIFT);
+    if (ascii == '\b') {
+        host_typed_length -= host_typed_length > 0;
+    } else if (ascii && host_typed_length < sizeof(host_typed) - 1) {
+        host_typed[host_typed_length++] = ascii;
+    }
+    host_typed[host_typed_length] = 0;
+}
+
+HOST_WEAK void send_keyboard_report(void) {
+    host_report_count++;
+    host_log_length += snprintf(host_log + host_log_length, sizeof(host_log) - host_log_length, "%s%02X:", host_log_length ? " " : "", host_mods | host_weak_mods);
+    uint8_t new_keys = 0;
+    for (uint8_t i = 0; i < host_key_count; i++) {
+        host_log_length += snprintf(host_log + host_log_length, sizeof(host_log) - host_log_length, "%s%02X", i ? "," : "", host_keys[i]);
+        if (!memchr(host_sent, host_keys[i], host_sent_count)) {
+            new_keys++;
+            host_type(host_keys[i]);
+        }
+    }
+    if (host_log_length >= sizeof(host_log)) {
+        host_log_length = sizeof(host_log) - 1;
+    }
+    if (new_keys > host_most_new_keys) {
+        host_most_new_keys = new_keys;
+    }
+    memcpy(host_sent, host_keys, host_key_count);
+    host_sent_count = host_key_count;
+    host_sent_mods  = host_mods | host_weak_mods;
+}
+
+const char *host_reports(void) {
+    static char reports[HOST_LOG_SIZE];
+    memcpy(reports, host_log, host_log_length + 1);
+    host_log_length = 0;
+    host_log[0]     = 0;
+    return reports;
+}
+
+bool host_is_down(uint8_t keycode) {
+    if (IS_MODIFIER_KEYCODE(keycode)) {
+        return (host_sent_mods & MOD_BIT(keycode)) != 0;
+    }
+    return memchr(host_sent, keycode, host_sent_count) != NULL;
+}
+
+const char *host_text(void) {
+    return host_typed;
+}
+
+void host_text_clear(void) {
+    host_typed_length = 0;
+    host_typed[0]     = 0;
+}
+
+uint64_t host_clock_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + now.tv_nsec;
+}
+
+void host_check(bool ok, const char *what, const char *file, int line) {
+    if (!ok) {
+        fprintf(stderr, "%s:%d: check failed: %s\n", file, line, what);
+        exit(1);
+    }
+}
+
+void host_expect_str(const char *got, const char *want, const char *what, const char *file, int line) {
+    if (strcmp(got, want) != 0) {
+        fprintf(stderr, "%s:%d: %s\n  got  \"%s\"\n  want \"%s\"\n", file, line, what, got, want);
+        exit(1);
+    }
+}
+
+/* Timer */
+
+HOST_WEAK uint16_t timer_read(void) {
+    return host_time;
+}
+
+HOST_WEAK uint32_t timer_read32(void) {
+    return host_time;
+}
+
+HOST_WEAK uint16_t timer_elapsed(uint16_t last) {
+    return (uint16_t)host_time - last;
+}
+
+HOST_WEAK uint32_t timer_elapsed32(uint32_t last) {
+    return host_time - last;
+}
+
+HOST_WEAK void wait_ms(uint32_t ms) {
+    host_time += ms;
+}
+
+/* Reports */
+
+HOST_WEAK void add_key(uint8_t kc) {
+    if (!memchr(host_keys, kc, host_key_count) && host_key_count < (keymap_config.nkro ? sizeof(host_keys) : KEYBOARD_REPORT_KEYS)) {
+        host_keys[host_key_count++] = kc;
+    }
+}
+
+HOST_WEAK void del_key(uint8_t kc) {
+    uint8_t *key = memchr(host_keys, kc, host_key_count);
+    if (key) {
+        memmove(key, key + 1, host_keys + --host_key_count - key);
+    }
+}
+
+HOST_WEAK uint8_t get_mods(void) {
+    return host_mods;
+}
+
+HOST_WEAK void set_mods(uint8_t mods) {
+    host_mods = mods;
+}
+
+HOST_WEAK void clear_mods(void) {
+    host_mods = 0;
+}
+
+HOST_WEAK uint8_t get_weak_mods(void) {
+    return host_weak_mods;
+}
+
+HOST_WEAK void add_weak_mods(uint8_t mods) {
+    host_weak_mods |= mods;
+}
+
+HOST_WEAK void del_weak_mods(uint8_t mods) {
+    host_weak_mods &= ~mods;
+}
+
+HOST_WEAK void clear_weak_mods(void) {
+    host_weak_mods = 0;
+}
+
+HOST_WEAK uint8_t get_oneshot_mods(void) {
+    return 0;
+}
+
+HOST_WEAK void register_code(uint8_t kc) {
+    if (kc == KC_NO) {
+        return;
+    }
+    if (IS_MODIFIER_KEYCODE(kc)) {
+        host_mods |= MOD_BIT(kc);
+    } else {
+        add_key(kc);
+    }
+    send_keyboard_report();
+}
+
+HOST_WEAK void unregister_code(uint8_t kc) {
+    if (kc == KC_NO) {
+        return;
+    }
+    if (IS_MODIFIER_KEYCODE(kc)) {
+        host_mods &= ~MOD_BIT(kc);
+    } else {
+        del_key(kc);
+    }
+    send_keyboard_report();
+}
+
+HOST_WEAK void tap_code(uint8_t kc) {
+    register_code(kc);
+    wait_ms(TAP_CODE_DELAY);
+    unregister_code(kc);
+}
+
+// Right-hand mods in the 5-bit form as the 8-bit report mask.
+static uint8_t host_mods_of(uint16_t kc) {
+    uint8_t mods = QK_MODS_GET_MODS(kc);
+    return mods & 0x10 ? (mods & 0x0F) << 4 : mods;
+}
+
+HOST_WEAK void register_code16(uint16_t kc) {
+    uint8_t mods = host_mods_of(kc);
+    if (mods) {
+        if (IS_MODIFIER_KEYCODE(kc) || kc == KC_NO) {
+            host_mods |= mods;
+        } else {
+            host_weak_mods |= mods;
+        }
+        send_keyboard_report();
+    }
+    register_code(kc);
+}
+
+HOST_WEAK void unregister_code16(uint16_t kc) {
+    unregister_code(kc);
+    uint8_t mods = host_mods_of(kc);
+    if (mods) {
+        if (IS_MODIFIER_KEYCODE(kc) || kc == KC_NO) {
+            host_mods &= ~mods;
+        } else {
+            host_weak_mods &= ~mods;
+        }
+        send_keyboard_report();
+    }
+}
+
+HOST_WEAK void clear_keyboard(void) {
+    host_key_count = 0;
+    host_mods      = 0;
+    host_weak_mods = 0;
+    send_keyboard_report();
+}
+
+HOST_WEAK void send_char(char ascii) {
+    uint8_t keycode = ascii_to_keycode_lut[(uint8_t)ascii];
+    bool    shifted = PGM_LOADBIT(ascii_to_shift_lut, (uint8_t)ascii);
+    if (shifted) {
+        register_code(KC_LEFT_SHIFT);
+    }
+    tap_code(keycode);
+    if (shifted) {
+        unregister_code(KC_LEFT_SHIFT);
+    }
+}
+
+HOST_WEAK void host_mouse_send(report_mouse_t *report) {
+    host_mouse_report = *report;
+    host_mouse_count++;
+    host_mouse_x += report->x;
+    host_mouse_y += report->y;
+}
+
+/* VIA custom config */
+
+HOST_WEAK void via_read_custom_config(void *buf, uint32_t offset, uint32_t length) {
+    host_check(offset + length <= sizeof(host_config), "custom config read in range", __FILE__, __LINE__);
+    memcpy(buf, host_config + offset, length);
+}
+
+HOST_WEAK void via_update_custom_config(const void *buf, uint32_t offset, uint32_t length) {
+    host_check(offset + length <= sizeof(host_config), "custom config write in range", __FILE__, __LINE__);
+    memcpy(host_config + offset, buf, length);
+}
+
+/* Dynamic keymap */
+
+HOST_WEAK uint8_t keymap_layer_count_raw(void) {
+    return 1;
+}
+
+HOST_WEAK uint16_t keycode_at_keymap_location_raw(uint8_t layer, uint8_t row, uint8_t column) {
+    return layer == 0 ? KC_A + column : KC_TRNS;
+}
+
+HOST_WEAK uint16_t dynamic_keymap_get_keycode(uint8_t layer, uint8_t row, uint8_t column) {
+    host_dynamic_keymap_reads++;
+    if (layer >= DYNAMIC_KEYMAP_LAYER_COUNT || row >= MATRIX_ROWS || column >= MATRIX_COLS) {
+        return KC_NO;
+    }
+    return host_dynamic_keymap[layer][row][column];
+}
+
+HOST_WEAK void dynamic_keymap_set_keycode(uint8_t layer, uint8_t row, uint8_t column, uint16_t keycode) {
+    if (layer < DYNAMIC_KEYMAP_LAYER_COUNT && row < MATRIX_ROWS && column < MATRIX_COLS) {
+        host_dynamic_keymap[layer][row][column] = keycode;
+    }
+}
+
+HOST_WEAK void dynamic_keymap_reset(void) {
+    for (uint8_t layer = 0; layer < DYNAMIC_KEYMAP_LAYER_COUNT; layer++) {
+        for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+            for (uint8_t column = 0; column < MATRIX_COLS; column++) {
+                host_dynamic_keymap[layer][row][column] = layer < keymap_layer_count_raw() ? keycode_at_keymap_location_raw(layer, row, column) : KC_TRNS;
+            }
+        }
+    }
+}
+
+HOST_WEAK void via_eeprom_set_valid(bool valid) {}
+
+HOST_WEAK void eeconfig_init_via(void) {
+    dynamic_keymap_reset();
+}
+
+/* Everything else */
+
+HOST_WEAK void layer_clear(void) {
+    layer_state = 0;
+}
+
+HOST_WEAK void raw_hid_send(uint8_t *data, uint8_t length) {}
+
+HOST_WEAK void eeconfig_update_user(uint32_t val) {}
+
+HOST_WEAK void rgb_matrix_set_suspend_state(bool state) {}
+
+HOST_WEAK void uprintf(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vprintf(fmt, args);
+    va_end(args);
+}
@@ -0,0 +1,193 @@
+// build: combos.c -DFJ_COMBO_ENABLE
+
+#include "fjlabs.h"
+#include "combos.h"
+#include "via.h"
+#include "host.h"
+
+/* Keys on row 0 type a, b, c, ... once they get past the combo engine. */
+
+#define KEY_A 0
+#define KEY_B 1
+#define KEY_C 2
+#define KEY_D 3
+#define KEY_E 4
+#define KC_X 0x1B
+#define KC_Y 0x1C
+
+void action_tapping_process(keyrecord_t record) {
+    uint8_t keycode = KC_A + record.event.key.row * MATRIX_COLS + record.event.key.col;
+    if (record.event.pressed) {
+        register_code(keycode);
+    } else {
+        unregister_code(keycode);
+    }
+}
+
+static void key(uint8_t col, bool pressed) {
+    keyrecord_t record = {.event = MAKE_KEYEVENT(0, col, pressed)};
+    if (combos_pre_process_record(&record)) {
+        action_tapping_process(record);
+    }
+}
+
+static void wait(uint16_t ms) {
+    host_time += ms;
+    combos_task();
+}
+
+// Sets slot index to the keys on row 0 (0xFF for none) and a keycode.
+static void set_combo(uint8_t index, const uint8_t keys[COMBOS_MAX_KEYS], uint16_t keycode) {
+    uint8_t data[32] = {id_custom_set_value, id_custom_channel, id_fj_combo, index};
+    for (uint8_t i = 0; i < COMBOS_MAX_KEYS; i++) {
+        data[4 + i * 2] = keys[i] == 0xFF ? 0xFF : 0;
+        data[5 + i * 2] = keys[i];
+    }
+    data[4 + COMBOS_MAX_KEYS * 2] = keycode >> 8;
+    data[5 + COMBOS_MAX_KEYS * 2] = keycode & 0xFF;
+    HOST_CHECK(combos_via_custom_value(data, sizeof(data)));
+    HOST_CHECK(data[0] == id_custom_set_value);
+}
+
+static void test_storage(void) {
+    set_combo(1, (uint8_t[]){KEY_B, KEY_C, 0xFF, 0xFF}, KC_ESCAPE);
+    uint8_t data[32] = {id_custom_get_value, id_custom_channel, id_fj_combo, 1};
+    HOST_CHECK(combos_via_custom_value(data, sizeof(data)));
+    HOST_CHECK(data[4] == 0 && data[5] == KEY_B && data[6] == 0 && data[7] == KEY_C && data[8] == 0xFF);
+    HOST_CHECK(data[12] == 0 && data[13] == KC_ESCAPE);
+
+    combos_init();
+    data[0] = id_custom_get_value;
+    HOST_CHECK(combos_via_custom_value(data, sizeof(data)));
+    HOST_CHECK(data[5] == KEY_B && data[13] == KC_ESCAPE);
+    set_combo(1, (uint8_t[]){0xFF, 0xFF, 0xFF, 0xFF}, KC_NO);
+}
+
+static void test_chord(void) {
+    set_combo(0, (uint8_t[]){KEY_A, KEY_B, 0xFF, 0xFF}, KC_X);
+
+    key(KEY_A, true);
+    key(KEY_B, true);
+    HOST_EXPECT_REPORTS("00:1B");
+    key(KEY_B, false);
+    HOST_EXPECT_REPORTS("00:");
+    key(KEY_A, false);
+    HOST_EXPECT_REPORTS("");
+
+    // Not a combo: replayed in order.
+    key(KEY_A, true);
+    key(KEY_C, true);
+    key(KEY_A, false);
+    key(KEY_C, false);
+    HOST_EXPECT_REPORTS("00:04 00:04,06 00:06 00:");
+
+    // Too slow: A goes through on its own, then B waits for a partner.
+    key(KEY_A, true);
+    wait(FJ_COMBO_TERM + 1);
+    HOST_EXPECT_REPORTS("00:04");
+    key(KEY_B, true);
+    HOST_EXPECT_REPORTS("");
+    key(KEY_B, false);
+    key(KEY_A, false);
+    HOST_EXPECT_REPORTS("00:04,05 00:04 00:");
+}
+
+static void test_two_held(void) {
+    set_combo(0, (uint8_t[]){KEY_A, KEY_B, 0xFF, 0xFF}, KC_X);
+    set_combo(1, (uint8_t[]){KEY_C, KEY_D, 0xFF, 0xFF}, KC_Y);
+
+    key(KEY_A, true);
+    key(KEY_B, true);
+    key(KEY_C, true);
+    key(KEY_D, true);
+    HOST_EXPECT_REPORTS("00:1B 00:1B,1C");
+    key(KEY_A, false);
+    HOST_EXPECT_REPORTS("00:1C");
+    key(KEY_D, false);
+    HOST_EXPECT_REPORTS("00:");
+    // The other members' releases do not leak through.
+    key(KEY_B, false);
+    key(KEY_C, false);
+    HOST_EXPECT_REPORTS("");
+
+    // A plain key between them is not taken for a member.
+    key(KEY_A, true);
+    key(KEY_B, true);
+    key(KEY_E, true);
+    key(KEY_A, false);
+    key(KEY_E, false);
+    key(KEY_B, false);
+    HOST_EXPECT_REPORTS("00:1B 00:1B,08 00:08 00:");
+
+    set_combo(1, (uint8_t[]){0xFF, 0xFF, 0xFF, 0xFF}, KC_NO);
+}
+
+static void test_superset(void) {
+    set_combo(0, (uint8_t[]){KEY_A, KEY_B, 0xFF, 0xFF}, KC_X);
+    set_combo(1, (uint8_t[]){KEY_A, KEY_B, KEY_C, 0xFF}, KC_Y);
+
+    // The longer combo is still reachable.
+    key(KEY_A, true);
+    key(KEY_B, true);
+    HOST_EXPECT_REPORTS("");
+    key(KEY_C, true);
+    HOST_EXPECT_REPORTS("00:1C");
+    key(KEY_C, false);
+    key(KEY_B, false);
+    key(KEY_A, false);
+    HOST_EXPECT_REPORTS("00:");
+
+    // The shorter one fires on a release, the term or a key outside both.
+    key(KEY_A, true);
+    key(KEY_B, true);
+    key(KEY_A, false);
+    key(KEY_B, false);
+    HOST_EXPECT_REPORTS("00:1B 00:");
+
+    key(KEY_B, true);
+    key(KEY_A, true);
+    wait(FJ_COMBO_TERM + 1);
+    HOST_EXPECT_REPORTS("00:1B");
+    key(KEY_B, false);
+    key(KEY_A, false);
+    HOST_EXPECT_REPORTS("00:");
+
+    key(KEY_A, true);
+    key(KEY_B, true);
+    key(KEY_E, true);
+    key(KEY_E, false);
+    key(KEY_A, false);
+    key(KEY_B, false);
+    HOST_EXPECT_REPORTS("00:1B 00:1B,08 00:1B 00:");
+
+    // Two of the three keys and nothing complete: replayed.
+    key(KEY_A, true);
+    key(KEY_C, true);
+    wait(FJ_COMBO_TERM + 1);
+    key(KEY_C, false);
+    key(KEY_A, false);
+    HOST_EXPECT_REPORTS("00:04 00:04,06 00:04 00:");
+}
+
+static void test_redefined_while_held(void) {
+    set_combo(1, (uint8_t[]){0xFF, 0xFF, 0xFF, 0xFF}, KC_NO);
+    set_combo(0, (uint8_t[]){KEY_A, KEY_B, 0xFF, 0xFF}, KC_X);
+    key(KEY_A, true);
+    key(KEY_B, true);
+    set_combo(0, (uint8_t[]){KEY_C, KEY_D, 0xFF, 0xFF}, KC_Y);
+    // The old keycode is released, the members go through as releases of keys that are not down.
+    key(KEY_A, false);
+    key(KEY_B, false);
+    HOST_EXPECT_REPORTS("00:1B 00: 00: 00:");
+}
+
+int main(void) {
+    host_init();
+    combos_init();
+    test_storage();
+    test_chord();
+    test_two_held();
+    test_superset();
+    test_redefined_while_held();
+    return 0;
+}
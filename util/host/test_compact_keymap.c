@@ -0,0 +1,168 @@
+// build: keymap_store.c -DFJ_COMPACT_KEYMAP_ENABLE -DFJ_KEYMAP_STORE_ENABLE -DFJ_VIA_CONFIG_ENABLE -fsanitize=address,undefined
+
+/* The store is included rather than linked, so the tests can see how each
+ * layer is encoded. With a 5x15 matrix the default size leaves room for five
+ * byte layers, or two wide ones and a byte one. */
+#include "compact_keymap.c"
+#include "keymap_store.h"
+#include "host.h"
+
+#define KC_B 0x05
+#define KC_C 0x06
+#define KC_Z 0x1D
+
+// Keycodes no byte holds, so each takes a dictionary slot in a byte layer.
+#define WIDE(n) (0x7C00 + (n))
+
+static uint16_t shadow[FJ_COMPACT_KEYMAP_LAYERS][MATRIX_ROWS][MATRIX_COLS];
+
+uint8_t keymap_layer_count_raw(void) {
+    return 1;
+}
+
+uint16_t keycode_at_keymap_location_raw(uint8_t layer, uint8_t row, uint8_t column) {
+    return KC_A + column;
+}
+
+static void start(void) {
+    compact_keymap_reset();
+    compact_keymap_init();
+    for (uint8_t layer = 0; layer < FJ_COMPACT_KEYMAP_LAYERS; layer++) {
+        HOST_CHECK(ck_mode[layer] == CK_EMPTY);
+        for (uint8_t key = 0; key < CK_KEYS; key++) {
+            shadow[layer][key / MATRIX_COLS][key % MATRIX_COLS] = KC_TRNS;
+        }
+    }
+}
+
+static bool set(uint8_t layer, uint8_t key, uint16_t keycode) {
+    bool stored = compact_keymap_set_keycode(layer, key / MATRIX_COLS, key % MATRIX_COLS, keycode);
+    if (stored) {
+        shadow[layer][key / MATRIX_COLS][key % MATRIX_COLS] = keycode;
+    }
+    return stored;
+}
+
+static void fill(uint8_t layer, uint16_t keycode) {
+    for (uint8_t key = 0; key < CK_KEYS; key++) {
+        HOST_CHECK(set(layer, key, keycode));
+    }
+}
+
+// Every key reads back as last stored, and the store survives a reboot.
+static void check(void) {
+    for (uint8_t pass = 0; pass < 2; pass++) {
+        for (uint8_t layer = 0; layer < FJ_COMPACT_KEYMAP_LAYERS; layer++) {
+            for (uint8_t key = 0; key < CK_KEYS; key++) {
+                HOST_CHECK(compact_keymap_get_keycode(layer, key / MATRIX_COLS, key % MATRIX_COLS) == shadow[layer][key / MATRIX_COLS][key % MATRIX_COLS]);
+            }
+        }
+        compact_keymap_init();
+    }
+}
+
+// Changing one key through many keycodes reuses its dictionary slot.
+static void test_dictionary_reuse(void) {
+    start();
+    for (uint16_t i = 0; i < 10 * CK_DICT_SIZE; i++) {
+        HOST_CHECK(set(0, 0, WIDE(i)));
+        HOST_CHECK(ck_mode[0] == CK_BYTE);
+    }
+    // A full dictionary of keys in use still takes a new keycode on one of them.
+    for (uint8_t slot = 0; slot < CK_DICT_SIZE; slot++) {
+        HOST_CHECK(set(0, slot, WIDE(1000 + slot)));
+    }
+    HOST_CHECK(set(0, 0, WIDE(2000)));
+    HOST_CHECK(ck_mode[0] == CK_BYTE);
+    // One more keycode than the dictionary holds has to widen the layer.
+    HOST_CHECK(set(0, CK_DICT_SIZE, WIDE(2001)));
+    HOST_CHECK(ck_mode[0] == CK_WIDE);
+    check();
+}
+
+// A full store refuses a write, and takes it once a layer is cleared.
+static void test_full(void) {
+    start();
+    uint8_t layers = (FJ_COMPACT_KEYMAP_SIZE - CK_DATA_OFFSET) / CK_KEYS;
+    for (uint8_t layer = 0; layer < layers; layer++) {
+        fill(layer, KC_A + layer);
+    }
+    HOST_CHECK(!set(layers, 0, KC_Z));
+    HOST_CHECK(ck_mode[layers] == CK_EMPTY);
+    check();
+
+    fill(1, KC_TRNS);
+    HOST_CHECK(set(layers, 0, KC_Z));
+    HOST_CHECK(ck_mode[1] == CK_EMPTY && ck_mode[layers] == CK_BYTE);
+    check();
+}
+
+// A wide layer whose keycodes fit in bytes again gives back its second byte per key.
+static void test_narrow(void) {
+    start();
+    for (uint8_t key = 0; key <= CK_DICT_SIZE; key++) {
+        HOST_CHECK(set(0, key, WIDE(key)));
+    }
+    HOST_CHECK(ck_mode[0] == CK_WIDE);
+    uint8_t layers = (FJ_COMPACT_KEYMAP_SIZE - CK_DATA_OFFSET) / CK_KEYS - 2;
+    for (uint8_t layer = 1; layer <= layers; layer++) {
+        fill(layer, KC_B);
+    }
+    HOST_CHECK(!set(layers + 1, 0, KC_C));
+
+    HOST_CHECK(set(0, 0, KC_A));
+    HOST_CHECK(set(layers + 1, 0, KC_C));
+    HOST_CHECK(ck_mode[0] == CK_BYTE);
+    check();
+}
+
+// Random writes across every layer, checked against what was stored.
+static void test_random_writes(void) {
+    start();
+    uint32_t seed = 3;
+    for (uint16_t step = 0; step < 20000; step++) {
+        seed          = seed * 1103515245 + 12345;
+        uint16_t pick = (seed >> 16) % 10;
+        uint16_t keycode = pick < 5 ? KC_TRNS : pick < 8 ? (seed >> 8) % 0xE8 : WIDE((seed >> 8) % 40);
+        set((seed >> 4) % FJ_COMPACT_KEYMAP_LAYERS, (seed >> 8) % CK_KEYS, keycode);
+        if (step % 1000 == 0) {
+            check();
+        }
+    }
+    check();
+}
+
+// VIA is told about a key the store has no room for.
+static void test_via_unhandled(void) {
+    keymap_store_reset();
+    keymap_store_init();
+    start();
+    uint8_t layers = (FJ_COMPACT_KEYMAP_SIZE - CK_DATA_OFFSET) / CK_KEYS;
+    for (uint8_t layer = 0; layer < layers; layer++) {
+        fill(layer, KC_A);
+    }
+
+    uint8_t data[32] = {id_dynamic_keymap_set_keycode, DYNAMIC_KEYMAP_LAYER_COUNT, 0, 0, 0, KC_B};
+    HOST_CHECK(keymap_store_via_command(data, sizeof(data)));
+    HOST_CHECK(data[0] == id_dynamic_keymap_set_keycode);
+
+    data[1] = DYNAMIC_KEYMAP_LAYER_COUNT + layers;
+    HOST_CHECK(keymap_store_via_command(data, sizeof(data)));
+    HOST_CHECK(data[0] == id_unhandled);
+
+    uint16_t offset = (DYNAMIC_KEYMAP_LAYER_COUNT + layers) * CK_KEYS * 2;
+    uint8_t  buffer[32] = {id_dynamic_keymap_set_buffer, offset >> 8, offset & 0xFF, 2, 0, KC_B};
+    HOST_CHECK(keymap_store_via_command(buffer, sizeof(buffer)));
+    HOST_CHECK(buffer[0] == id_unhandled);
+    HOST_CHECK(keymap_store_get_keycode(DYNAMIC_KEYMAP_LAYER_COUNT + layers, 0, 0) == KC_TRNS);
+}
+
+int main(void) {
+    host_init();
+    test_dictionary_reuse();
+    test_full();
+    test_narrow();
+    test_random_writes();
+    test_via_unhandled();
+    return 0;
+}
@@ -0,0 +1,64 @@
+// build: expand.c -DFJ_EXPAND_ENABLE
+// setup: python3 "$USERSPACE/util/via_expand.py" "$USERSPACE/util/host/expand_dictionary.txt" -n -o expand.bin
+
+#include <string.h>
+#include "fjlabs.h"
+#include "expand.h"
+#include "send_string.h"
+#include "host.h"
+
+/* The dictionary in expand_dictionary.txt, compiled by via_expand.py. Each
+ * character is typed with its US key, shifted when it needs to be, and the
+ * key goes to the host unless expand_process_record takes it. */
+
+static void type(const char *text) {
+    for (; *text; text++) {
+        uint8_t keycode = ascii_to_keycode_lut[(uint8_t)*text];
+        bool    shifted = PGM_LOADBIT(ascii_to_shift_lut, (uint8_t)*text);
+        if (shifted) {
+            register_code(KC_LEFT_SHIFT);
+        }
+        keyrecord_t record = {.event = MAKE_KEYEVENT(0, 0, true)};
+        if (expand_process_record(keycode, &record)) {
+            tap_code(keycode);
+        }
+        if (shifted) {
+            unregister_code(KC_LEFT_SHIFT);
+        }
+    }
+}
+
+static void expect(const char *typed, const char *want) {
+    host_text_clear();
+    type(typed);
+    HOST_EXPECT_STR(host_text(), want);
+    // Whatever is left of a partial match does not carry over.
+    type("\n");
+}
+
+int main(void) {
+    host_init();
+    FILE *file = fopen("expand.bin", "rb");
+    HOST_CHECK(file != NULL);
+    HOST_CHECK(fread(&host_config[FJ_CONFIG_EXPAND_OFFSET], 1, FJ_EXPAND_SIZE, file) > 0);
+    fclose(file);
+    expand_init();
+
+    expect("hello ;sig", "hello Best regards,\nFJLabs Support");
+    expect(";ad", "ADDR");
+    expect(";addr", "ADDRdr");
+    expect("yq", "YQ");
+
+    // A trigger that starts inside a partial match of another one.
+    expect("ababac", "abONE");
+    expect("abaabac", "abaONE");
+    expect("xyq", "xYQ");
+    expect("abcd", "aBCD");
+    expect("abcde", "aBCDe");
+
+    // Anything but a character starts over.
+    expect("ab\nac", "ab\nac");
+    expect("a;sig", "aBest regards,\nFJLabs Support");
+    expect("AbAC", "AbAC");
+    return 0;
+}
@@ -0,0 +1,104 @@
+// build: -DFJ_KEYMAP_MIRROR_ENABLE -DFJ_KEYMAP_STORE_ENABLE -fsanitize=address,undefined
+// build: -DFJ_KEYMAP_MIRROR_ENABLE -DFJ_KEYMAP_STORE_ENABLE -DFJ_KEYMAP_MIRROR_LAYERS=1
+// build: -DFJ_KEYMAP_MIRROR_ENABLE -DFJ_KEYMAP_STORE_ENABLE -DFJ_KEYMAP_MIRROR_LAYERS=1 -DFJ_KEYMAP_MIRROR_ENTRIES=20
+// build: -DFJ_KEYMAP_MIRROR_ENABLE -DFJ_KEYMAP_STORE_ENABLE -DFJ_KEYMAP_MIRROR_LAYERS=2 -DFJ_PROFILE_ENABLE
+// build: compact_keymap.c -DFJ_KEYMAP_MIRROR_ENABLE -DFJ_KEYMAP_STORE_ENABLE -DFJ_KEYMAP_MIRROR_LAYERS=1 -DFJ_COMPACT_KEYMAP_ENABLE -DFJ_VIA_CONFIG_ENABLE
+
+/* The store is included rather than linked, so the mirror can be checked
+ * against what the store holds underneath it, after every write. */
+#include "keymap_store.c"
+#include "host.h"
+
+#define KC_X 0x1B
+
+uint8_t keymap_layer_count_raw(void) {
+    return 2;
+}
+
+uint16_t keycode_at_keymap_location_raw(uint8_t layer, uint8_t row, uint8_t column) {
+    return layer == 0 ? KC_A + column : layer == 1 && row == 0 ? KC_1 + column : KC_TRNS;
+}
+
+static void check_mirror(void) {
+    for (uint8_t layer = 0; layer < KEYMAP_STORE_VISIBLE_LAYERS; layer++) {
+        for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+            for (uint8_t column = 0; column < MATRIX_COLS; column++) {
+                HOST_CHECK(keymap_store_get_keycode(layer, row, column) == keymap_store_get_raw(keymap_store_base + layer, row, column));
+            }
+        }
+    }
+}
+
+// The layers copied whole never reach the store on a lookup.
+static void test_no_reads(void) {
+    keymap_store_reset();
+    keymap_store_init();
+    check_mirror();
+    host_dynamic_keymap_reads = 0;
+    for (uint8_t layer = 0; layer < FJ_KEYMAP_MIRROR_LAYERS; layer++) {
+        for (uint8_t column = 0; column < MATRIX_COLS; column++) {
+            HOST_CHECK(keymap_key_to_keycode(layer, (keypos_t){.row = 0, .col = column}) == keycode_at_keymap_location_raw(layer, 0, column));
+        }
+    }
+    HOST_CHECK(host_dynamic_keymap_reads == 0);
+}
+
+// VIA names any row and column; those off the matrix touch nothing.
+static void test_out_of_range(void) {
+    keymap_store_reset();
+    keymap_store_init();
+    const uint8_t keys[][2] = {{0, MATRIX_COLS}, {0, 76}, {MATRIX_ROWS, 0}, {0xFF, 0xFF}};
+    for (uint8_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+        uint8_t data[32] = {id_dynamic_keymap_set_keycode, 0, keys[i][0], keys[i][1], 0, KC_X};
+        HOST_CHECK(keymap_store_via_command(data, sizeof(data)));
+        data[0] = id_dynamic_keymap_get_keycode;
+        HOST_CHECK(keymap_store_via_command(data, sizeof(data)));
+        HOST_CHECK(data[4] == 0 && data[5] == 0);
+        check_mirror();
+    }
+    for (uint8_t column = 0; column < MATRIX_COLS; column++) {
+        HOST_CHECK(keymap_store_get_keycode(0, 0, column) == keycode_at_keymap_location_raw(0, 0, column));
+        HOST_CHECK(keymap_store_get_keycode(0, MATRIX_ROWS - 1, column) == keycode_at_keymap_location_raw(0, MATRIX_ROWS - 1, column));
+    }
+}
+
+// Random keycode and buffer writes, resets and profile switches.
+static void test_random_writes(void) {
+    uint32_t seed = 2;
+    uint16_t end  = KEYMAP_STORE_VISIBLE_LAYERS * KEYMAP_STORE_KEYS * 2;
+    for (uint16_t step = 0; step < 3000; step++) {
+        seed          = seed * 1103515245 + 12345;
+        uint16_t pick = (seed >> 16) % 10;
+        uint16_t keycode = pick < 4 ? KC_TRNS : pick < 8 ? (seed >> 8) % 0xE8 : seed >> 8;
+        if (step % 5 == 0) {
+            uint16_t offset  = (seed >> 4) % end;
+            uint8_t  size    = 1 + (seed >> 20) % 27;
+            uint8_t  data[32] = {id_dynamic_keymap_set_buffer, offset >> 8, offset & 0xFF, size};
+            for (uint8_t i = 0; i < size; i++) {
+                seed        = seed * 1103515245 + 12345;
+                data[4 + i] = (offset + i) & 1 || (seed >> 16) & 1 ? seed >> 8 : 0;
+            }
+            HOST_CHECK(keymap_store_via_command(data, sizeof(data)));
+        } else {
+            keymap_store_set_keycode((seed >> 4) % KEYMAP_STORE_VISIBLE_LAYERS, (seed >> 8) % MATRIX_ROWS, (seed >> 12) % MATRIX_COLS, keycode);
+        }
+#ifdef FJ_PROFILE_ENABLE
+        if (step % 50 == 0) {
+            keymap_store_set_profile((seed >> 24) % FJ_PROFILE_COUNT);
+        }
+#endif
+        if (step % 1000 == 999) {
+            uint8_t data[32] = {step % 2000 == 999 ? id_dynamic_keymap_reset : id_eeprom_reset};
+            HOST_CHECK(keymap_store_via_command(data, sizeof(data)));
+        }
+        check_mirror();
+    }
+}
+
+int main(void) {
+    host_init();
+    test_no_reads();
+    test_out_of_range();
+    test_random_writes();
+    return 0;
+}
@@ -0,0 +1,212 @@
+// build: layer_reeval.c -DFJ_LAYER_REEVAL_ENABLE
+
+#include "fjlabs.h"
+#include "layer_reeval.h"
+#include "host.h"
+
+/* A two layer keymap run through the parts of QMK's action code that
+ * matter here: the source layer cache, MO(1), and layer_state_set calling
+ * layer_state_set_user, as the hub in fjlabs.c does. */
+
+#define KEY_SHIFT 4
+#define KEY_USER 5
+#define KEY_J 9
+#define KEY_K 10
+#define KEY_L 11
+#define KEY_MO (MATRIX_COLS - 1)
+
+static uint16_t keymap[2][MATRIX_ROWS][MATRIX_COLS];
+static uint8_t  source_layers[MATRIX_ROWS][MATRIX_COLS];
+
+uint16_t keymap_key_to_keycode(uint8_t layer, keypos_t key) {
+    return keymap[layer][key.row][key.col];
+}
+
+uint8_t get_highest_layer(layer_state_t state) {
+    uint8_t layer = 0;
+    for (uint8_t l = 0; l < 32; l++) {
+        if (state & ((layer_state_t)1 << l)) {
+            layer = l;
+        }
+    }
+    return layer;
+}
+
+void update_source_layers_cache(keypos_t key, uint8_t layer) {
+    source_layers[key.row][key.col] = layer;
+}
+
+uint8_t read_source_layers_cache(keypos_t key) {
+    return source_layers[key.row][key.col];
+}
+
+static uint8_t resolve_layer(keypos_t key) {
+    layer_state_t active = layer_state | default_layer_state;
+    for (int8_t l = 1; l > 0; l--) {
+        if ((active & ((layer_state_t)1 << l)) && keymap[l][key.row][key.col] != KC_TRNS) {
+            return l;
+        }
+    }
+    return 0;
+}
+
+static void event(uint8_t row, uint8_t col, bool pressed) {
+    keypos_t    key    = {.row = row, .col = col};
+    keyrecord_t record = {.event = MAKE_KEYEVENT(row, col, pressed)};
+    if (pressed) {
+        update_source_layers_cache(key, resolve_layer(key));
+    }
+    uint16_t keycode = keymap[read_source_layers_cache(key)][row][col];
+
+    layer_reeval_record(keycode, &record);
+    if (keycode == MO(1)) {
+        layer_state = layer_reeval_state(pressed ? layer_state | 2 : layer_state & ~2);
+    } else if (IS_BASIC_KEYCODE(keycode) || IS_MODIFIER_KEYCODE(keycode)) {
+        if (pressed) {
+            register_code(keycode);
+        } else {
+            unregister_code(keycode);
+        }
+    }
+}
+
+static void key(uint8_t col, bool pressed) {
+    event(0, col, pressed);
+}
+
+static void test_changes(void) {
+    // Held, then the layer changes under it.
+    key(KEY_J, true);
+    key(KEY_MO, true);
+    HOST_EXPECT_REPORTS("00:0D 00: 00:27");
+    // The release is the new keycode's.
+    key(KEY_J, false);
+    key(KEY_MO, false);
+    HOST_EXPECT_REPORTS("00:");
+
+    // And back when the layer goes away.
+    key(KEY_MO, true);
+    key(KEY_J, true);
+    key(KEY_MO, false);
+    HOST_EXPECT_REPORTS("00:27 00: 00:0D");
+    key(KEY_J, false);
+    HOST_EXPECT_REPORTS("00:");
+
+    // Transparent on layer 1: nothing to do.
+    key(KEY_K, true);
+    key(KEY_MO, true);
+    key(KEY_MO, false);
+    key(KEY_K, false);
+    HOST_EXPECT_REPORTS("00:0E 00:");
+
+    // KC_NO on layer 1 releases the key, and it comes back with layer 0.
+    key(KEY_L, true);
+    key(KEY_MO, true);
+    key(KEY_MO, false);
+    key(KEY_L, false);
+    HOST_EXPECT_REPORTS("00:0F 00: 00:0F 00:");
+
+    // Modifiers too.
+    key(KEY_SHIFT, true);
+    key(KEY_MO, true);
+    key(KEY_SHIFT, false);
+    key(KEY_MO, false);
+    HOST_EXPECT_REPORTS("02: 00: 01: 00:");
+
+    // A key that resolves to something else on the new layer is left alone.
+    key(KEY_USER, true);
+    key(KEY_MO, true);
+    key(KEY_MO, false);
+    key(KEY_USER, false);
+    HOST_EXPECT_REPORTS("00:09 00:");
+}
+
+static void test_rapid_toggle(void) {
+    key(KEY_J, true);
+    key(KEY_K, true);
+    key(KEY_L, true);
+    HOST_EXPECT_REPORTS("00:0D 00:0D,0E 00:0D,0E,0F");
+    for (uint8_t i = 0; i < 3; i++) {
+        key(KEY_MO, true);
+        HOST_EXPECT_REPORTS("00:0E,0F 00:0E,0F,27 00:0E,27");
+        key(KEY_MO, false);
+        HOST_EXPECT_REPORTS("00:0E 00:0E,0D 00:0E,0D,0F");
+    }
+    // Released while layer 1 is up, after it changed twice.
+    key(KEY_MO, true);
+    HOST_EXPECT_REPORTS("00:0E,0F 00:0E,0F,27 00:0E,27");
+    key(KEY_K, false);
+    key(KEY_J, false);
+    key(KEY_L, false);
+    key(KEY_MO, false);
+    HOST_EXPECT_REPORTS("00:27 00:");
+}
+
+// Random rollover with MO(1) going up and down: after every event the
+// report has exactly the keys the held keys resolve to now. Every key has
+// its own keycodes, so two held keys never share one.
+static void test_random_rollover(void) {
+    bool     held[MATRIX_COLS] = {0};
+    uint32_t seed              = 3;
+    for (uint32_t step = 0; step < 200000; step++) {
+        seed          = seed * 1103515245 + 12345;
+        uint8_t col   = (seed >> 16) % 3 == 0 ? KEY_MO : (seed >> 18) % KEY_MO;
+        uint8_t count = 0;
+        if (col == KEY_USER) {
+            continue;
+        }
+        for (uint8_t c = 0; c < MATRIX_COLS; c++) {
+            count += held[c];
+        }
+        if (!held[col] && count >= 6) {
+            continue;
+        }
+        held[col] = !held[col];
+        key(col, held[col]);
+        host_reports();
+
+        for (uint8_t c = 0; c < KEY_MO; c++) {
+            uint16_t keycode = keymap[resolve_layer((keypos_t){.row = 0, .col = c})][0][c];
+            if (held[c] && keycode != KC_NO) {
+                HOST_CHECK(host_is_down(keycode));
+            }
+        }
+        for (uint16_t keycode = KC_A; keycode <= KC_RIGHT_GUI; keycode++) {
+            bool want = false;
+            for (uint8_t c = 0; c < KEY_MO; c++) {
+                want |= held[c] && keymap[resolve_layer((keypos_t){.row = 0, .col = c})][0][c] == keycode;
+            }
+            if (!want) {
+                HOST_CHECK(!host_is_down(keycode));
+            }
+        }
+    }
+    for (uint8_t c = 0; c < MATRIX_COLS; c++) {
+        if (held[c]) {
+            key(c, false);
+        }
+    }
+    for (uint16_t keycode = KC_A; keycode <= KC_RIGHT_GUI; keycode++) {
+        HOST_CHECK(!host_is_down(keycode));
+    }
+}
+
+int main(void) {
+    host_init();
+    for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+        keymap[0][0][col] = KC_A + col;
+        keymap[1][0][col] = KC_1 + col;
+    }
+    keymap[1][0][KEY_K]     = KC_TRNS;
+    keymap[1][0][KEY_L]     = KC_NO;
+    keymap[0][0][KEY_SHIFT] = KC_LEFT_SHIFT;
+    keymap[1][0][KEY_SHIFT] = KC_LEFT_CTRL;
+    keymap[1][0][KEY_USER]  = FJ_LATENCY_REPORT;
+    keymap[0][0][KEY_MO]    = MO(1);
+    keymap[1][0][KEY_MO]    = KC_TRNS;
+
+    test_changes();
+    test_rapid_toggle();
+    test_random_rollover();
+    return 0;
+}
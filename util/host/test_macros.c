@@ -0,0 +1,86 @@
+// build: macros.c -DFJ_MACRO_COALESCE_ENABLE -DNKRO_ENABLE
+
+#include "fjlabs.h"
+#include "macros.h"
+#include "send_string.h"
+#include "host.h"
+
+static uint8_t  macro_buffer[1024];
+static uint16_t macro_length;
+static uint8_t  macro_count;
+
+uint8_t dynamic_keymap_macro_get_count(void) {
+    return 16;
+}
+
+uint16_t dynamic_keymap_macro_get_buffer_size(void) {
+    return sizeof(macro_buffer);
+}
+
+void dynamic_keymap_macro_get_buffer(uint16_t offset, uint16_t size, uint8_t *data) {
+    for (uint16_t i = 0; i < size; i++) {
+        data[i] = offset + i < sizeof(macro_buffer) ? macro_buffer[offset + i] : 0;
+    }
+}
+
+// Appends a macro of length bytes and returns its keycode.
+static uint16_t add_macro(const void *macro, uint16_t length) {
+    memcpy(macro_buffer + macro_length, macro, length);
+    macro_length += length;
+    macro_buffer[macro_length++] = 0;
+    return QK_MACRO + macro_count++;
+}
+
+static uint16_t add_text(const char *text) {
+    return add_macro(text, strlen(text));
+}
+
+static bool play(uint16_t keycode) {
+    keyrecord_t record = {.event = MAKE_KEYEVENT(0, 0, true)};
+    host_text_clear();
+    return macros_process_record(keycode, &record);
+}
+
+static const char *const prose = "Lorem ipsum dolor sit amet, consectetur adipiscing elit. Sed do eiusmod tempor incididunt ut labore et dolore magna aliqua. Ut enim ad minim veniam, quis nostrud exercitation ullamco laboris nisi ut aliquip ex ea commodo consequat.\n";
+
+int main(void) {
+    host_init();
+    uint16_t ab      = add_text("ab");
+    uint16_t repeat  = add_text("ll");
+    uint16_t shift   = add_text("aAb");
+    uint16_t text    = add_text(prose);
+    uint16_t escapes = add_macro((uint8_t[]){'a', SS_QMK_PREFIX, SS_DOWN_CODE, KC_LEFT_SHIFT, 'b', 'c', SS_QMK_PREFIX, SS_UP_CODE, KC_LEFT_SHIFT, SS_QMK_PREFIX, SS_TAP_CODE, KC_ENTER, 'd', SS_QMK_PREFIX, SS_DELAY_CODE, '2', '5', '|', 'e'}, 19);
+    uint16_t unknown = add_macro((uint8_t[]){'a', SS_QMK_PREFIX, 9, 'b'}, 4);
+
+    // The previous key goes up in the report that presses the next one.
+    HOST_CHECK(!play(ab));
+    HOST_EXPECT_REPORTS("00:04 00:05 00:");
+    HOST_CHECK(!play(repeat));
+    HOST_EXPECT_REPORTS("00:0F 00: 00:0F 00:");
+    // Shift changes in a report of its own, which also lets go of the a.
+    HOST_CHECK(!play(shift));
+    HOST_EXPECT_REPORTS("00:04 02: 02:04 00: 00:05 00:");
+    HOST_EXPECT_STR(host_text(), "aAb");
+
+    // Escape codes are played in place, with nothing held.
+    host_time = 0;
+    HOST_CHECK(!play(escapes));
+    HOST_EXPECT_REPORTS("00:04 00: 02: 02:05 02:06 02: 00: 00:28 00: 00:07 00: 00:08 00:");
+    HOST_EXPECT_STR(host_text(), "aBC\nde");
+    HOST_CHECK(host_time >= 25);
+
+    // Anything else goes to the stock player.
+    HOST_CHECK(play(unknown));
+    HOST_EXPECT_REPORTS("");
+
+    for (uint8_t nkro = 0; nkro < 2; nkro++) {
+        keymap_config.nkro = nkro;
+        host_most_new_keys = 0;
+        HOST_CHECK(!play(text));
+        HOST_EXPECT_STR(host_text(), prose);
+        HOST_CHECK(host_most_new_keys == 1);
+        const char *reports = host_reports();
+        HOST_EXPECT_STR(reports + strlen(reports) - 3, "00:");
+    }
+    return 0;
+}
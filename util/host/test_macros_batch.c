@@ -0,0 +1,69 @@
+// build: macros.c -DFJ_MACRO_COALESCE_ENABLE -DNKRO_ENABLE -DFJ_MACRO_BATCH=8
+
+#include "fjlabs.h"
+#include "macros.h"
+#include "host.h"
+
+/* FJ_MACRO_BATCH: runs of ascending keycodes share a report. The fake host
+ * types the keys of a report in array order. */
+
+static uint8_t  macro_buffer[256];
+static uint16_t macro_length;
+static uint8_t  macro_count;
+
+uint8_t dynamic_keymap_macro_get_count(void) {
+    return 16;
+}
+
+uint16_t dynamic_keymap_macro_get_buffer_size(void) {
+    return sizeof(macro_buffer);
+}
+
+void dynamic_keymap_macro_get_buffer(uint16_t offset, uint16_t size, uint8_t *data) {
+    for (uint16_t i = 0; i < size; i++) {
+        data[i] = offset + i < sizeof(macro_buffer) ? macro_buffer[offset + i] : 0;
+    }
+}
+
+static uint16_t add_text(const char *text) {
+    memcpy(macro_buffer + macro_length, text, strlen(text));
+    macro_length += strlen(text) + 1;
+    return QK_MACRO + macro_count++;
+}
+
+static void play(uint16_t keycode) {
+    keyrecord_t record = {.event = MAKE_KEYEVENT(0, 0, true)};
+    host_text_clear();
+    HOST_CHECK(!macros_process_record(keycode, &record));
+}
+
+int main(void) {
+    host_init();
+    uint16_t ascending = add_text("abc");
+    uint16_t again     = add_text("cab");
+    uint16_t overlap   = add_text("abca");
+    uint16_t mods      = add_text("abCD");
+    uint16_t long_run  = add_text("abcdefghij");
+
+    play(ascending);
+    HOST_EXPECT_REPORTS("00:04,05,06 00:");
+    play(again);
+    HOST_EXPECT_REPORTS("00:06 00:04,05 00:");
+    // A key still down from the last report is released on its own first.
+    play(overlap);
+    HOST_EXPECT_REPORTS("00:04,05,06 00: 00:04 00:");
+    HOST_EXPECT_STR(host_text(), "abca");
+    play(mods);
+    HOST_EXPECT_REPORTS("00:04,05 02: 02:06,07 00:");
+    HOST_EXPECT_STR(host_text(), "abCD");
+
+    // Six keys per report without NKRO, FJ_MACRO_BATCH with it.
+    keymap_config.nkro = false;
+    play(long_run);
+    HOST_EXPECT_REPORTS("00:04,05,06,07,08,09 00:0A,0B,0C,0D 00:");
+    keymap_config.nkro = true;
+    play(long_run);
+    HOST_EXPECT_REPORTS("00:04,05,06,07,08,09,0A,0B 00:0C,0D 00:");
+    HOST_EXPECT_STR(host_text(), "abcdefghij");
+    return 0;
+}
@@ -0,0 +1,134 @@
+// build: mouse.c -DFJ_MOUSE_ENABLE
+
+#include <math.h>
+#include <stdlib.h>
+#include "fjlabs.h"
+#include "mouse.h"
+#include "host.h"
+
+/* mouse_task runs every millisecond, as housekeeping does. */
+
+static void key(uint16_t keycode, bool pressed) {
+    keyrecord_t record = {.event = MAKE_KEYEVENT(0, 0, pressed)};
+    HOST_CHECK(!mouse_process_record(keycode, &record));
+}
+
+// Runs ms milliseconds and returns the largest move in one report.
+static int run(uint16_t ms) {
+    int largest = 0;
+    for (uint16_t t = 0; t < ms; t++) {
+        uint32_t count = host_mouse_count;
+        mouse_task();
+        if (host_mouse_count != count && abs(host_mouse_report.x) + abs(host_mouse_report.y) > largest) {
+            largest = abs(host_mouse_report.x) + abs(host_mouse_report.y);
+        }
+        host_time++;
+    }
+    return largest;
+}
+
+static void reset(void) {
+    host_mouse_count = 0;
+    host_mouse_x     = 0;
+    host_mouse_y     = 0;
+}
+
+static void test_taps(void) {
+    reset();
+    for (uint8_t i = 0; i < 5; i++) {
+        key(QK_MOUSE_CURSOR_LEFT, true);
+        run(3);
+        key(QK_MOUSE_CURSOR_LEFT, false);
+        run(50);
+    }
+    HOST_CHECK(host_mouse_x == -5 && host_mouse_y == 0);
+
+    // A tap released before the next report still moves, and only once.
+    reset();
+    key(QK_MOUSE_CURSOR_DOWN, true);
+    key(QK_MOUSE_CURSOR_DOWN, false);
+    HOST_CHECK(host_mouse_count == 1 && host_mouse_x == 0 && host_mouse_y == 1);
+    run(50);
+    HOST_CHECK(host_mouse_count == 1);
+
+    reset();
+    key(QK_MOUSE_WHEEL_UP, true);
+    key(QK_MOUSE_WHEEL_UP, false);
+    HOST_CHECK(host_mouse_count == 1 && host_mouse_report.v == 1);
+    run(50);
+    HOST_CHECK(host_mouse_count == 1);
+}
+
+static void test_hold(void) {
+    reset();
+    key(QK_MOUSE_CURSOR_RIGHT, true);
+    int largest = run(1000);
+    key(QK_MOUSE_CURSOR_RIGHT, false);
+    // At most one report every FJ_MOUSE_INTERVAL ms, all but the slowest
+    // start of the ramp moving a pixel or more, and none of them a jump.
+    HOST_CHECK(host_mouse_count <= 1000 / 2 && host_mouse_count >= 1000 / 2 * 9 / 10);
+    HOST_CHECK(largest <= 4);
+    // 1 px for the press, 430 px up the ramp, 800 px at full speed.
+    HOST_CHECK(abs(host_mouse_x - 1231) < 1231 / 100);
+
+    // Nothing is sent once the key is up.
+    uint32_t count = host_mouse_count;
+    run(100);
+    HOST_CHECK(host_mouse_count == count);
+}
+
+static void test_diagonal(void) {
+    reset();
+    key(QK_MOUSE_CURSOR_RIGHT, true);
+    key(QK_MOUSE_CURSOR_DOWN, true);
+    run(1000);
+    key(QK_MOUSE_CURSOR_RIGHT, false);
+    key(QK_MOUSE_CURSOR_DOWN, false);
+    HOST_CHECK(host_mouse_x == host_mouse_y);
+    HOST_CHECK(fabs(hypot(host_mouse_x, host_mouse_y) - 1231) < 1231 / 100);
+}
+
+static void test_acceleration(void) {
+    reset();
+    key(QK_MOUSE_ACCELERATION_2, true);
+    key(QK_MOUSE_CURSOR_UP, true);
+    run(100);
+    key(QK_MOUSE_CURSOR_UP, false);
+    key(QK_MOUSE_ACCELERATION_2, false);
+    // Full speed from the first report: 1.6 px per ms, less half of the first step.
+    HOST_CHECK(-host_mouse_y >= 150 && -host_mouse_y <= 1 + 160);
+
+    reset();
+    key(QK_MOUSE_ACCELERATION_0, true);
+    key(QK_MOUSE_CURSOR_UP, true);
+    run(1000);
+    key(QK_MOUSE_CURSOR_UP, false);
+    key(QK_MOUSE_ACCELERATION_0, false);
+    // A quarter of full speed at most.
+    HOST_CHECK(host_mouse_y < 0 && -host_mouse_y <= 1 + 400);
+}
+
+static void test_buttons(void) {
+    reset();
+    key(QK_MOUSE_BUTTON_1, true);
+    HOST_CHECK(host_mouse_count == 1 && host_mouse_report.buttons == 1);
+    key(QK_MOUSE_BUTTON_1 + 2, true);
+    HOST_CHECK(host_mouse_count == 2 && host_mouse_report.buttons == 5);
+    key(QK_MOUSE_BUTTON_1, false);
+    key(QK_MOUSE_BUTTON_1 + 2, false);
+    HOST_CHECK(host_mouse_count == 4 && host_mouse_report.buttons == 0);
+    run(100);
+    HOST_CHECK(host_mouse_count == 4);
+    HOST_CHECK(host_mouse_x == 0 && host_mouse_y == 0);
+}
+
+int main(void) {
+    host_init();
+    host_time = 1000;
+    test_taps();
+    test_hold();
+    test_diagonal();
+    test_acceleration();
+    test_buttons();
+    return 0;
+}
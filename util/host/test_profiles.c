@@ -0,0 +1,121 @@
+// build: keymap_store.c -DFJ_PROFILE_ENABLE -DFJ_KEYMAP_STORE_ENABLE
+
+#include "fjlabs.h"
+#include "keymap_store.h"
+#include "via.h"
+#include "host.h"
+
+/* Two banks of four layers in the dynamic keymap. The compiled keymap has
+ * KC_A + column on layer 0 and KC_1 + column on layer 1. */
+
+#define KC_D (KC_A + 3)
+#define KC_4 (KC_1 + 3)
+#define KC_X 0x1B
+#define KC_Y 0x1C
+#define KC_Z 0x1D
+
+uint8_t keymap_layer_count_raw(void) {
+    return 2;
+}
+
+uint16_t keycode_at_keymap_location_raw(uint8_t layer, uint8_t row, uint8_t column) {
+    return layer == 0 ? KC_A + column : layer == 1 ? KC_1 + column : KC_TRNS;
+}
+
+static bool press(uint16_t keycode, bool pressed) {
+    keyrecord_t record = {.event = MAKE_KEYEVENT(0, 0, pressed)};
+    return keymap_store_process_record(keycode, &record);
+}
+
+static uint8_t custom_value(uint8_t command, uint8_t value_id, uint8_t value) {
+    uint8_t data[32] = {command, id_custom_channel, value_id, value};
+    HOST_CHECK(keymap_store_via_custom_value(data, sizeof(data)));
+    return data[3];
+}
+
+static void test_seeded(void) {
+    // A reset leaves the banks to be seeded by the next init.
+    keymap_store_reset();
+    keymap_store_init();
+    HOST_CHECK(keymap_store_get_profile() == 0);
+    HOST_CHECK(keymap_store_layer_count() == FJ_PROFILE_LAYERS);
+    for (uint8_t profile = 0; profile < FJ_PROFILE_COUNT; profile++) {
+        HOST_CHECK(host_dynamic_keymap[profile * FJ_PROFILE_LAYERS][0][3] == KC_D);
+        HOST_CHECK(host_dynamic_keymap[profile * FJ_PROFILE_LAYERS + 1][0][3] == KC_4);
+    }
+    HOST_CHECK(keymap_store_get_keycode(FJ_PROFILE_LAYERS, 0, 0) == KC_NO);
+}
+
+static void test_switch(void) {
+    keymap_store_set_keycode(1, 0, 3, KC_X);
+    HOST_CHECK(host_dynamic_keymap[1][0][3] == KC_X);
+
+    // Held keys and layers were looked up in the old bank and are let go.
+    register_code(KC_D);
+    layer_state = 2;
+    HOST_CHECK(!press(FJ_PROFILE_NEXT, true));
+    HOST_EXPECT_REPORTS("00:07 00:");
+    HOST_CHECK(layer_state == 0);
+    HOST_CHECK(keymap_store_get_profile() == 1);
+    HOST_CHECK(keymap_store_get_keycode(1, 0, 3) == KC_4);
+    HOST_CHECK(keymap_key_to_keycode(0, (keypos_t){.row = 0, .col = 3}) == KC_D);
+    keymap_store_set_keycode(0, 0, 3, KC_Y);
+    HOST_CHECK(host_dynamic_keymap[FJ_PROFILE_LAYERS][0][3] == KC_Y);
+
+    // Only presses switch, and switching to the active bank does nothing.
+    HOST_CHECK(!press(FJ_PROFILE_NEXT, false));
+    HOST_CHECK(!press(FJ_PROFILE_0 + 1, true));
+    HOST_EXPECT_REPORTS("");
+    HOST_CHECK(keymap_store_get_profile() == 1);
+    HOST_CHECK(press(KC_A, true));
+
+    // Kept across a restart.
+    keymap_store_init();
+    HOST_CHECK(keymap_store_get_profile() == 1);
+    HOST_CHECK(keymap_store_get_keycode(0, 0, 3) == KC_Y);
+
+    HOST_CHECK(!press(FJ_PROFILE_NEXT, true));
+    HOST_CHECK(keymap_store_get_profile() == 0);
+    HOST_CHECK(keymap_store_get_keycode(1, 0, 3) == KC_X);
+    HOST_CHECK(!press(FJ_PROFILE_MAX, true));
+    HOST_CHECK(keymap_store_get_profile() == 0);
+    host_reports();
+}
+
+static void test_via(void) {
+    HOST_CHECK(custom_value(id_custom_get_value, id_fj_profile_count, 0) == FJ_PROFILE_COUNT);
+    custom_value(id_custom_set_value, id_fj_profile, 1);
+    HOST_CHECK(custom_value(id_custom_get_value, id_fj_profile, 0) == 1);
+    custom_value(id_custom_set_value, id_fj_profile, FJ_PROFILE_COUNT);
+    HOST_CHECK(keymap_store_get_profile() == 1);
+    uint8_t data[32] = {id_custom_get_value, id_custom_channel, id_fj_combo};
+    HOST_CHECK(!keymap_store_via_custom_value(data, sizeof(data)));
+
+    // The dynamic keymap commands see the active bank.
+    uint8_t command[32] = {id_dynamic_keymap_get_layer_count};
+    HOST_CHECK(keymap_store_via_command(command, sizeof(command)));
+    HOST_CHECK(command[1] == FJ_PROFILE_LAYERS);
+    uint8_t set[32] = {id_dynamic_keymap_set_keycode, 2, 0, 5, 0, KC_Z};
+    HOST_CHECK(keymap_store_via_command(set, sizeof(set)));
+    HOST_CHECK(host_dynamic_keymap[FJ_PROFILE_LAYERS + 2][0][5] == KC_Z);
+    uint8_t get[32] = {id_dynamic_keymap_get_keycode, 0, 0, 3};
+    HOST_CHECK(keymap_store_via_command(get, sizeof(get)));
+    HOST_CHECK(get[4] == 0 && get[5] == KC_Y);
+
+    // A reset of the whole EEPROM goes back to the first bank, seeded again.
+    uint8_t reset[32] = {id_eeprom_reset};
+    HOST_CHECK(keymap_store_via_command(reset, sizeof(reset)));
+    HOST_CHECK(keymap_store_get_profile() == 0);
+    HOST_CHECK(keymap_store_get_keycode(1, 0, 3) == KC_4);
+    HOST_CHECK(host_dynamic_keymap[FJ_PROFILE_LAYERS][0][3] == KC_D);
+    HOST_CHECK(host_dynamic_keymap[FJ_PROFILE_LAYERS + 2][0][5] == KC_TRNS);
+    host_reports();
+}
+
+int main(void) {
+    host_init();
+    test_seeded();
+    test_switch();
+    test_via();
+    return 0;
+}
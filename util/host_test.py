@@ -0,0 +1,120 @@
+#!/usr/bin/env python3
+"""Builds the userspace modules on the host and runs the tests in util/host/.
+
+Each util/host/test_*.c (or bench_*.c with --bench) is one program. Its
+`// build:` line names the users/fjlabs sources it links and any -D flags,
+e.g. `// build: combos.c -DFJ_COMBO_ENABLE`; with several, it is built and
+run once for each, to cover configurations. It is compiled with
+the host C compiler against the qmk_firmware stand-ins in util/host/include/
+and the fake keyboard in util/host/qmk.c, with users/fjlabs/config.h forced
+in as QMK does. `// setup:` lines are shell commands run first, in the
+scratch directory the program then runs in, with $USERSPACE set to the
+repository. A test passes when it exits with 0; the exit status is 1 if
+any test fails to build or run. Benchmarks print their numbers and are not
+checked. No qmk_firmware checkout is needed.
+
+    util/host_test.py                    # every test, also `make test`
+    util/host_test.py combos macros      # test_combos.c and test_macros.c
+    util/host_test.py --bench mouse      # bench_mouse.c
+"""
+import argparse
+import os
+import shlex
+import subprocess
+import sys
+import tempfile
+from pathlib import Path
+
+USERSPACE = Path(__file__).resolve().parent.parent
+HOST = USERSPACE / 'util' / 'host'
+SOURCES = USERSPACE / 'users' / 'fjlabs'
+
+CFLAGS = ['-std=gnu11', '-O2', '-Wall', '-Wextra', '-Wno-unused-parameter', '-Werror']
+
+
+def header(path, key):
+    """Returns the text after `// key:` on each such line of the file."""
+    prefix = f'// {key}:'
+    return [line[len(prefix):].strip() for line in path.read_text(encoding='utf-8').splitlines() if line.startswith(prefix)]
+
+
+def build(path, line, output, cc, userspace=SOURCES):
+    words = shlex.split(line)
+    sources, flags = [userspace / word for word in words if not word.startswith('-')], [word for word in words if word.startswith('-')]
+    command = [*cc, *CFLAGS, f'-I{HOST / "include"}', f'-I{HOST}', f'-I{userspace}', '-DQMK_KEYBOARD_H="qmk.h"', '-DVIA_ENABLE', '-include', str(userspace / 'config.h'), *flags, str(path), str(HOST / 'qmk.c'), *map(str, sources), '-lm', '-o', str(output)]
+    return command, subprocess.run(command, capture_output=True, text=True)
+
+
+def prepare(path, line, scratch, cc, userspace=SOURCES, verbose=False):
+    """Builds one configuration of a program into scratch and runs its setup lines there. Returns (program, failed result or None).
+    """
+    output = Path(scratch) / path.stem
+    command, result = build(path, line, output, cc, userspace)
+    if verbose:
+        print(shlex.join(command))
+    env = {**os.environ, 'USERSPACE': str(USERSPACE)}
+    for setup in header(path, 'setup'):
+        if result.returncode != 0:
+            break
+        if verbose:
+            print(setup)
+        result = subprocess.run(setup, shell=True, cwd=scratch, env=env, capture_output=True, text=True)
+    return output, result if result.returncode != 0 else None
+
+
+def configurations(programs, prefix):
+    """Returns (path, build line, name) for every configuration of the programs.
+    """
+    runs = []
+    for path in programs:
+        lines = header(path, 'build') or ['']
+        for line in lines:
+            runs.append((path, line, path.stem[len(prefix):] + (f' [{line}]' if len(lines) > 1 else '')))
+    return runs
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('names', nargs='*', help='tests to run, by name without the test_ prefix (default: all)')
+    parser.add_argument('--bench', action='store_true', help='run the benchmarks instead of the tests')
+    parser.add_argument('-v', '--verbose', action='store_true', help='print the compiler command lines')
+    args = parser.parse_args()
+
+    prefix = 'bench_' if args.bench else 'test_'
+    programs = sorted(HOST.glob(f'{prefix}*.c'))
+    if args.names:
+        wanted = {f'{prefix}{name}.c' for name in args.names}
+        missing = wanted - {path.name for path in programs}
+        if missing:
+            parser.error(f'no such {"benchmark" if args.bench else "test"}: {", ".join(sorted(missing))}')
+        programs = [path for path in programs if path.name in wanted]
+
+    cc = shlex.split(os.environ.get('CC', 'cc'))
+    failed = []
+    runs = configurations(programs, prefix)
+    for path, line, name in runs:
+        with tempfile.TemporaryDirectory() as scratch:
+            output, result = prepare(path, line, scratch, cc, verbose=args.verbose)
+            if result is not None:
+                print(f'{name}: BUILD FAILED\n{result.stdout}{result.stderr}', end='')
+                failed.append(name)
+                continue
+            if args.bench:
+                print(f'{name}:', flush=True)
+                failed += [name] if subprocess.run([str(output)], cwd=scratch).returncode != 0 else []
+                continue
+            result = subprocess.run([str(output)], cwd=scratch, capture_output=True, text=True)
+            if result.returncode != 0:
+                print(f'{name}: FAILED\n{result.stdout}{result.stderr}', end='')
+                failed.append(name)
+            else:
+                print(f'{name}: ok')
+
+    if failed:
+        print(f'{len(failed)} of {len(runs)} failed: {", ".join(failed)}')
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
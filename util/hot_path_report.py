@@ -0,0 +1,59 @@
+#!/usr/bin/env python3
+"""Reports what building the userspace hot paths for speed costs in flash, per board.
+
+Every keymap is built twice, as is and with FJ_HOT_PATH_OPT=yes, which
+compiles the functions marked FJ_HOT in users/ at -O2 while the rest of
+the firmware stays at -Os. The total flash and the size of each hot
+function that made it into the build are compared.
+
+    util/hot_path_report.py                  # every via keymap
+    util/hot_path_report.py -kb fjlabs/kf87  # one board
+"""
+import argparse
+import re
+import sys
+
+import qmk_tree
+
+
+def hot_functions():
+    """Returns the names of the functions marked FJ_HOT in the userspace sources.
+    """
+    names = set()
+    for source in sorted((qmk_tree.USERSPACE / 'users').glob('*/*.c')):
+        text = qmk_tree.strip_comments(source.read_text(encoding='utf-8'))
+        names.update(re.findall(r'^(?:(?:static|inline)\s+)*FJ_HOT\s+[\w\s\*]+?\b(\w+)\s*\(', text, flags=re.M))
+    return sorted(names)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('-kb', '--keyboard', action='append', help='only build these keyboards')
+    parser.add_argument('-km', '--keymap', default='via')
+    args = parser.parse_args()
+
+    hot = hot_functions()
+    status = 0
+    for keyboard, _ in qmk_tree.keymaps(args.keymap):
+        if args.keyboard and keyboard not in args.keyboard:
+            continue
+        try:
+            size_elf = qmk_tree.compile(keyboard, args.keymap)
+            size_flash, size_functions = qmk_tree.flash_size(size_elf), qmk_tree.function_sizes(size_elf)
+            speed_elf = qmk_tree.compile(keyboard, args.keymap, {'FJ_HOT_PATH_OPT': 'yes'})
+            speed_flash, speed_functions = qmk_tree.flash_size(speed_elf), qmk_tree.function_sizes(speed_elf)
+        except (RuntimeError, ValueError, FileNotFoundError) as e:
+            print(f'{keyboard}: {e}', file=sys.stderr)
+            status = 1
+            continue
+
+        print(f'{keyboard}: flash {size_flash} -> {speed_flash} bytes ({speed_flash - size_flash:+d})')
+        for name in hot:
+            if name in size_functions or name in speed_functions:
+                before, after = size_functions.get(name, 0), speed_functions.get(name, 0)
+                print(f'  {name:<32} {before:>5} -> {after:>5} ({after - before:+d})')
+    return status
+
+
+if __name__ == '__main__':
+    sys.exit(main())
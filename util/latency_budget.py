@@ -0,0 +1,94 @@
+#!/usr/bin/env python3
+"""Builds a per-board worst-case latency budget from FJ_LATENCY_ENABLE console logs.
+
+Boards built with FJ_LATENCY_ENABLE print a `latency:` line whenever a stage
+of the main loop goes over its bound, and the full table when
+FJ_LATENCY_REPORT is pressed. Capture `qmk console` while driving the board
+with the worst input you have (the traces in util/traces/, long VIA macros,
+lighting keys, a VIA keymap upload), press FJ_LATENCY_REPORT, and feed the
+log here. The worst value per stage is kept for every board; the exit status
+is 1 if any stage is over its bound, so the check can gate a release.
+
+    qmk console | tee kf87.log                     # then type, and press FJ_LATENCY_REPORT
+    util/latency_budget.py kf87.log tf60.log
+    util/latency_budget.py --bound key=500 *.log   # tighter bound than the firmware's
+"""
+import argparse
+import re
+import sys
+from pathlib import Path
+
+STAGES = ('scan', 'gesc', 'layer', 'lighting', 'macro', 'key', 'via', 'loop')
+
+ANSI = re.compile(r'\x1b\[[0-9;]*m')
+# qmk console prefixes every line with manufacturer:product:index.
+LINE = re.compile(r'^(?:(?P<device>.*?):\d+: )?latency: (?P<stage>\w+)\s+(?P<worst>\d+) us, bound\s+(?P<bound>\d+) us')
+RESOLUTION = re.compile(r'^(?:(?P<device>.*?):\d+: )?latency: resolution (?P<us>\d+) us')
+
+
+def parse(lines, default):
+    """Returns {board: {'stages': {stage: [worst, bound]}, 'resolution': us}} from console lines.
+    """
+    boards = {}
+    for line in lines:
+        line = ANSI.sub('', line).strip()
+        match = LINE.match(line)
+        if match:
+            board = boards.setdefault(match['device'] or default, {'stages': {}, 'resolution': None})
+            worst, bound = int(match['worst']), int(match['bound'])
+            seen = board['stages'].setdefault(match['stage'], [0, bound])
+            seen[0] = max(seen[0], worst)
+            seen[1] = bound
+            continue
+        match = RESOLUTION.match(line)
+        if match:
+            board = boards.setdefault(match['device'] or default, {'stages': {}, 'resolution': None})
+            board['resolution'] = int(match['us'])
+    return boards
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('logs', nargs='*', type=Path, help='console logs (default: stdin)')
+    parser.add_argument('--bound', action='append', default=[], metavar='STAGE=US', help='override the firmware\'s bound for a stage, in microseconds')
+    args = parser.parse_args()
+
+    bounds = {}
+    for item in args.bound:
+        stage, _, value = item.partition('=')
+        if stage not in STAGES or not value.isdigit():
+            parser.error(f'--bound {item}: expected one of {", ".join(STAGES)}=<microseconds>')
+        bounds[stage] = int(value)
+
+    boards = {}
+    sources = [(path.stem, path.read_text(encoding='utf-8', errors='replace').splitlines()) for path in args.logs] or [('stdin', sys.stdin)]
+    for default, lines in sources:
+        for name, board in parse(lines, default).items():
+            merged = boards.setdefault(name, {'stages': {}, 'resolution': None})
+            merged['resolution'] = board['resolution'] or merged['resolution']
+            for stage, (worst, bound) in board['stages'].items():
+                seen = merged['stages'].setdefault(stage, [0, bound])
+                seen[0] = max(seen[0], worst)
+
+    if not boards:
+        print('no latency lines found, is FJ_LATENCY_ENABLE on?', file=sys.stderr)
+        return 2
+
+    status = 0
+    for name in sorted(boards):
+        board = boards[name]
+        resolution = f', {board["resolution"]} us resolution' if board['resolution'] else ''
+        print(f'{name}{resolution}')
+        for stage in STAGES:
+            if stage not in board['stages']:
+                continue
+            worst, bound = board['stages'][stage]
+            bound = bounds.get(stage, bound)
+            over = worst > bound
+            status |= over
+            print(f'  {stage:<9} {worst:>8} us of {bound:>8} us  {"OVER" if over else f"{bound - worst:>8} us spare"}')
+    return status
+
+
+if __name__ == '__main__':
+    sys.exit(main())
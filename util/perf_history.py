@@ -0,0 +1,493 @@
+#!/usr/bin/env python3
+"""Tracks the speed of the userspace C code across git commits and flags regressions.
+
+Each commit's keyboards/ and users/ are checked out into a scratch
+directory. The benchmarks in util/host/ (always the working tree's, so
+every commit runs the same programs) are built with the host C compiler
+against that commit's users/fjlabs, as util/host_test.py --bench does, and
+each is run --samples times. Every "<n> ns" figure they print is recorded:
+time per key event in the combo engine and the text expander, per keycode
+lookup in the keymap store, per profile switch, per mouse_task call, for
+the C code of that commit. The times follow the host's clock and load,
+so only entries measured on the same idle host are comparable, best in
+one run.
+
+Every keymap is also loaded into fleet_sim's model of the board, one
+worker per core, which replays the trace corpus in util/traces/, and per
+board it records:
+
+* model latency: for every key press while the bus is up, the model time
+  from the press to the first report it sends, so a keymap or rules.mk
+  change that makes a key wait on a tap-hold decision shows up. It is
+  model time, so it does not depend on the host, and it only follows the
+  keymaps and their flags, never the C code;
+* via: the full speed bus time of the commands VIA sends when it opens the
+  board and edits it, one command at a time like the VIA app, from the
+  emulator in via_hid.py sized to the commit's keymap.
+
+Results go to a local history file, one JSON line per commit and
+qmk_firmware revision, and a commit already measured at that revision is
+not measured again. Then every commit is compared with the one before it,
+and with --qmk the last commit at each revision with the previous one.
+Benchmark times and model latency only count as regressions when a
+one-sided Mann-Whitney U test puts them below --alpha and the median or
+mean moved by more than --tolerance. VIA bus times are exact and are
+flagged whenever they grow by more than --tolerance. A checkout that is
+not a git repository has no revision to key the history on and is
+measured every time.
+
+    util/perf_history.py HEAD~10..HEAD                    # each commit touching keyboards/ or users/, and HEAD~10
+    util/perf_history.py HEAD --qmk 0.26.0 develop        # one commit against two qmk_firmware revisions
+    util/perf_history.py --report 1a2b3c4 HEAD            # compare two recorded commits without measuring
+"""
+import argparse
+import hashlib
+import io
+import json
+import math
+import multiprocessing
+import os
+import platform
+import re
+import shlex
+import statistics
+import subprocess
+import sys
+import tarfile
+import tempfile
+import time
+from pathlib import Path
+
+import fleet_sim
+import host_test
+import qmk_tree
+import via_hid
+
+HISTORY = qmk_tree.USERSPACE / '.perf_history.jsonl'
+TREE = ('keyboards', 'users')
+PERCENTILES = (50, 90, 99)
+BENCH_NS = re.compile(r'(\d+(?:\.\d+)?) ns\b')
+
+
+class TimedBoard(fleet_sim.Board):
+    """fleet_sim's board model that also times each key press to the first report it sends.
+    """
+    def reset(self):
+        super().reset()
+        self.pressed_at = {}  # pos -> time of a press that has not reported yet
+        self.latencies = []
+
+    def feed(self, stamp, pos, pressed):
+        if pressed and self.usb == 'configured':
+            self.pressed_at[pos] = stamp
+        self.event(stamp, pos, pressed)
+
+    def suspend(self, stamp):
+        super().suspend(stamp)
+        self.pressed_at.clear()
+
+    def _reported(self, pos, before):
+        # Presses that send nothing (layer keys) keep no time.
+        if pos in self.pressed_at and len(self.output) > before:
+            self.latencies.append(int(self.output[before].split(' ', 1)[0]) - self.pressed_at.pop(pos))
+
+    def _press(self, pos, keycode):
+        before = len(self.output)
+        super()._press(pos, keycode)
+        self._reported(pos, before)
+
+    def _decide(self, hold, stamp):
+        pos, keycode, _ = self.pending
+        before = len(self.output)
+        super()._decide(hold, stamp)
+        # A held layer-tap sends nothing itself, the first report is a buffered key's.
+        if not (hold and self.ranges.kind(keycode) == 'QK_LAYER_TAP'):
+            self._reported(pos, before)
+
+
+def _git(*args, cwd=qmk_tree.USERSPACE):
+    result = subprocess.run(['git', *args], cwd=cwd, capture_output=True, text=True)
+    if result.returncode:
+        raise RuntimeError(f'git {" ".join(args)}: {result.stderr.strip()}')
+    return result.stdout.strip()
+
+
+def commits(revisions):
+    """Returns the full hashes to measure, oldest first: the start and every commit touching keyboards/ or users/ of a range.
+    """
+    found = []
+    for revision in revisions:
+        if '..' in revision:
+            start = revision.split('..', 1)[0]
+            if start:
+                found.append(_git('rev-parse', '--verify', f'{start}^{{commit}}'))
+            found += _git('rev-list', '--reverse', revision, '--', *TREE).split()
+        else:
+            found.append(_git('rev-parse', '--verify', f'{revision}^{{commit}}'))
+    return list(dict.fromkeys(found))
+
+
+def checkout(commit, into):
+    """Extracts the commit's keyboards/ and users/ into `into`.
+    """
+    data = subprocess.run(['git', 'archive', '--format=tar', commit, *TREE], cwd=qmk_tree.USERSPACE, capture_output=True, check=True).stdout
+    with tarfile.open(fileobj=io.BytesIO(data)) as archive:
+        if hasattr(tarfile, 'data_filter'):
+            archive.extractall(into, filter='data')
+        else:
+            archive.extractall(into)
+
+
+def qmk_revision(home):
+    try:
+        return _git('rev-parse', 'HEAD', cwd=home)
+    except (RuntimeError, FileNotFoundError):
+        return None
+
+
+def corpus_hash(traces):
+    """Hashes the inputs every commit shares: the traces and the benchmark programs with their fake keyboard.
+    """
+    digest = hashlib.sha1()
+    for path in [*map(Path, traces), *sorted(host_test.HOST.rglob('*')), Path(host_test.__file__)]:
+        if path.is_file():
+            digest.update(path.name.encode() + b'\0' + path.read_bytes())
+    return digest.hexdigest()[:12]
+
+
+def bench_metrics(text):
+    """Yields (name, ns) for each line of benchmark output with a time in it.
+    """
+    for line in text.splitlines():
+        match = BENCH_NS.search(line)
+        if match:
+            # Named by what comes before the figure, or by what it is per.
+            name = line[:match.start()].strip(' :') or line[match.end():].split(',')[0].strip()
+            yield ' '.join(name.split()), float(match.group(1))
+
+
+def run_benchmarks(tree, samples):
+    """Builds the working tree's benchmarks against tree/users/fjlabs and runs each `samples` times. Returns ({metric: [ns]}, [configurations that failed]).
+    """
+    cc = shlex.split(os.environ.get('CC', 'cc'))
+    metrics, failed = {}, []
+    for path, line, name in host_test.configurations(sorted(host_test.HOST.glob('bench_*.c')), 'bench_'):
+        with tempfile.TemporaryDirectory(prefix='perf_history_bench_') as scratch:
+            # A commit from before a module or its benchmark existed fails to build.
+            program, result = host_test.prepare(path, line, scratch, cc, tree / 'users' / 'fjlabs')
+            for _ in range(samples if result is None else 0):
+                result = subprocess.run([str(program)], cwd=scratch, capture_output=True, text=True)
+                if result.returncode != 0:
+                    break
+                for metric, ns in bench_metrics(result.stdout):
+                    metrics.setdefault(f'{name}: {metric}', []).append(ns)
+                result = None
+            if result is not None:
+                failed.append(name)
+    return metrics, failed
+
+
+def via_costs(info, layers):
+    """Returns {operation: emulated ms} for what VIA sends to open and edit a board of that size.
+    """
+    rows, cols = info['matrix_size']['rows'], info['matrix_size']['cols']
+    device = via_hid.Emulator([[0] * (rows * cols) for _ in range(layers)], cols=cols, pipeline=0)
+    size = layers * rows * cols * 2
+    operations = {
+        'connect': lambda: (device.protocol_version(), device.layer_count(), device.macro_count(), device.macro_buffer_size()),
+        'get_keymap': lambda: device.get_buffer(0, size),
+        'set_key': lambda: device.command(via_hid.ID_DYNAMIC_KEYMAP_SET_KEYCODE, 0, 0, 0, 0, 4),
+        'set_keymap': lambda: device.set_buffer(0, bytes(size)),
+        'get_macros': lambda: device.get_macro_buffer(0, device.macro_buffer_size()),
+    }
+    costs = {}
+    for name, operation in operations.items():
+        start = device.clock
+        operation()
+        costs[name] = round((device.clock - start) * 1000, 3)
+    return costs
+
+
+_worker = {}
+
+
+def _init_worker(home, tree):
+    _worker['home'] = home
+    _worker['keycodes'] = qmk_tree.KeycodeTable(home, extra=sorted((tree / 'users').glob('*/*.h')))
+
+
+def _replay(board, traces):
+    """Replays the traces once. Returns the press latencies in model time.
+    """
+    latencies = []
+    for events in traces:
+        board.reset()
+        for stamp, action, keycode in events:
+            if action == 'set':
+                board.remap(*keycode)
+                continue
+            if action == 'expect':
+                continue
+            if keycode is None:
+                getattr(board, action)(stamp)
+                continue
+            pos = board.base.get(keycode)
+            if pos is not None:
+                board.feed(stamp, pos, action == 'down')
+        board.finish()
+        latencies += board.latencies
+    return latencies
+
+
+def measure_board(job):
+    """Worker: replays the corpus on one board's model. Returns (keyboard, result dict).
+    """
+    keyboard, keymap_c, traces = job
+    keycodes = _worker['keycodes']
+    try:
+        keymap_c = Path(keymap_c)
+        board = fleet_sim.load_board(keyboard, keymap_c, _worker['home'], keycodes, cls=TimedBoard)
+        traces = [fleet_sim.load_trace(Path(trace), keycodes) for trace in traces]
+        info = qmk_tree.keyboard_info(keyboard, _worker['home'])
+        histogram = {}
+        for latency in _replay(board, traces):
+            histogram[str(latency)] = histogram.get(str(latency), 0) + 1
+        return keyboard, {'latency': histogram, 'via': via_costs(info, qmk_tree.via_layer_count(keymap_c, info, len(board.layers)))}
+    except (FileNotFoundError, ValueError, KeyError) as e:
+        return keyboard, {'error': str(e)}
+
+
+def measure(commit, home, traces, samples, jobs, keymap):
+    """Measures one commit: its C code on the host, and every board's model against the qmk_firmware at `home`.
+
+    Returns ({metric: [ns]}, [benchmarks that failed], {keyboard: result}).
+    """
+    with tempfile.TemporaryDirectory(prefix='perf_history_') as scratch:
+        tree = Path(scratch)
+        checkout(commit, tree)
+        # One at a time and before the workers start, so nothing else competes for the core.
+        benches, failed = run_benchmarks(tree, samples)
+        work = [(keyboard, str(keymap_c), traces) for keyboard, keymap_c in qmk_tree.keymaps(keymap, tree)]
+        with multiprocessing.Pool(min(jobs, len(work)) or 1, _init_worker, (home, tree)) as pool:
+            return benches, failed, dict(pool.map(measure_board, work))
+
+
+def load_history(path):
+    history = []
+    if path.exists():
+        for line in path.read_text(encoding='utf-8').splitlines():
+            if line.strip():
+                history.append(json.loads(line))
+    return history
+
+
+def find(history, commit, qmk, corpus):
+    """Returns the latest entry for the commit (a hash prefix) at that qmk revision (None for any) and corpus.
+    """
+    for entry in reversed(history):
+        if entry['commit'].startswith(commit) and (qmk is None or entry['qmk'] == qmk) and entry['corpus'] == corpus:
+            return entry
+    return None
+
+
+def mann_whitney(before, after):
+    """Returns the one-sided p-value of `after` tending to be larger than `before`, by the normal approximation.
+    """
+    n1, n2 = len(before), len(after)
+    if not n1 or not n2:
+        return 1.0
+    ranked = sorted([(value, 0) for value in before] + [(value, 1) for value in after])
+    rank_sum, ties, i = 0.0, 0, 0
+    while i < len(ranked):
+        j = i
+        while j < len(ranked) and ranked[j][0] == ranked[i][0]:
+            j += 1
+        # Tied values share the mean of their ranks.
+        rank = (i + j + 1) / 2
+        rank_sum += rank * sum(1 for k in range(i, j) if ranked[k][1])
+        ties += (j - i) ** 3 - (j - i)
+        i = j
+    n = n1 + n2
+    u = rank_sum - n2 * (n2 + 1) / 2
+    variance = n1 * n2 / 12 * ((n + 1) - ties / (n * (n - 1)))
+    if variance <= 0:
+        return 1.0
+    z = (u - n1 * n2 / 2 - 0.5) / math.sqrt(variance)
+    return 1 - statistics.NormalDist().cdf(z)
+
+
+def _expand(histogram):
+    return [int(value) for value, count in histogram.items() for _ in range(count)]
+
+
+def percentile(values, p):
+    if not values:
+        return 0
+    values = sorted(values)
+    return values[min(len(values) - 1, math.ceil(p / 100 * len(values)) - 1)]
+
+
+def _state(result):
+    return 'missing' if result is None else 'error' if 'error' in result else 'ok'
+
+
+def compare(before, after, alpha, tolerance):
+    """Returns [(keyboard, metric, before, after, change, p or None, regression)] for what moved between two entries.
+    """
+    rows = []
+    old_benches, new_benches = before.get('benches', {}), after.get('benches', {})
+    for metric in sorted(set(old_benches) | set(new_benches)):
+        a, b = old_benches.get(metric), new_benches.get(metric)
+        if a is None or b is None:
+            # A benchmark that a commit cannot build, or that it adds.
+            rows.append(('bench', metric, 'missing' if a is None else statistics.median(a), 'missing' if b is None else statistics.median(b), None, None, False))
+            continue
+        change = statistics.median(b) / statistics.median(a) - 1
+        p = mann_whitney(a, b)
+        rows.append(('bench', metric, statistics.median(a), statistics.median(b), change, p, p < alpha and change > tolerance))
+
+    for keyboard in sorted(set(before['boards']) | set(after['boards'])):
+        old, new = before['boards'].get(keyboard), after['boards'].get(keyboard)
+        if old is None or new is None or 'error' in old or 'error' in new:
+            if _state(old) != _state(new):
+                rows.append((keyboard, 'board', _state(old), _state(new), None, None, bool(new and 'error' in new)))
+            continue
+
+        a, b = _expand(old['latency']), _expand(new['latency'])
+        if a and b:
+            mean_a, mean_b = statistics.mean(a), statistics.mean(b)
+            change = (mean_b - mean_a) / mean_a if mean_a else (math.inf if mean_b else 0)
+            p = mann_whitney(a, b)
+            for q in PERCENTILES:
+                rows.append((keyboard, f'model latency p{q} ms', percentile(a, q), percentile(b, q), None, None, False))
+            rows.append((keyboard, 'model latency mean ms', round(mean_a, 2), round(mean_b, 2), change, p, p < alpha and change > tolerance))
+
+        for operation in sorted(set(old['via']) | set(new['via'])):
+            a, b = old['via'].get(operation), new['via'].get(operation)
+            if a is None or b is None:
+                continue
+            change = b / a - 1 if a else 0
+            rows.append((keyboard, f'via {operation} ms', a, b, change, None, change > tolerance))
+    return rows
+
+
+def report(before, after, alpha, tolerance, verbose):
+    """Prints the comparison of two entries. Returns the number of regressions.
+    """
+    print(f'{before["commit"][:7]} -> {after["commit"][:7]} {after["subject"]}')
+    if before['qmk'] != after['qmk']:
+        print(f'    qmk_firmware {(before["qmk"] or "unknown")[:7]} -> {(after["qmk"] or "unknown")[:7]}')
+    if before['host'] != after['host']:
+        print(f'    measured on {before["host"]} and {after["host"]}, benchmark times are not comparable', file=sys.stderr)
+    rows = compare(before, after, alpha, tolerance)
+    regressions = 0
+    for keyboard, metric, old, new, change, p, regression in rows:
+        regressions += regression
+        # Timed metrics move between runs, only significant changes are shown.
+        if change is None:
+            moved = metric.startswith('model latency') and old != new
+        else:
+            moved = abs(change) > tolerance and (p is None or p < alpha)
+        if not (verbose or regression or moved):
+            continue
+        change = '' if change is None else 'new' if math.isinf(change) else f'{change * 100:+.1f}%'
+        p = '' if p is None else f'{p:.3f}'
+        print(f'    {keyboard:<24} {metric:<22} {old:>10} {new:>10} {change:>8} {p:>6}  {"REGRESSION" if regression else ""}'.rstrip())
+        if metric == 'board' and new == 'error':
+            print(f'        {after["boards"][keyboard]["error"]}')
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('revisions', nargs='*', default=['HEAD'], help='commits or ranges (A..B) to measure (default: HEAD)')
+    parser.add_argument('--qmk', nargs='+', help='qmk_firmware revisions to measure against, each in a temporary worktree (default: the checkout as is)')
+    parser.add_argument('--report', nargs=2, metavar=('BEFORE', 'AFTER'), help='only compare two recorded commits')
+    parser.add_argument('-km', '--keymap', default='via')
+    parser.add_argument('--history', type=Path, default=HISTORY, help='history file (default: %(default)s)')
+    parser.add_argument('--samples', type=int, default=5, help='runs of each benchmark (default: %(default)s)')
+    parser.add_argument('--alpha', type=float, default=0.01, help='significance level (default: %(default)s)')
+    parser.add_argument('--tolerance', type=float, default=0.05, help='smallest relative change reported (default: %(default)s)')
+    parser.add_argument('-j', '--jobs', type=int, default=os.cpu_count(), help='worker processes (default: one per core)')
+    parser.add_argument('-f', '--force', action='store_true', help='measure again commits already in the history')
+    parser.add_argument('-v', '--verbose', action='store_true', help='print every metric, not only those that moved')
+    args = parser.parse_args()
+
+    traces = [str(path) for path in sorted(fleet_sim.TRACES.glob('*.trace'))]
+    if not traces:
+        print(f'no traces found in {fleet_sim.TRACES}', file=sys.stderr)
+        return 2
+    corpus = corpus_hash(traces)
+    history = load_history(args.history)
+    home = qmk_tree.qmk_home()
+
+    if args.report:
+        try:
+            pair = [find(history, _git('rev-parse', '--verify', f'{revision}^{{commit}}'), None, corpus) for revision in args.report]
+        except RuntimeError as e:
+            print(e, file=sys.stderr)
+            return 2
+        missing = [revision for revision, entry in zip(args.report, pair) if entry is None]
+        if missing:
+            print(f'not in {args.history} with the current traces: {", ".join(missing)}', file=sys.stderr)
+            return 2
+        return 1 if report(*pair, args.alpha, args.tolerance, args.verbose) else 0
+
+    try:
+        measured = commits(args.revisions)
+    except RuntimeError as e:
+        print(e, file=sys.stderr)
+        return 2
+    host = f'{platform.node()} {platform.machine()} python {platform.python_version()}'
+    entries = {}  # qmk ref -> [entry per commit]
+    for ref in args.qmk or [None]:
+        worktree = None
+        if ref is None:
+            tree = home
+        else:
+            worktree = tempfile.mkdtemp(prefix='perf_history_qmk_')
+            _git('worktree', 'add', '--detach', worktree, ref, cwd=home)
+            tree = Path(worktree)
+        try:
+            revision = qmk_revision(tree)
+            for commit in measured:
+                entry = None if args.force or revision is None else find(history, commit, revision, corpus)
+                if entry is None:
+                    start = time.perf_counter()
+                    benches, failed, boards = measure(commit, tree, traces, args.samples, args.jobs, args.keymap)
+                    entry = {
+                        'commit': commit,
+                        'subject': _git('log', '-1', '--format=%s', commit),
+                        'qmk': revision,
+                        'corpus': corpus,
+                        'host': host,
+                        'samples': args.samples,
+                        'measured': time.strftime('%Y-%m-%dT%H:%M:%S'),
+                        'benches': benches,
+                        'bench_failed': failed,
+                        'boards': boards,
+                    }
+                    history.append(entry)
+                    with args.history.open('a', encoding='utf-8') as f:
+                        f.write(json.dumps(entry, sort_keys=True) + '\n')
+                    print(f'{commit[:7]} at qmk_firmware {(revision or "unknown")[:7]}: {len(benches)} benchmark figures, {len(entry["boards"])} boards in {time.perf_counter() - start:.1f}s' + (f', not built: {", ".join(failed)}' if failed else ''), file=sys.stderr)
+                entries.setdefault(ref, []).append(entry)
+        finally:
+            if worktree:
+                _git('worktree', 'remove', '--force', worktree, cwd=home)
+
+    regressions = 0
+    for ref, line in entries.items():
+        for before, after in zip(line, line[1:]):
+            regressions += report(before, after, args.alpha, args.tolerance, args.verbose)
+    last = [line[-1] for line in entries.values()]
+    for before, after in zip(last, last[1:]):
+        regressions += report(before, after, args.alpha, args.tolerance, args.verbose)
+    if len(measured) == 1 and len(last) == 1 and not args.verbose:
+        print(f'{measured[0][:7]}: one measurement, nothing to compare', file=sys.stderr)
+    print(f'{regressions} regressions', file=sys.stderr)
+    return 1 if regressions else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
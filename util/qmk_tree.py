@@ -0,0 +1,376 @@
+"""Helpers shared by the userspace tools: locating qmk_firmware, reading
+keyboard definitions, resolving keycode names and parsing the via keymaps.
+"""
+import json
+import os
+import re
+import shutil
+import struct
+import subprocess
+from pathlib import Path
+
+USERSPACE = Path(__file__).resolve().parent.parent
+
+
+def qmk_home():
+    """Returns the qmk_firmware checkout the userspace builds against.
+    """
+    for var in ('QMK_FIRMWARE_ROOT', 'QMK_HOME'):
+        if os.environ.get(var):
+            return Path(os.environ[var])
+
+    if shutil.which('qmk'):
+        result = subprocess.run(['qmk', 'config', '-ro', 'user.qmk_home'], capture_output=True, text=True)
+        value = result.stdout.strip().partition('=')[2]
+        if value and value != 'None':
+            return Path(value)
+
+    return Path.home() / 'qmk_firmware'
+
+
+def keymaps(keymap='via', userspace=USERSPACE):
+    """Yields (keyboard, keymap.c path) for every keymap of that name in the userspace, or a copy of it.
+    """
+    for path in sorted((userspace / 'keyboards').glob(f'**/keymaps/{keymap}/keymap.c')):
+        yield path.parent.parent.parent.relative_to(userspace / 'keyboards').as_posix(), path
+
+
+def _merge(target, source):
+    for key, value in source.items():
+        if isinstance(value, dict) and isinstance(target.get(key), dict):
+            _merge(target[key], value)
+        else:
+            target[key] = value
+    return target
+
+
+def _load_json(path):
+    text = path.read_text(encoding='utf-8')
+    try:
+        return json.loads(text)
+    except ValueError:
+        import hjson
+        return hjson.loads(text)
+
+
+def _load_rules(path, rules):
+    for line in path.read_text(encoding='utf-8').splitlines():
+        match = re.match(r'^\s*([A-Z0-9_]+)\s*[:?]?=\s*(\S*)', line)
+        if match:
+            rules[match.group(1)] = match.group(2)
+
+
+def keyboard_info(keyboard, home=None):
+    """Merges info.json/keyboard.json and rules.mk down the keyboard's folder tree.
+
+    Returns the merged info dict, with the rules.mk variables under `rules`.
+    """
+    base = (home or qmk_home()) / 'keyboards'
+    info = {}
+    rules = {}
+    folder = base
+    for part in keyboard.split('/'):
+        folder = folder / part
+        for name in ('info.json', 'keyboard.json'):
+            if (folder / name).exists():
+                _merge(info, _load_json(folder / name))
+        if (folder / 'rules.mk').exists():
+            _load_rules(folder / 'rules.mk', rules)
+
+    if not info and not rules:
+        raise FileNotFoundError(f'{keyboard} not found under {base}')
+
+    for feature, enabled in info.get('features', {}).items():
+        rules.setdefault(f'{feature.upper()}_ENABLE', 'yes' if enabled else 'no')
+
+    info['rules'] = rules
+    return info
+
+
+def layout(info, macro):
+    """Returns the key list of a LAYOUT_* macro, following layout aliases.
+    """
+    name = info.get('layout_aliases', {}).get(macro, macro)
+    if name in info.get('layouts', {}):
+        return info['layouts'][name]['layout']
+    return None
+
+
+def compile(keyboard, keymap, env=None):
+    """Builds a keymap with `qmk compile`, passing `env` as -e overrides, and returns the ELF path.
+    """
+    command = ['qmk', 'compile', '-kb', keyboard, '-km', keymap]
+    for name, value in (env or {}).items():
+        command += ['-e', f'{name}={value}']
+    result = subprocess.run(command, capture_output=True, text=True)
+    if result.returncode:
+        raise RuntimeError(f'{" ".join(command)} failed:\n{result.stdout}{result.stderr}')
+    return qmk_home() / '.build' / f'{keyboard.replace("/", "_")}_{keymap}.elf'
+
+
+def _elf_sections(data):
+    if data[:4] != b'\x7fELF':
+        raise ValueError('not an ELF file')
+    is64 = data[4] == 2
+    endian = '<' if data[5] == 1 else '>'
+    if is64:
+        shoff, = struct.unpack_from(endian + 'Q', data, 0x28)
+        shentsize, shnum = struct.unpack_from(endian + 'HH', data, 0x3A)
+        layout = endian + 'IIQQQQII'
+    else:
+        shoff, = struct.unpack_from(endian + 'I', data, 0x20)
+        shentsize, shnum = struct.unpack_from(endian + 'HH', data, 0x2E)
+        layout = endian + 'IIIIIIII'
+    # (name, type, flags, addr, offset, size, link, info)
+    return is64, endian, [struct.unpack_from(layout, data, shoff + i * shentsize) for i in range(shnum)]
+
+
+def flash_size(elf):
+    """Sums the allocated PROGBITS sections of an ELF file, i.e. what ends up in flash.
+    """
+    _, _, sections = _elf_sections(Path(elf).read_bytes())
+    return sum(size for _, sh_type, flags, _, _, size, _, _ in sections if sh_type == 1 and flags & 0x2)
+
+
+def function_sizes(elf):
+    """Returns {name: size} for the function symbols of an ELF file.
+    """
+    data = Path(elf).read_bytes()
+    is64, endian, sections = _elf_sections(data)
+    sizes = {}
+    for _, sh_type, _, _, offset, size, link, _ in sections:
+        if sh_type != 2:  # SHT_SYMTAB
+            continue
+        strtab = sections[link][4]
+        entry = 24 if is64 else 16
+        for at in range(offset, offset + size, entry):
+            if is64:
+                name, info, _, _, _, sym_size = struct.unpack_from(endian + 'IBBHQQ', data, at)
+            else:
+                name, _, sym_size, info, _, _ = struct.unpack_from(endian + 'IIIBBH', data, at)
+            if info & 0xF == 2:  # STT_FUNC
+                end = data.index(b'\0', strtab + name)
+                sizes[data[strtab + name:end].decode()] = sym_size
+    return sizes
+
+
+def strip_comments(text):
+    """Blanks out C comments, keeping line breaks so line numbers survive.
+    """
+    def blank(match):
+        return re.sub(r'[^\n]', ' ', match.group(0))
+
+    return re.sub(r'//[^\n]*|/\*.*?\*/', blank, text, flags=re.S)
+
+
+def split_args(text):
+    """Splits a macro argument list on top level commas.
+
+    Returns (argument, offset) pairs, offsets relative to the start of text.
+    """
+    args = []
+    depth = 0
+    start = 0
+    for i, char in enumerate(text):
+        if char in '([{':
+            depth += 1
+        elif char in ')]}':
+            depth -= 1
+        elif char == ',' and depth == 0:
+            args.append((text[start:i], start))
+            start = i + 1
+    if text[start:].strip() or args:
+        args.append((text[start:], start))
+    return [(arg.strip(), offset + len(arg) - len(arg.lstrip())) for arg, offset in args]
+
+
+def _closing_paren(text, start):
+    depth = 0
+    for i in range(start, len(text)):
+        if text[i] == '(':
+            depth += 1
+        elif text[i] == ')':
+            depth -= 1
+            if depth == 0:
+                return i
+    raise ValueError('unbalanced parentheses')
+
+
+class Layer:
+    def __init__(self, name, macro, keys, line):
+        self.name = name
+        self.macro = macro
+        self.keys = keys
+        self.line = line
+
+
+def parse_keymap(path):
+    """Returns the layers of a keymap.c `keymaps[]` array.
+
+    Each key is a (keycode expression, line number) pair.
+    """
+    text = strip_comments(Path(path).read_text(encoding='utf-8'))
+    layers = []
+    for match in re.finditer(r'(?:\[\s*(\w+)\s*\]\s*=\s*)?\b(LAYOUT\w*)\s*\(', text):
+        open_paren = match.end() - 1
+        close_paren = _closing_paren(text, open_paren)
+        body = text[open_paren + 1:close_paren]
+        keys = []
+        for arg, offset in split_args(body):
+            keys.append((arg, text.count('\n', 0, open_paren + 1 + offset) + 1))
+        name = match.group(1) if match.group(1) else str(len(layers))
+        layers.append(Layer(name, match.group(2), keys, text.count('\n', 0, match.start()) + 1))
+    return layers
+
+
+def via_layer_count(keymap_c, info, layers):
+    """Returns the number of layers a keymap can reach: what VIA sees with VIA on, else the keymap's own.
+
+    Follows the keymap's rules.mk and config.h through the userspace's
+    compact store and profile banks, then the keyboard's dynamic keymap
+    size, 4 by default.
+    """
+    rules = dict(info.get('rules', {}))
+    if (keymap_c.parent / 'rules.mk').exists():
+        _load_rules(keymap_c.parent / 'rules.mk', rules)
+    if rules.get('VIA_ENABLE') != 'yes':
+        return layers
+    defines = {}
+    if (keymap_c.parent / 'config.h').exists():
+        text = strip_comments((keymap_c.parent / 'config.h').read_text(encoding='utf-8'))
+        defines = {name: int(value) for name, value in re.findall(r'^\s*#\s*define\s+(\w+)\s+(\d+)', text, flags=re.M)}
+    if rules.get('FJ_PROFILE_ENABLE') == 'yes':
+        return defines.get('FJ_PROFILE_LAYERS', 4)
+    if rules.get('FJ_COMPACT_KEYMAP_ENABLE') == 'yes':
+        return 1 + defines.get('FJ_COMPACT_KEYMAP_LAYERS', 7)
+    return defines.get('DYNAMIC_KEYMAP_LAYER_COUNT', info.get('dynamic_keymap', {}).get('layer_count', 4))
+
+
+class KeycodeTable:
+    """Resolves keycode expressions to values using qmk_firmware's own headers.
+
+    Only the subset of C that keycode headers use is understood: integer
+    literals, enum constants, object and function-like macros, casts and the
+    usual arithmetic and bitwise operators.
+    """
+    HEADERS = (
+        'quantum/keycodes.h',
+        'quantum/quantum_keycodes.h',
+        'quantum/modifiers.h',
+        'quantum/keymap_common.h',
+        'quantum/keycode_legacy.h',
+    )
+
+    TOKEN = re.compile(r'\s*(0[xX][0-9a-fA-F]+|\d+|[A-Za-z_]\w*|<<|>>|&&|\|\||[-+*/%&|^~!(),?:<>])')
+
+    def __init__(self, home=None, extra=()):
+        self.objects = {}
+        self.functions = {}
+        home = home or qmk_home()
+        for header in [home / header for header in self.HEADERS] + list(extra):
+            if header.exists():
+                self._load(strip_comments(header.read_text(encoding='utf-8')))
+
+    def _load(self, text):
+        text = re.sub(r'\\\n', ' ', text)
+        for match in re.finditer(r'^\s*#\s*define\s+(\w+)(\(([^)]*)\))?[ \t]*(.*)$', text, flags=re.M):
+            name, params, body = match.group(1), match.group(3), match.group(4).strip()
+            if match.group(2):
+                self.functions[name] = ([p.strip() for p in params.split(',') if p.strip()], body)
+            elif body:
+                self.objects[name] = body
+
+        for block in re.finditer(r'\benum\b[^{;]*\{(.*?)\}', text, flags=re.S):
+            previous = -1
+            for entry, _ in split_args(block.group(1)):
+                if not entry or entry.startswith('#'):
+                    continue
+                name, _, expr = entry.partition('=')
+                name = name.strip()
+                if not re.match(r'^\w+$', name):
+                    continue
+                if expr.strip():
+                    self.objects[name] = expr.strip()
+                    try:
+                        previous = self.value(name)
+                    except ValueError:
+                        previous = None
+                elif previous is not None:
+                    previous += 1
+                    self.objects[name] = str(previous)
+
+    def with_source(self, path):
+        """Returns a copy that also knows the enums and macros defined in a source file.
+        """
+        table = KeycodeTable.__new__(KeycodeTable)
+        table.objects = dict(self.objects)
+        table.functions = dict(self.functions)
+        table._load(strip_comments(Path(path).read_text(encoding='utf-8')))
+        return table
+
+    def known(self, name):
+        return name in self.objects or name in self.functions
+
+    def value(self, expr):
+        """Evaluates a keycode expression, raising ValueError if it can not be resolved.
+        """
+        python = self._expand(expr, set())
+        try:
+            return int(eval(python, {'__builtins__': {}}, {})) & 0xFFFF
+        except Exception as e:
+            raise ValueError(f'can not evaluate {expr!r}: {e}')
+
+    def _tokens(self, expr):
+        tokens = []
+        pos = 0
+        expr = expr.strip()
+        while pos < len(expr):
+            match = self.TOKEN.match(expr, pos)
+            if not match:
+                raise ValueError(f'unexpected {expr[pos:]!r} in {expr!r}')
+            tokens.append(match.group(1))
+            pos = match.end()
+        return tokens
+
+    def _expand(self, expr, active):
+        tokens = self._tokens(expr)
+        out = []
+        i = 0
+        while i < len(tokens):
+            token = tokens[i]
+            if token == '(' and i + 2 < len(tokens) and tokens[i + 2] == ')' and re.match(r'^u?int\d+_t$', tokens[i + 1]):
+                i += 3
+                continue
+            if re.match(r'^[A-Za-z_]', token):
+                if token in self.functions and i + 1 < len(tokens) and tokens[i + 1] == '(' and token not in active:
+                    close = i + 1
+                    depth = 0
+                    for close in range(i + 1, len(tokens)):
+                        depth += tokens[close] == '('
+                        depth -= tokens[close] == ')'
+                        if depth == 0:
+                            break
+                    args = [arg for arg, _ in split_args(' '.join(tokens[i + 2:close]))]
+                    params, body = self.functions[token]
+                    if len(args) != len(params):
+                        raise ValueError(f'{token} takes {len(params)} arguments, got {len(args)}')
+                    body = ' '.join(f'({args[params.index(t)]})' if t in params else t for t in self._tokens(body)) if body else '0'
+                    out.append(f'({self._expand(body, active | {token})})')
+                    i = close + 1
+                    continue
+                if token in self.objects and token not in active:
+                    out.append(f'({self._expand(self.objects[token], active | {token})})')
+                    i += 1
+                    continue
+                raise ValueError(f'unknown identifier {token}')
+            if token == '&&':
+                token = ' and '
+            elif token == '||':
+                token = ' or '
+            elif token == '!':
+                token = ' not '
+            elif token == '/':
+                token = '//'
+            out.append(token)
+            i += 1
+        return ''.join(out)
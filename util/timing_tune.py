@@ -0,0 +1,369 @@
+#!/usr/bin/env python3
+"""Tunes a board's debounce and tapping term against matrix traces recorded from it.
+
+Record the traces with the board's keymap built with FJ_MATRIX_TRACE_ENABLE
+= yes, which turns debouncing off and prints every raw key change on the
+console: type normally for a few minutes, including taps and holds of the
+mod-tap and layer-tap keys, and keep the `qmk console` log.
+
+The raw changes are replayed through models of QMK's debounce algorithms at
+the board's measured scan interval, for every DEBOUNCE_TYPE and DEBOUNCE up
+to --max-debounce, one worker per core. The reference is the trace with
+each burst of changes closer than --settle ms collapsed into the one press
+or release it was. A setting passes only with zero chatter: every key sees
+exactly the reference presses and releases, no more and no fewer. Of the
+passing settings the one with the lowest mean delay wins. The debounced
+events then go through fleet_sim's model of the board's keymap to find the
+lowest TAPPING_TERM that decides every tap-hold press the way the stock
+term did, plus --margin.
+
+    qmk console | tee 7vhotswap.log                     # with FJ_MATRIX_TRACE_ENABLE
+    util/timing_tune.py -kb fjlabs/7vhotswap 7vhotswap.log
+    util/timing_tune.py -kb fjlabs/bks65solder bks65solder.log --apply
+"""
+import argparse
+import math
+import multiprocessing
+import os
+import re
+import sys
+from pathlib import Path
+
+import fleet_sim
+import qmk_tree
+
+ANSI = re.compile(r'\x1b\[[0-9;]*m')
+# qmk console prefixes every line with manufacturer:product:index.
+LINE = re.compile(r'^(?:.*?:\d+: )?matrix: (?P<ms>\d+) (?P<scan>\d+) (?P<row>\d+) (?P<col>\d+) (?P<state>[01])$')
+
+STOCK = ('sym_defer_g', 5)
+TERM_STEP = 5
+
+
+def parse(lines):
+    """Returns (scan interval ms, [(time ms, (row, col), pressed)]) from console lines, None if there are none.
+    """
+    samples = []
+    for line in lines:
+        match = LINE.match(ANSI.sub('', line).strip())
+        if match:
+            samples.append((int(match['ms']), int(match['scan']), (int(match['row']), int(match['col'])), match['state'] == '1'))
+    if len(samples) < 2 or samples[-1][1] == samples[0][1]:
+        return None
+    # The millisecond timer against the scan count over the whole recording.
+    period = (samples[-1][0] - samples[0][0]) / (samples[-1][1] - samples[0][1])
+    first = samples[0][1]
+    edges, state = [], {}
+    for _, scan, pos, pressed in samples:
+        # Lines the console dropped can leave a key seemingly changing to the state it was in.
+        if state.get(pos, not pressed) != pressed:
+            edges.append(((scan - first) * period, pos, pressed))
+            state[pos] = pressed
+    return period, edges
+
+
+def reference(edges, settle):
+    """Returns the intended [(time, pos, pressed)]: each burst of changes closer than `settle` ms, by where it ended.
+    """
+    by_key = {}
+    for stamp, pos, pressed in edges:
+        by_key.setdefault(pos, []).append((stamp, pressed))
+    events = []
+    for pos, changes in by_key.items():
+        state = not changes[0][1]
+        start = 0
+        for i in range(len(changes)):
+            if i + 1 < len(changes) and changes[i + 1][0] - changes[i][0] < settle:
+                continue
+            # A burst that ends where it started was noise, not a key press.
+            if changes[i][1] != state:
+                state = changes[i][1]
+                events.append((changes[start][0], pos, state))
+            start = i + 1
+    return sorted(events)
+
+
+class Debounce:
+    """One of QMK's debounce algorithms, fed the raw changes at the scans that see them.
+
+    Time is in ms; the firmware only reads the millisecond timer, so
+    countdowns start from the millisecond a scan falls in and end at the
+    first scan of the millisecond they expire in.
+    """
+    def __init__(self, debounce, period):
+        self.debounce = debounce
+        self.period = period
+        self.raw = {}
+        self.cooked = {}
+        self.deadlines = {}  # key -> scan time its countdown ends
+        self.output = []
+
+    def _after(self, stamp):
+        target = math.floor(stamp + 1e-9) + self.debounce
+        return math.ceil(target / self.period - 1e-9) * self.period
+
+    def _emit(self, stamp, pos):
+        self.cooked[pos] = self.raw[pos]
+        self.output.append((stamp, pos, self.raw[pos]))
+
+    def deadline(self):
+        return min(self.deadlines.values(), default=None)
+
+    def change(self, stamp, pos, pressed):
+        self.raw[pos] = pressed
+        if self.debounce == 0:
+            if self.cooked.get(pos, False) != pressed:
+                self._emit(stamp, pos)
+            return
+        self._change(stamp, pos, pressed)
+
+    def expire(self, stamp):
+        for pos in [pos for pos, at in self.deadlines.items() if at <= stamp + 1e-9]:
+            del self.deadlines[pos]
+            self._expire(stamp, pos)
+
+
+class SymDeferG(Debounce):
+    """Every key waits until the whole matrix has been still for DEBOUNCE ms.
+    """
+    def _change(self, stamp, pos, pressed):
+        self.deadlines = {None: self._after(stamp)}
+
+    def _expire(self, stamp, _):
+        for pos, pressed in self.raw.items():
+            if self.cooked.get(pos, False) != pressed:
+                self._emit(stamp, pos)
+
+
+class SymDeferPk(Debounce):
+    """A key changes once it has read its new state for DEBOUNCE ms.
+    """
+    def _change(self, stamp, pos, pressed):
+        if self.cooked.get(pos, False) == pressed:
+            self.deadlines.pop(pos, None)
+        elif pos not in self.deadlines:
+            self.deadlines[pos] = self._after(stamp)
+
+    def _expire(self, stamp, pos):
+        self._emit(stamp, pos)
+
+
+class SymEagerPk(Debounce):
+    """A key changes on its first change and ignores the matrix for DEBOUNCE ms after.
+    """
+    def _change(self, stamp, pos, pressed):
+        if pos not in self.deadlines and self.cooked.get(pos, False) != pressed:
+            self._emit(stamp, pos)
+            self.deadlines[pos] = self._after(stamp)
+
+    def _expire(self, stamp, pos):
+        if self.cooked.get(pos, False) != self.raw[pos]:
+            self._emit(stamp, pos)
+            self.deadlines[pos] = self._after(stamp)
+
+
+class AsymEagerDeferPk(Debounce):
+    """Presses are eager, releases deferred, DEBOUNCE ms each.
+    """
+    def __init__(self, debounce, period):
+        super().__init__(debounce, period)
+        self.releasing = set()
+
+    def _start(self, stamp, pos):
+        if self.raw[pos]:
+            self._emit(stamp, pos)
+        else:
+            self.releasing.add(pos)
+        self.deadlines[pos] = self._after(stamp)
+
+    def _change(self, stamp, pos, pressed):
+        if self.cooked.get(pos, False) != pressed:
+            if pos not in self.deadlines:
+                self._start(stamp, pos)
+        elif pos in self.releasing:
+            self.releasing.discard(pos)
+            del self.deadlines[pos]
+
+    def _expire(self, stamp, pos):
+        if pos in self.releasing:
+            self.releasing.discard(pos)
+            self._emit(stamp, pos)
+        elif self.cooked.get(pos, False) != self.raw[pos]:
+            self._start(stamp, pos)
+
+
+ALGORITHMS = {
+    'sym_defer_g': SymDeferG,
+    'sym_defer_pk': SymDeferPk,
+    'sym_eager_pk': SymEagerPk,
+    'asym_eager_defer_pk': AsymEagerDeferPk,
+}
+
+
+def debounce(algorithm, value, period, edges):
+    """Returns the debounced [(time, pos, pressed)] for one trace.
+    """
+    model = ALGORITHMS[algorithm](value, period)
+    for stamp, pos, pressed in edges:
+        while model.deadline() is not None and model.deadline() < stamp - 1e-9:
+            model.expire(model.deadline())
+        model.expire(stamp)
+        model.change(stamp, pos, pressed)
+    while model.deadline() is not None:
+        model.expire(model.deadline())
+    return model.output
+
+
+def score(output, intended):
+    """Returns (chatter, delays): events that differ from the intended ones per key, and each intended event's delay.
+    """
+    mine, theirs = {}, {}
+    for stamp, pos, pressed in output:
+        mine.setdefault(pos, []).append((stamp, pressed))
+    for stamp, pos, pressed in intended:
+        theirs.setdefault(pos, []).append((stamp, pressed))
+    chatter, delays = 0, []
+    for pos in mine.keys() | theirs.keys():
+        got, want = mine.get(pos, []), theirs.get(pos, [])
+        if [pressed for _, pressed in got] != [pressed for _, pressed in want]:
+            chatter += max(1, abs(len(got) - len(want)))
+            continue
+        delays += [out - ref for (out, _), (ref, _) in zip(got, want)]
+    return chatter, delays
+
+
+_worker = {}
+
+
+def _init_worker(traces):
+    _worker['traces'] = traces
+
+
+def run_setting(setting):
+    """Worker: one DEBOUNCE_TYPE and DEBOUNCE over every trace. Returns (setting, chatter, delays).
+    """
+    algorithm, value = setting
+    chatter, delays = 0, []
+    for period, edges, intended in _worker['traces']:
+        more, some = score(debounce(algorithm, value, period, edges), intended)
+        chatter += more
+        delays += some
+    return setting, chatter, delays
+
+
+def tapping_decisions(board, streams, term):
+    board.tapping_term = term
+    decisions = []
+    for events in streams:
+        board.reset()
+        for stamp, pos, pressed in events:
+            board.event(stamp, pos, pressed)
+        board.finish()
+        decisions.append(board.decisions)
+    return decisions
+
+
+def apply(keymap_dir, algorithm, value, term, source):
+    """Writes the tuned settings into the keymap's config.h and rules.mk, replacing earlier ones.
+    """
+    config = keymap_dir / 'config.h'
+    lines = config.read_text(encoding='utf-8').splitlines() if config.exists() else ['#pragma once']
+    drop = re.compile(r'^\s*#\s*(undef|define)\s+(DEBOUNCE|TAPPING_TERM)\b|^// Tuned by util/timing_tune\.py')
+    lines = [line for line in lines if not drop.match(line)]
+    while lines and not lines[-1].strip():
+        lines.pop()
+    lines += ['', f'// Tuned by util/timing_tune.py from {source}.', '#undef DEBOUNCE', f'#define DEBOUNCE {value}']
+    if term is not None:
+        lines += ['#undef TAPPING_TERM', f'#define TAPPING_TERM {term}']
+    config.write_text('\n'.join(lines) + '\n', encoding='utf-8')
+
+    rules = keymap_dir / 'rules.mk'
+    lines = [line for line in rules.read_text(encoding='utf-8').splitlines() if not re.match(r'^\s*DEBOUNCE_TYPE\s*[:?]?=', line)]
+    lines.append(f'DEBOUNCE_TYPE = {algorithm}')
+    rules.write_text('\n'.join(lines) + '\n', encoding='utf-8')
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('logs', nargs='+', type=Path, help='console logs recorded with FJ_MATRIX_TRACE_ENABLE')
+    parser.add_argument('-kb', '--keyboard', required=True, help='the keyboard the traces were recorded on')
+    parser.add_argument('-km', '--keymap', default='via')
+    parser.add_argument('--settle', type=float, default=15, help='changes closer than this many ms are one bounce (default: %(default)s)')
+    parser.add_argument('--max-debounce', type=int, default=30, help='largest DEBOUNCE tried, in ms (default: %(default)s)')
+    parser.add_argument('--tapping-term', type=int, default=fleet_sim.TAPPING_TERM, help='the term the traces were typed with (default: %(default)s)')
+    parser.add_argument('--margin', type=int, default=20, help='ms added to the lowest TAPPING_TERM that decides the same (default: %(default)s)')
+    parser.add_argument('-j', '--jobs', type=int, default=os.cpu_count(), help='worker processes (default: one per core)')
+    parser.add_argument('--apply', action='store_true', help='write the result into the keymap\'s config.h and rules.mk')
+    args = parser.parse_args()
+
+    traces = []
+    for path in args.logs:
+        parsed = parse(path.read_text(encoding='utf-8', errors='replace').splitlines())
+        if parsed is None:
+            print(f'{path}: no matrix lines found, is FJ_MATRIX_TRACE_ENABLE on?', file=sys.stderr)
+            return 2
+        period, edges = parsed
+        traces.append((period, edges, reference(edges, args.settle)))
+
+    edges = sum(len(trace[1]) for trace in traces)
+    presses = sum(pressed for trace in traces for _, _, pressed in trace[2])
+    period = sum(trace[0] for trace in traces) / len(traces)
+    print(f'{args.keyboard}: {len(traces)} traces, {edges} raw changes, {presses} presses, scan {period * 1000:.0f} us')
+
+    settings = [(algorithm, value) for algorithm in ALGORITHMS for value in range(args.max_debounce + 1)]
+    with multiprocessing.Pool(min(args.jobs, len(settings)) or 1, _init_worker, (traces,)) as pool:
+        results = pool.map(run_setting, settings)
+
+    print(f'{"DEBOUNCE_TYPE":<20} {"DEBOUNCE":>8} {"mean ms":>8} {"worst ms":>8}')
+    best = None
+    for algorithm in ALGORITHMS:
+        passing = [(sum(delays) / len(delays) if delays else 0, max(delays, default=0), value) for (name, value), chatter, delays in results if name == algorithm and not chatter]
+        if not passing:
+            print(f'{algorithm:<20} {"none":>8}   chatters at every DEBOUNCE up to {args.max_debounce}')
+            continue
+        mean, worst, value = min(passing)
+        print(f'{algorithm:<20} {value:>8} {mean:>8.2f} {worst:>8.2f}')
+        if best is None or (mean, worst) < best[:2]:
+            best = (mean, worst, algorithm, value)
+    for (name, value), chatter, delays in results:
+        if (name, value) == STOCK:
+            mean = sum(delays) / len(delays) if delays else 0
+            verdict = f'{chatter} chattering events' if chatter else f'no chatter, mean {mean:.2f} ms'
+            print(f'stock ({name}, DEBOUNCE {value}): {verdict}')
+    if best is None:
+        print('no setting is free of chatter; check --settle against the traces', file=sys.stderr)
+        return 1
+    mean, worst, algorithm, value = best
+
+    home = qmk_tree.qmk_home()
+    keymap_c = qmk_tree.USERSPACE / 'keyboards' / args.keyboard / 'keymaps' / args.keymap / 'keymap.c'
+    keycodes = qmk_tree.KeycodeTable(home, extra=sorted((qmk_tree.USERSPACE / 'users').glob('*/*.h')))
+    try:
+        board = fleet_sim.load_board(args.keyboard, keymap_c, home, keycodes)
+    except (FileNotFoundError, ValueError, KeyError) as e:
+        print(f'{keymap_c}: {e}', file=sys.stderr)
+        return 2
+    streams = [debounce(algorithm, value, trace[0], trace[1]) for trace in traces]
+    stock = tapping_decisions(board, streams, args.tapping_term)
+    decided = sum(len(decisions) for decisions in stock)
+    term = None
+    if decided:
+        lowest = args.tapping_term
+        for candidate in range(args.tapping_term - TERM_STEP, 0, -TERM_STEP):
+            if tapping_decisions(board, streams, candidate) != stock:
+                break
+            lowest = candidate
+        term = min(args.tapping_term, lowest + args.margin)
+        print(f'TAPPING_TERM {args.tapping_term} -> {term}: {decided} tap-hold presses decided the same down to {lowest}, holds on their own register {args.tapping_term - term} ms sooner')
+    else:
+        print('no tap-hold presses in the traces, TAPPING_TERM left alone')
+
+    print(f'-> DEBOUNCE_TYPE = {algorithm}, DEBOUNCE {value}: mean {mean:.2f} ms, worst {worst:.2f} ms')
+    if args.apply:
+        apply(keymap_c.parent, algorithm, value, term, ', '.join(path.name for path in args.logs))
+        print(f'written to {keymap_c.parent / "config.h"} and rules.mk')
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,113 @@
+#!/usr/bin/env python3
+"""Measures full-keymap read and write throughput over VIA, one command at a time and pipelined.
+
+The whole dynamic keymap is read, then written back unchanged, first with
+every command waiting for its answer as stock VIA does and then with the
+userspace pipelined protocol keeping several tagged commands in flight.
+Against a device the times are wall clock; against the emulator they are
+the emulated full speed USB bus time, so the numbers do not depend on the
+host. Both reads must match for the run to pass.
+
+    util/via_bench.py -kb fjlabs/kf87                    # the connected kf87
+    util/via_bench.py -kb fjlabs/kf87 --emulate          # an emulated board with the same matrix
+    util/via_bench.py --keys 90 --emulate --layers 8 --depth 2 4 8
+"""
+import argparse
+import sys
+import time
+
+import qmk_tree
+import via_hid
+
+
+def _elapsed(device, start):
+    return device.clock - start if isinstance(device, via_hid.Emulator) else time.perf_counter() - start
+
+
+def _now(device):
+    return device.clock if isinstance(device, via_hid.Emulator) else time.perf_counter()
+
+
+def measure(device, size, depth):
+    """Reads and rewrites `size` bytes of keymap at `depth`. Returns (image, commands each way, read s, write s).
+    """
+    device.depth = depth
+    device.commands = 0
+    start = _now(device)
+    image = device.get_buffer(0, size)
+    read_time = _elapsed(device, start)
+    commands = device.commands
+    start = _now(device)
+    device.set_buffer(0, image)
+    write_time = _elapsed(device, start)
+    return image, commands, read_time, write_time
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('-kb', '--keyboard', help='keyboard, for the matrix size and USB ids')
+    parser.add_argument('--keys', type=int, help='matrix positions per layer (default: from the keyboard)')
+    parser.add_argument('-d', '--device', help='raw HID device path (default: the only VIA interface with the keyboard\'s USB ids)')
+    parser.add_argument('--emulate', action='store_true', help='measure an emulated board instead of a device')
+    parser.add_argument('--layers', type=int, default=4, help='layers of the emulated board (default: %(default)s)')
+    parser.add_argument('--depth', type=int, nargs='+', help='pipeline depths to measure (default: what the board advertises)')
+    args = parser.parse_args()
+
+    info = None
+    if args.keyboard:
+        try:
+            info = qmk_tree.keyboard_info(args.keyboard, qmk_tree.qmk_home())
+        except (FileNotFoundError, ValueError, KeyError) as e:
+            print(f'{args.keyboard}: {e}', file=sys.stderr)
+            return 2
+    keys = args.keys or (info['matrix_size']['rows'] * info['matrix_size']['cols'] if info else None)
+    if keys is None:
+        parser.error('pass -kb or --keys')
+
+    if args.emulate:
+        device = via_hid.Emulator([[(layer << 8) | key for key in range(keys)] for layer in range(args.layers)], pipeline=max(args.depth or [4]))
+    else:
+        path = args.device
+        if path is None:
+            usb = (info or {}).get('usb', {})
+            vid, pid = (int(usb[k], 16) if k in usb else None for k in ('vid', 'pid'))
+            found = via_hid.find_devices(vid, pid)
+            if len(found) != 1:
+                print(f'{len(found)} VIA devices found, pass --device', file=sys.stderr)
+                return 2
+            path = found[0]
+        device = via_hid.HidDevice(path)
+
+    try:
+        depths = args.depth
+        if depths is None:
+            advertised = device.negotiate()
+            depths = [advertised] if advertised > 1 else []
+            if not depths:
+                print(f'{device.path} does not advertise the pipelined protocol, measuring one command at a time only', file=sys.stderr)
+        layers = device.layer_count()
+        size = layers * keys * 2
+        print(f'{device.path}: {layers} layers x {keys} keys, {size} bytes')
+        print(f'{"depth":>5} {"commands":>8} {"read ms":>9} {"write ms":>9} {"read KB/s":>9} {"write KB/s":>10} {"speedup":>7}')
+        baseline = None
+        base_time = None
+        for depth in [1] + [depth for depth in depths if depth > 1]:
+            image, commands, read_time, write_time = measure(device, size, depth)
+            if baseline is None:
+                baseline, base_time = image, read_time + write_time
+            elif image != baseline:
+                print(f'depth {depth}: keymap read differs from the one read a command at a time', file=sys.stderr)
+                return 1
+            speedup = base_time / (read_time + write_time)
+            print(f'{depth:>5} {commands:>8} {read_time * 1000:>9.1f} {write_time * 1000:>9.1f} '
+                  f'{size / read_time / 1000:>9.1f} {size / write_time / 1000:>10.1f} {speedup:>6.2f}x')
+        return 0
+    except via_hid.ViaError as e:
+        print(e, file=sys.stderr)
+        return 1
+    finally:
+        device.close()
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,263 @@
+#!/usr/bin/env python3
+"""Compiles a text expansion dictionary into the FJ_EXPAND_ENABLE trie and writes it to a board over VIA.
+
+The dictionary has one entry per line, the trigger, whitespace, then the
+expansion; `\\n`, `\\t` and `\\\\` are the usual escapes and lines starting
+with # are comments. Triggers are matched on the keys that type them on a
+US layout, so they can use any printable character but space. Only the
+chunks that differ from what the board holds are written, and the result
+is read back.
+
+    util/via_expand.py snippets.txt -kb fjlabs/kf87      # the keyboard's only VIA interface
+    util/via_expand.py snippets.txt -n                   # compile and show the size only
+    util/via_expand.py snippets.txt -n -o snippets.bin   # and keep the image
+    util/via_expand.py snippets.txt --emulate            # against an in-memory board
+"""
+import argparse
+import sys
+from pathlib import Path
+
+import qmk_tree
+import via_hid
+
+MAGIC = 0xE6
+SHIFT = 0x80
+ROOT = 1
+ID_FJ_EXPAND_SIZE = 0x44
+ID_FJ_EXPAND_DATA = 0x45
+# value_data = [ offset hi, offset lo, size, bytes ... ] after the 3 byte command header,
+# leaving the last byte of the report alone as the board does.
+CHUNK = via_hid.REPORT_SIZE - 7
+
+_UNSHIFTED = 'abcdefghijklmnopqrstuvwxyz1234567890' + '\n\x1b\b\t ' + '-=[]\\' + '#' + ';\'`,./'
+_SHIFTED = 'ABCDEFGHIJKLMNOPQRSTUVWXYZ!@#$%^&*()' + '\0\0\0\0\0' + '_+{}|' + '~' + ':"~<>?'
+# ASCII character -> trie symbol, HID keycode plus SHIFT, on a US layout.
+SYMBOLS = {}
+for index, (plain, shifted) in enumerate(zip(_UNSHIFTED, _SHIFTED)):
+    keycode = 0x04 + index
+    SYMBOLS.setdefault(plain, keycode)
+    if shifted != '\0':
+        SYMBOLS.setdefault(shifted, keycode | SHIFT)
+# KC_NONUS_HASH (0x32) shares # and ~ with KC_3 and KC_GRAVE; use those.
+SYMBOLS['#'], SYMBOLS['~'] = 0x20 | SHIFT, 0x35 | SHIFT
+
+
+def unescape(text):
+    return text.replace('\\\\', '\0').replace('\\n', '\n').replace('\\t', '\t').replace('\0', '\\')
+
+
+def load_dictionary(path):
+    """Returns [(trigger, expansion)] from a dictionary file.
+    """
+    entries = []
+    for number, line in enumerate(path.read_text(encoding='utf-8').splitlines(), 1):
+        if not line.strip() or line.lstrip().startswith('#'):
+            continue
+        parts = line.strip().split(None, 1)
+        if len(parts) != 2:
+            raise ValueError(f'{path.name}:{number}: expected a trigger and an expansion')
+        trigger, expansion = parts[0], unescape(parts[1])
+        bad = [c for c in trigger if c not in SYMBOLS or c in ' \n\t\b\x1b']
+        if bad:
+            raise ValueError(f'{path.name}:{number}: trigger cannot contain {bad[0]!r}')
+        bad = [c for c in expansion if not (' ' <= c <= '~' or c in '\n\t')]
+        if bad:
+            raise ValueError(f'{path.name}:{number}: expansion cannot contain {bad[0]!r}')
+        entries.append((trigger, expansion))
+    return entries
+
+
+def compile_trie(entries):
+    """Returns the automaton image for [(trigger, expansion)] and the triggers shadowed by another one.
+
+    Nodes are laid out breadth first from offset 1, each [children]
+    [length][expansion hi, lo][fail hi, lo] followed by [symbol][node hi, lo]
+    per child by ascending symbol, then the NUL-terminated expansions, shared
+    when equal. A node's failure link is the node for the longest proper
+    suffix of its path that is in the trie. Its length and expansion are
+    those of its own trigger, or else of the trigger its failure links
+    reach first, since that one has been typed too.
+    """
+    root = {'children': {}, 'text': None, 'depth': 0}
+    for trigger, expansion in entries:
+        node = root
+        for char in trigger:
+            node = node['children'].setdefault(SYMBOLS[char], {'children': {}, 'text': None, 'depth': node['depth'] + 1})
+        node['text'] = expansion
+
+    # Failure links and outputs, breadth first so the links they start from are set.
+    root['fail'], root['out'] = root, None
+    order, queue = [], [(root, '')]
+    while queue:
+        node, path = queue.pop(0)
+        order.append((node, path))
+        for symbol in sorted(node['children']):
+            child = node['children'][symbol]
+            fail = node['fail']
+            while fail is not root and symbol not in fail['children']:
+                fail = fail['fail']
+            child['fail'] = fail['children'][symbol] if node is not root and symbol in fail['children'] else root
+            child['out'] = (child['text'], child['depth']) if child['text'] is not None else child['fail']['out']
+            queue.append((child, path + _char(symbol)))
+
+    # Reaching a node that expands ends the match, so nothing below it is
+    # reachable. No failure link points there either: the node for such a
+    # suffix would be below a prefix that expands.
+    shadowed, nodes, pruned = [], [], set()
+    for node, path in order:
+        if id(node) in pruned:
+            continue
+        nodes.append(node)
+        if node['out'] is not None and node['children']:
+            for rest, below in _walk(node):
+                if rest:
+                    pruned.add(id(below))
+                    if below['text'] is not None:
+                        shadowed.append(path + rest)
+            node['children'] = {}
+    shadowed.sort()
+
+    offset = ROOT
+    for node in nodes:
+        node['offset'] = offset
+        offset += 6 + 3 * len(node['children'])
+    texts = {}
+    for node in nodes:
+        if node['out'] is not None and node['out'][0] not in texts:
+            texts[node['out'][0]] = offset
+            offset += len(node['out'][0]) + 1
+    if offset > 0xFFFF:
+        raise ValueError(f'dictionary compiles to {offset} bytes, more than 64 KB')
+
+    image = bytearray([MAGIC])
+    for node in nodes:
+        text, length = (texts[node['out'][0]], node['out'][1]) if node['out'] is not None else (0, 0)
+        fail = node['fail']['offset'] if node is not root else 0
+        image += bytes([len(node['children']), length, text >> 8, text & 0xFF, fail >> 8, fail & 0xFF])
+        for symbol in sorted(node['children']):
+            child = node['children'][symbol]['offset']
+            image += bytes([symbol, child >> 8, child & 0xFF])
+    for text in texts:
+        image += text.encode('ascii') + b'\0'
+    return bytes(image), shadowed
+
+
+def _walk(node, path=''):
+    yield (path, node)
+    for symbol, child in node['children'].items():
+        yield from _walk(child, path + _char(symbol))
+
+
+def _char(symbol):
+    return next(char for char, value in SYMBOLS.items() if value == symbol)
+
+
+class ExpandEmulator(via_hid.Emulator):
+    """An in-memory board with FJ_EXPAND_SIZE bytes of expansion area.
+    """
+    def __init__(self, size):
+        super().__init__([[0]])
+        self.area = bytearray(size)
+
+    def _answer(self, report):
+        if report[0] not in (via_hid.ID_CUSTOM_GET_VALUE, via_hid.ID_CUSTOM_SET_VALUE) or report[1] != 0 or report[2] not in (ID_FJ_EXPAND_SIZE, ID_FJ_EXPAND_DATA):
+            return super()._answer(report)
+        response = bytearray(report)
+        if report[2] == ID_FJ_EXPAND_SIZE:
+            response[3:5] = bytes([len(self.area) >> 8, len(self.area) & 0xFF])
+            return bytes(response)
+        offset, size = (report[3] << 8) | report[4], report[5]
+        if size > CHUNK or offset + size > len(self.area):
+            response[0] = via_hid.ID_UNHANDLED
+        elif report[0] == via_hid.ID_CUSTOM_GET_VALUE:
+            response[6:6 + size] = self.area[offset:offset + size]
+        else:
+            for i in range(size):
+                self._update(offset + i, report[6 + i], self.area)
+        return bytes(response)
+
+
+def read_area(device, size):
+    data = bytearray()
+    while len(data) < size:
+        chunk = min(CHUNK, size - len(data))
+        at = len(data)
+        data += device.custom_value(ID_FJ_EXPAND_DATA, at >> 8, at & 0xFF, chunk)[3:3 + chunk]
+    return bytes(data)
+
+
+def write_area(device, offset, data):
+    device.set_custom_value(ID_FJ_EXPAND_DATA, offset >> 8, offset & 0xFF, len(data), *data)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('dictionary', type=Path)
+    parser.add_argument('-kb', '--keyboard', help='keyboard, for its USB ids')
+    parser.add_argument('-d', '--device', help='raw HID device path (default: the only VIA interface, or the only one with the keyboard\'s USB ids)')
+    parser.add_argument('-n', '--dry-run', action='store_true', help='compile only')
+    parser.add_argument('-o', '--output', type=Path, help='also write the compiled image to a file')
+    parser.add_argument('--emulate', nargs='?', type=int, const=512, metavar='SIZE', help='write to an in-memory board with SIZE bytes of expansion area (default: 512)')
+    args = parser.parse_args()
+
+    try:
+        entries = load_dictionary(args.dictionary)
+        image, shadowed = compile_trie(entries)
+    except (FileNotFoundError, ValueError) as e:
+        print(e, file=sys.stderr)
+        return 2
+    for trigger in shadowed:
+        print(f'{trigger}: never expands, another trigger ends inside it', file=sys.stderr)
+    print(f'{len(entries)} entries, {len(image)} bytes')
+    if args.output:
+        args.output.write_bytes(image)
+    if args.dry_run:
+        return 0
+
+    if args.emulate:
+        device = ExpandEmulator(args.emulate)
+    else:
+        path = args.device
+        if path is None:
+            vid = pid = None
+            if args.keyboard:
+                usb = qmk_tree.keyboard_info(args.keyboard, qmk_tree.qmk_home()).get('usb', {})
+                vid, pid = (int(usb[k], 16) if k in usb else None for k in ('vid', 'pid'))
+            found = via_hid.find_devices(vid, pid)
+            if len(found) != 1:
+                print(f'{len(found)} VIA devices found, pass --device', file=sys.stderr)
+                return 2
+            path = found[0]
+        device = via_hid.HidDevice(path)
+
+    try:
+        size_bytes = device.custom_value(ID_FJ_EXPAND_SIZE)
+        size = (size_bytes[0] << 8) | size_bytes[1]
+        if len(image) > size:
+            print(f'the board has {size} bytes for expansions, the dictionary needs {len(image)}; raise FJ_EXPAND_SIZE', file=sys.stderr)
+            return 1
+
+        current = read_area(device, len(image))
+        # Off while the trie is half written, the magic byte goes last.
+        write_area(device, 0, b'\0')
+        written = 0
+        for start in range(1, len(image), CHUNK):
+            chunk = image[start:start + CHUNK]
+            if current[start:start + len(chunk)] != chunk:
+                write_area(device, start, chunk)
+                written += len(chunk)
+        write_area(device, 0, image[:1])
+        if read_area(device, len(image)) != image:
+            print('readback differs, the board dropped a write', file=sys.stderr)
+            return 1
+        print(f'wrote {written} of {len(image)} bytes, {size - len(image)} bytes free')
+        return 0
+    except via_hid.ViaError as e:
+        print(e, file=sys.stderr)
+        return 1
+    finally:
+        device.close()
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,403 @@
+"""Talks the VIA raw HID protocol to a keyboard, or to an in-memory stand-in.
+
+Only the commands the userspace tools need are wrapped. Devices are opened
+through hidapi when the `hid` module is installed and through Linux hidraw
+otherwise.
+"""
+import os
+import select
+import time
+from collections import deque
+from pathlib import Path
+
+REPORT_SIZE = 32
+USAGE_PAGE = 0xFF60
+USAGE = 0x61
+
+# Bytes of payload a get/set buffer command carries after its 4 byte header.
+BUFFER_CHUNK = REPORT_SIZE - 4
+# The same with the last byte kept for the request id of a pipelined command.
+TAGGED_CHUNK = BUFFER_CHUNK - 1
+
+ID_GET_PROTOCOL_VERSION = 0x01
+ID_DYNAMIC_KEYMAP_GET_KEYCODE = 0x04
+ID_DYNAMIC_KEYMAP_SET_KEYCODE = 0x05
+ID_CUSTOM_SET_VALUE = 0x07
+ID_CUSTOM_GET_VALUE = 0x08
+ID_CUSTOM_SAVE = 0x09
+ID_DYNAMIC_KEYMAP_MACRO_GET_COUNT = 0x0C
+ID_DYNAMIC_KEYMAP_MACRO_GET_BUFFER_SIZE = 0x0D
+ID_DYNAMIC_KEYMAP_MACRO_GET_BUFFER = 0x0E
+ID_DYNAMIC_KEYMAP_MACRO_SET_BUFFER = 0x0F
+ID_DYNAMIC_KEYMAP_GET_LAYER_COUNT = 0x11
+ID_DYNAMIC_KEYMAP_GET_BUFFER = 0x12
+ID_DYNAMIC_KEYMAP_SET_BUFFER = 0x13
+ID_UNHANDLED = 0xFF
+
+ID_CUSTOM_CHANNEL = 0
+# Userspace value on the custom channel: [version, pipeline depth].
+ID_FJ_PROTOCOL = 0x46
+FJ_PROTOCOL_VERSION = 1
+
+
+class ViaError(Exception):
+    pass
+
+
+class HidrawTransport:
+    """One /dev/hidraw* node.
+    """
+    def __init__(self, path):
+        self.path = path
+        self.fd = os.open(path, os.O_RDWR)
+
+    def write(self, report):
+        # hidraw wants the report number first, 0 for devices without numbered reports.
+        os.write(self.fd, bytes([0]) + report)
+
+    def read(self, timeout):
+        ready, _, _ = select.select([self.fd], [], [], timeout)
+        return os.read(self.fd, REPORT_SIZE) if ready else b''
+
+    def close(self):
+        os.close(self.fd)
+
+
+class HidapiTransport:
+    def __init__(self, path):
+        import hid
+        self.path = path
+        self.device = hid.device()
+        self.device.open_path(path.encode() if isinstance(path, str) else path)
+
+    def write(self, report):
+        self.device.write(bytes([0]) + report)
+
+    def read(self, timeout):
+        return bytes(self.device.read(REPORT_SIZE, int(timeout * 1000)))
+
+    def close(self):
+        self.device.close()
+
+
+def _hidraw_devices():
+    for node in sorted(Path('/sys/class/hidraw').glob('hidraw*')):
+        try:
+            descriptor = (node / 'device' / 'report_descriptor').read_bytes()
+            uevent = (node / 'device' / 'uevent').read_text()
+        except OSError:
+            continue
+        # Usage Page (0xFF60) and Usage (0x61), as short items.
+        if b'\x06\x60\xff' not in descriptor or b'\x09\x61' not in descriptor:
+            continue
+        for line in uevent.splitlines():
+            if line.startswith('HID_ID='):
+                _, vid, pid = line[len('HID_ID='):].split(':')
+                yield f'/dev/{node.name}', int(vid, 16), int(pid, 16)
+
+
+def find_devices(vid=None, pid=None):
+    """Returns the paths of every VIA raw HID interface, optionally for one VID/PID.
+    """
+    try:
+        import hid
+        found = [(info['path'].decode(), info['vendor_id'], info['product_id']) for info in hid.enumerate() if info['usage_page'] == USAGE_PAGE and info['usage'] == USAGE]
+    except ImportError:
+        found = list(_hidraw_devices())
+    return [path for path, v, p in found if (vid is None or v == vid) and (pid is None or p == pid)]
+
+
+class Device:
+    """A VIA keyboard. Subclasses provide _write() and _read().
+
+    Commands normally go one at a time, each waiting for its answer. After
+    negotiate() finds the userspace pipelined protocol, the buffer reads and
+    writes keep up to `depth` commands in flight instead, each tagged with a
+    request id in the last report byte that the board echoes back.
+    """
+    def __init__(self):
+        self.commands = 0
+        self.depth = 1
+        self._tag = 0
+
+    def _write(self, report):
+        raise NotImplementedError
+
+    def _read(self):
+        """Returns the next report from the board, raises ViaError if none comes.
+        """
+        raise NotImplementedError
+
+    def _exchange(self, report):
+        self._write(report)
+        while True:
+            response = self._read()
+            # VIA echoes the command id, anything else is a stale report.
+            if response[0] in (report[0], ID_UNHANDLED):
+                return response
+
+    def command(self, command_id, *payload):
+        report = bytes([command_id, *payload]).ljust(REPORT_SIZE, b'\0')
+        self.commands += 1
+        response = self._exchange(report)
+        if response[0] == ID_UNHANDLED:
+            raise ViaError(f'command 0x{command_id:02x} not handled by the keyboard')
+        return response
+
+    def negotiate(self, depth=None):
+        """Turns on pipelining if the board answers id_fj_protocol, up to `depth` commands deep.
+
+        Boards without the userspace protocol stay one command at a time.
+        """
+        try:
+            version, board_depth = self.custom_value(ID_FJ_PROTOCOL, channel=ID_CUSTOM_CHANNEL)[:2]
+        except ViaError:
+            version = 0
+        self.depth = 1
+        if version >= 1 and board_depth > 1:
+            self.depth = min(board_depth, depth or board_depth)
+        return self.depth
+
+    @property
+    def chunk(self):
+        """Bytes of payload one buffer command carries; tagged commands leave the last byte to the tag.
+        """
+        return TAGGED_CHUNK if self.depth > 1 else BUFFER_CHUNK
+
+    def _pipeline(self, requests):
+        """Sends every (command id, payload) with up to `depth` in flight and returns the answers in order.
+        """
+        if self.depth == 1:
+            return [self.command(command_id, *payload) for command_id, payload in requests]
+        answers = []
+        in_flight = deque()
+        for command_id, payload in requests:
+            if len(in_flight) == self.depth:
+                answers.append(self._collect(in_flight))
+            self._tag = self._tag % 255 + 1
+            report = bytearray(bytes([command_id, *payload]).ljust(REPORT_SIZE, b'\0'))
+            report[-1] = self._tag
+            self.commands += 1
+            self._write(bytes(report))
+            in_flight.append(report)
+        while in_flight:
+            answers.append(self._collect(in_flight))
+        return answers
+
+    def _collect(self, in_flight):
+        report = in_flight.popleft()
+        while True:
+            response = self._read()
+            if response[-1] == report[-1] and response[0] in (report[0], ID_UNHANDLED):
+                break
+            # The board answers in order, so an answer to a later request means this one was lost.
+            if any(response[-1] == later[-1] and response[0] == later[0] for later in in_flight):
+                raise ViaError(f'no answer to command 0x{report[0]:02x}, request {report[-1]}')
+        if response[0] == ID_UNHANDLED:
+            raise ViaError(f'command 0x{report[0]:02x} not handled by the keyboard')
+        return response
+
+    def protocol_version(self):
+        response = self.command(ID_GET_PROTOCOL_VERSION)
+        return (response[1] << 8) | response[2]
+
+    def layer_count(self):
+        return self.command(ID_DYNAMIC_KEYMAP_GET_LAYER_COUNT)[1]
+
+    def _get_chunks(self, command_id, offset, size):
+        chunks = [(at, min(self.chunk, offset + size - at)) for at in range(offset, offset + size, self.chunk)]
+        answers = self._pipeline([(command_id, (at >> 8, at & 0xFF, chunk)) for at, chunk in chunks])
+        return b''.join(response[4:4 + chunk] for (_, chunk), response in zip(chunks, answers))
+
+    def _set_chunks(self, command_id, ranges):
+        requests = []
+        for offset, data in ranges:
+            for start in range(0, len(data), self.chunk):
+                chunk = data[start:start + self.chunk]
+                at = offset + start
+                requests.append((command_id, (at >> 8, at & 0xFF, len(chunk), *chunk)))
+        self._pipeline(requests)
+
+    def get_buffer(self, offset, size):
+        """Reads `size` bytes of the dynamic keymap, two big-endian bytes per key.
+        """
+        return self._get_chunks(ID_DYNAMIC_KEYMAP_GET_BUFFER, offset, size)
+
+    def set_buffer(self, offset, data):
+        self._set_chunks(ID_DYNAMIC_KEYMAP_SET_BUFFER, [(offset, data)])
+
+    def set_buffer_ranges(self, ranges):
+        """Writes every (offset, data) of the dynamic keymap, pipelined together.
+        """
+        self._set_chunks(ID_DYNAMIC_KEYMAP_SET_BUFFER, ranges)
+
+    def macro_count(self):
+        return self.command(ID_DYNAMIC_KEYMAP_MACRO_GET_COUNT)[1]
+
+    def macro_buffer_size(self):
+        response = self.command(ID_DYNAMIC_KEYMAP_MACRO_GET_BUFFER_SIZE)
+        return (response[1] << 8) | response[2]
+
+    def get_macro_buffer(self, offset, size):
+        """Reads `size` bytes of the macro buffer, one NUL-terminated macro after the other.
+        """
+        return self._get_chunks(ID_DYNAMIC_KEYMAP_MACRO_GET_BUFFER, offset, size)
+
+    def set_macro_buffer(self, offset, data):
+        self._set_chunks(ID_DYNAMIC_KEYMAP_MACRO_SET_BUFFER, [(offset, data)])
+
+    def set_macro_buffer_ranges(self, ranges):
+        self._set_chunks(ID_DYNAMIC_KEYMAP_MACRO_SET_BUFFER, ranges)
+
+    def custom_value(self, value_id, *data, channel=0):
+        return self.command(ID_CUSTOM_GET_VALUE, channel, value_id, *data)[3:]
+
+    def set_custom_value(self, value_id, *data, channel=0):
+        self.command(ID_CUSTOM_SET_VALUE, channel, value_id, *data)
+
+    def save_custom_values(self, channel=0):
+        """Asks the channel to persist its values; userspace values are saved as they are set.
+        """
+        self.command(ID_CUSTOM_SAVE, channel)
+
+    def close(self):
+        pass
+
+
+class HidDevice(Device):
+    def __init__(self, path, timeout=0.5):
+        super().__init__()
+        self.path = path
+        try:
+            import hid  # noqa: F401
+            self.transport = HidapiTransport(path)
+        except ImportError:
+            self.transport = HidrawTransport(path)
+        self.timeout = timeout
+
+    def _write(self, report):
+        self.transport.write(report)
+
+    def _read(self):
+        response = self.transport.read(self.timeout)
+        if not response:
+            raise ViaError(f'no response from {self.transport.path}')
+        return response
+
+    def close(self):
+        self.transport.close()
+
+
+class Emulator(Device):
+    """Answers the dynamic keymap, macro and custom value commands from memory, like the stock firmware.
+
+    `layers` is a list of layers, each a list of keycodes in matrix order,
+    and `cols` the matrix width the per-key commands use. `writes` counts the
+    EEPROM bytes that actually changed, as the firmware only writes bytes
+    that differ. Custom values read back whatever was last set, per first
+    data byte, so values led by an index (a combo slot) keep one entry per
+    index. `delay` seconds are spent on every command, to stand in for a
+    USB round trip.
+
+    `clock` keeps the time the commands would take on a full speed bus
+    instead, without sleeping: a report goes out in one `frame`, the board
+    spends `process` on it, and the answer comes back in the next free IN
+    frame. Reports queue up to `pipeline` deep, as the userspace firmware
+    advertises through id_fj_protocol; 0 answers like a stock board.
+    """
+    def __init__(self, layers, cols=None, protocol=0x000C, macros=16, macro_size=1024, delay=0, path='emulator',
+                 pipeline=4, frame=0.001, process=0.0002):
+        super().__init__()
+        self.path = path
+        self.delay = delay
+        self.pipeline = pipeline
+        self.frame = frame
+        self.process = process
+        self.clock = 0.0
+        self._out_free = self._board_free = self._in_free = 0.0
+        self._answers = deque()
+        self.macros = macros
+        self.macro_eeprom = bytearray(macro_size)
+        self.values = {}
+        self.keys = len(layers[0])
+        self.cols = cols or self.keys
+        self.layers = len(layers)
+        self.eeprom = bytearray()
+        for layer in layers:
+            for keycode in layer:
+                self.eeprom += bytes([keycode >> 8, keycode & 0xFF])
+        self.protocol = protocol
+        self.writes = 0
+
+    def keycode(self, layer, key):
+        at = (layer * self.keys + key) * 2
+        return (self.eeprom[at] << 8) | self.eeprom[at + 1]
+
+    def _update(self, at, value, eeprom=None):
+        eeprom = self.eeprom if eeprom is None else eeprom
+        if at < len(eeprom) and eeprom[at] != value:
+            eeprom[at] = value
+            self.writes += 1
+
+    def _write(self, report):
+        if self.delay:
+            time.sleep(self.delay)
+        # One interrupt transfer per frame each way, so reports in flight overlap.
+        self._out_free = max(self.clock, self._out_free) + self.frame
+        self._board_free = max(self._out_free, self._board_free) + self.process
+        self._in_free = max(self._board_free, self._in_free) + self.frame
+        self._answers.append((self._in_free, self._answer(report)))
+
+    def _read(self):
+        if not self._answers:
+            raise ViaError(f'no response from {self.path}')
+        ready, response = self._answers.popleft()
+        self.clock = max(self.clock, ready)
+        return response
+
+    def _answer(self, report):
+        response = bytearray(report)
+        command_id = report[0]
+        if command_id == ID_GET_PROTOCOL_VERSION:
+            response[1:3] = bytes([self.protocol >> 8, self.protocol & 0xFF])
+        elif command_id == ID_DYNAMIC_KEYMAP_GET_LAYER_COUNT:
+            response[1] = self.layers
+        elif command_id == ID_DYNAMIC_KEYMAP_GET_BUFFER:
+            offset, size = (report[1] << 8) | report[2], min(report[3], BUFFER_CHUNK)
+            chunk = self.eeprom[offset:offset + size]
+            response[4:4 + size] = chunk.ljust(size, b'\0')
+        elif command_id == ID_DYNAMIC_KEYMAP_SET_BUFFER:
+            offset, size = (report[1] << 8) | report[2], min(report[3], BUFFER_CHUNK)
+            for i in range(size):
+                self._update(offset + i, report[4 + i])
+        elif command_id == ID_DYNAMIC_KEYMAP_GET_KEYCODE:
+            keycode = self.keycode(report[1], report[2] * self.cols + report[3])
+            response[4:6] = bytes([keycode >> 8, keycode & 0xFF])
+        elif command_id == ID_DYNAMIC_KEYMAP_SET_KEYCODE:
+            at = (report[1] * self.keys + report[2] * self.cols + report[3]) * 2
+            self._update(at, report[4])
+            self._update(at + 1, report[5])
+        elif command_id == ID_DYNAMIC_KEYMAP_MACRO_GET_COUNT:
+            response[1] = self.macros
+        elif command_id == ID_DYNAMIC_KEYMAP_MACRO_GET_BUFFER_SIZE:
+            response[1:3] = bytes([len(self.macro_eeprom) >> 8, len(self.macro_eeprom) & 0xFF])
+        elif command_id == ID_DYNAMIC_KEYMAP_MACRO_GET_BUFFER:
+            offset, size = (report[1] << 8) | report[2], min(report[3], BUFFER_CHUNK)
+            response[4:4 + size] = self.macro_eeprom[offset:offset + size].ljust(size, b'\0')
+        elif command_id == ID_DYNAMIC_KEYMAP_MACRO_SET_BUFFER:
+            offset, size = (report[1] << 8) | report[2], min(report[3], BUFFER_CHUNK)
+            for i in range(size):
+                self._update(offset + i, report[4 + i], self.macro_eeprom)
+        elif command_id == ID_CUSTOM_GET_VALUE and (report[1], report[2]) == (ID_CUSTOM_CHANNEL, ID_FJ_PROTOCOL) and self.pipeline:
+            response[3:5] = bytes([FJ_PROTOCOL_VERSION, self.pipeline])
+        elif command_id == ID_CUSTOM_SET_VALUE:
+            self.values[report[1], report[2], report[3]] = self.values[report[1], report[2]] = bytes(report[3:])
+        elif command_id == ID_CUSTOM_GET_VALUE:
+            value = self.values.get((report[1], report[2], report[3]), self.values.get((report[1], report[2])))
+            if value is not None:
+                response[3:] = value
+        elif command_id == ID_CUSTOM_SAVE:
+            pass
+        else:
+            response[0] = ID_UNHANDLED
+        return bytes(response)
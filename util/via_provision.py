@@ -0,0 +1,162 @@
+#!/usr/bin/env python3
+"""Provisions many VIA boards at once with the same keymap, macros and custom values.
+
+Every VIA interface with the keyboard's USB ids (or each --device given) is
+written in parallel, at most --jobs boards at a time. Each board gets the
+target keymap, with only the keys that differ written as in via_sync.py,
+the macro buffer and the custom values, then everything written is read
+back; a board passes only if the readback matches. The run ends with the
+throughput in boards per minute.
+
+    util/via_provision.py -kb fjlabs/kf87                            # every connected kf87
+    util/via_provision.py -kb fjlabs/kf87 --macros macros.txt --set 0:0x43:1
+    util/via_provision.py -kb fjlabs/kf87 --emulate 200 --delay 0.001  # 200 in-memory boards
+"""
+import argparse
+import sys
+import time
+from concurrent.futures import ThreadPoolExecutor, as_completed
+from pathlib import Path
+
+import qmk_tree
+import via_hid
+import via_sync
+
+
+def macro_image(macros, count, size):
+    """Returns the macro buffer holding `macros`, one NUL-terminated macro each, the rest empty.
+    """
+    if len(macros) > count:
+        raise via_hid.ViaError(f'{len(macros)} macros, the board has {count}')
+    image = b''.join(macro + b'\0' for macro in macros) + b'\0' * (count - len(macros))
+    if len(image) > size:
+        raise via_hid.ViaError(f'macros take {len(image)} bytes, the board has {size}')
+    return image
+
+
+def parse_setting(text):
+    """Parses CHANNEL:ID:BYTE[,BYTE...] into (channel, value id, bytes).
+    """
+    channel, value_id, data = text.split(':')
+    return int(channel, 0), int(value_id, 0), bytes(int(byte, 0) for byte in data.split(','))
+
+
+def provision(device, layers, keys, macros, settings):
+    """Writes one board and reads it back. Returns a summary, raises ViaError on any failure.
+    """
+    device.negotiate()
+    device_layers = device.layer_count()
+    if len(layers) > device_layers:
+        raise via_hid.ViaError(f'target has {len(layers)} layers, the board {device_layers}')
+
+    size = len(layers) * keys * 2
+    current = device.get_buffer(0, size)
+    changes, writes = via_sync.plan(current, layers, keys, device.chunk)
+    device.set_buffer_ranges(writes)
+    expected = bytearray(current)
+    for offset, data in writes:
+        expected[offset:offset + len(data)] = data
+    if device.get_buffer(0, size) != expected:
+        raise via_hid.ViaError('keymap readback differs')
+
+    if macros is not None:
+        image = macro_image(macros, device.macro_count(), device.macro_buffer_size())
+        current = device.get_macro_buffer(0, len(image))
+        chunks = [(start, image[start:start + device.chunk]) for start in range(0, len(image), device.chunk)]
+        device.set_macro_buffer_ranges([(start, chunk) for start, chunk in chunks if current[start:start + len(chunk)] != chunk])
+        if device.get_macro_buffer(0, len(image)) != image:
+            raise via_hid.ViaError('macro readback differs')
+
+    for channel, value_id, data in settings:
+        device.set_custom_value(value_id, *data, channel=channel)
+    # The userspace channel writes its values as they are set and has no save.
+    for channel in sorted({channel for channel, _, _ in settings} - {0}):
+        device.save_custom_values(channel)
+    for channel, value_id, data in settings:
+        if device.custom_value(value_id, *data, channel=channel)[:len(data)] != data:
+            raise via_hid.ViaError(f'custom value {channel}:0x{value_id:02x} readback differs')
+
+    return f'{len(changes)} keys written'
+
+
+def run(open_device, layers, keys, macros, settings):
+    start = time.perf_counter()
+    device = open_device()
+    try:
+        summary = provision(device, layers, keys, macros, settings)
+        return device.path, True, summary, device.commands, time.perf_counter() - start
+    except via_hid.ViaError as e:
+        return device.path, False, str(e), device.commands, time.perf_counter() - start
+    finally:
+        device.close()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('-kb', '--keyboard', help='keyboard, for the matrix size, USB ids and default target')
+    parser.add_argument('-km', '--keymap', default='via')
+    parser.add_argument('-t', '--target', type=Path, help='keymap.c or VIA JSON to write (default: the userspace keymap)')
+    parser.add_argument('-d', '--device', action='append', help='raw HID device path, repeatable (default: every VIA interface with the keyboard\'s USB ids)')
+    parser.add_argument('--macros', type=Path, help='text file with one macro per line, written to every board')
+    parser.add_argument('--set', dest='settings', action='append', default=[], metavar='CHANNEL:ID:BYTES', help='custom value to set, bytes separated by commas, repeatable')
+    parser.add_argument('-j', '--jobs', type=int, default=8, help='boards written at the same time (default: %(default)s)')
+    parser.add_argument('--emulate', type=int, metavar='N', help='provision N in-memory boards instead of devices')
+    parser.add_argument('--delay', type=float, default=0.001, help='seconds per command on emulated boards (default: %(default)s)')
+    args = parser.parse_args()
+
+    target = args.target
+    keyboard = args.keyboard or (target and via_sync._keyboard_of(target))
+    if target is None:
+        if not keyboard:
+            parser.error('pass -kb or --target')
+        target = qmk_tree.USERSPACE / 'keyboards' / keyboard / 'keymaps' / args.keymap / 'keymap.c'
+    try:
+        settings = [parse_setting(text) for text in args.settings]
+    except ValueError:
+        parser.error('--set takes CHANNEL:ID:BYTE[,BYTE...]')
+
+    home = qmk_tree.qmk_home()
+    keycodes = qmk_tree.KeycodeTable(home, extra=sorted((qmk_tree.USERSPACE / 'users').glob('*/*.h')))
+    try:
+        info = qmk_tree.keyboard_info(keyboard, home) if keyboard else None
+        layers = via_sync.load_layers(target, info, keycodes)
+        macros = [line.encode() for line in args.macros.read_text(encoding='utf-8').splitlines()] if args.macros else None
+    except (FileNotFoundError, ValueError, KeyError) as e:
+        print(f'{target}: {e}', file=sys.stderr)
+        return 2
+    keys = info['matrix_size']['rows'] * info['matrix_size']['cols'] if info else len(layers[0])
+
+    if args.emulate:
+        cols = info['matrix_size']['cols'] if info else None
+        openers = [lambda i=i: via_hid.Emulator([[0] * keys for _ in layers], cols, delay=args.delay, path=f'emulator{i}') for i in range(args.emulate)]
+    else:
+        paths = args.device
+        if not paths:
+            usb = (info or {}).get('usb', {})
+            vid, pid = (int(usb[k], 16) if k in usb else None for k in ('vid', 'pid'))
+            paths = via_hid.find_devices(vid, pid)
+        if not paths:
+            print('no VIA devices found, pass --device', file=sys.stderr)
+            return 2
+        openers = [lambda path=path: via_hid.HidDevice(path) for path in paths]
+
+    failed = 0
+    start = time.perf_counter()
+    with ThreadPoolExecutor(max_workers=max(1, args.jobs)) as pool:
+        futures = [pool.submit(run, opener, layers, keys, macros, settings) for opener in openers]
+        for future in as_completed(futures):
+            try:
+                path, ok, summary, commands, elapsed = future.result()
+            except OSError as e:
+                path, ok, summary, commands, elapsed = '?', False, str(e), 0, 0
+            failed += not ok
+            print(f'{"ok  " if ok else "FAIL"} {path}: {summary}, {commands} commands in {elapsed:.2f} s')
+    elapsed = time.perf_counter() - start
+
+    boards = len(openers)
+    print(f'{boards - failed} of {boards} boards provisioned in {elapsed:.1f} s, {boards * 60 / elapsed:.0f} boards per minute with {args.jobs} jobs')
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,191 @@
+#!/usr/bin/env python3
+"""Brings a keyboard's VIA keymap in line with a target, writing only the keys that differ.
+
+The board's dynamic keymap is read back, compared with the target (a
+keymap.c, by default the userspace one for the keyboard, or a keymap saved
+from VIA as JSON) and only the differing keys are written, packed into as
+few set-buffer commands as possible. The written ranges are read back to
+check the board kept them.
+
+    util/via_sync.py -kb fjlabs/kf87                     # sync to the userspace keymap
+    util/via_sync.py -kb fjlabs/kf87 -n                  # only show what would change
+    util/via_sync.py -kb fjlabs/kf87 --target layout.json --device /dev/hidraw3
+    util/via_sync.py -kb fjlabs/kf87 --emulate saved.json  # against an in-memory board
+"""
+import argparse
+import json
+import sys
+import time
+from pathlib import Path
+
+import qmk_tree
+import via_hid
+
+
+def _keyboard_of(path):
+    """Returns the keyboard a userspace keymap.c belongs to, or None.
+    """
+    try:
+        parts = path.resolve().relative_to(qmk_tree.USERSPACE / 'keyboards').parts
+    except ValueError:
+        return None
+    return '/'.join(parts[:-3]) if len(parts) > 3 and parts[-3] == 'keymaps' else None
+
+
+def load_layers(path, info, keycodes):
+    """Reads a keymap.c or VIA JSON keymap into a list of {matrix index: keycode} per layer.
+    """
+    if path.suffix == '.json':
+        data = json.loads(path.read_text(encoding='utf-8'))
+        layers = []
+        for layer in data['layers']:
+            layers.append({key: value if isinstance(value, int) else keycodes.value(value) for key, value in enumerate(layer)})
+        return layers
+
+    if info is None:
+        raise ValueError(f'{path}: a keymap.c needs the keyboard, pass -kb')
+    cols = info['matrix_size']['cols']
+    keycodes = keycodes.with_source(path)
+    layers = []
+    for layer in qmk_tree.parse_keymap(path):
+        keys = qmk_tree.layout(info, layer.macro)
+        if keys is None or len(keys) != len(layer.keys):
+            raise ValueError(f'{path}:{layer.line}: {layer.macro} does not match the keyboard, run check_keymaps.py')
+        cells = {}
+        for key, (expr, line) in zip(keys, layer.keys):
+            row, col = key['matrix']
+            try:
+                cells[row * cols + col] = keycodes.value(expr)
+            except ValueError as e:
+                raise ValueError(f'{path}:{line}: {e}')
+        layers.append(cells)
+    return layers
+
+
+def plan(current, layers, keys, chunk=via_hid.BUFFER_CHUNK):
+    """Returns the differing (layer, key, old, new) cells and the set-buffer writes covering them.
+
+    A write covers a run of keys up to `chunk` bytes long; unchanged keys
+    inside it are sent with their current value, which the firmware does
+    not rewrite.
+    """
+    image = bytearray(current)
+    changes = []
+    for index, cells in enumerate(layers):
+        for key, keycode in sorted(cells.items()):
+            at = (index * keys + key) * 2
+            if at + 2 > len(current):
+                continue
+            old = (current[at] << 8) | current[at + 1]
+            if old != keycode:
+                changes.append((index, key, old, keycode))
+                image[at:at + 2] = bytes([keycode >> 8, keycode & 0xFF])
+
+    writes = []
+    offsets = [(index * keys + key) * 2 for index, key, _, _ in changes]
+    i = 0
+    while i < len(offsets):
+        start = offsets[i]
+        end = start + 2
+        while i < len(offsets) and offsets[i] + 2 - start <= chunk:
+            end = offsets[i] + 2
+            i += 1
+        writes.append((start, bytes(image[start:end])))
+    return changes, writes
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('-kb', '--keyboard', help='keyboard, for the matrix size, USB ids and default target')
+    parser.add_argument('-km', '--keymap', default='via')
+    parser.add_argument('-t', '--target', type=Path, help='keymap.c or VIA JSON to sync to (default: the userspace keymap)')
+    parser.add_argument('-d', '--device', help='raw HID device path (default: the only VIA interface with the keyboard\'s USB ids)')
+    parser.add_argument('-n', '--dry-run', action='store_true', help='read and compare only, write nothing')
+    parser.add_argument('--emulate', type=Path, metavar='KEYMAP', help='sync an in-memory board holding this keymap.c or VIA JSON instead of a device')
+    args = parser.parse_args()
+
+    target = args.target
+    keyboard = args.keyboard or (target and _keyboard_of(target))
+    if target is None:
+        if not keyboard:
+            parser.error('pass -kb or --target')
+        target = qmk_tree.USERSPACE / 'keyboards' / keyboard / 'keymaps' / args.keymap / 'keymap.c'
+
+    home = qmk_tree.qmk_home()
+    keycodes = qmk_tree.KeycodeTable(home, extra=sorted((qmk_tree.USERSPACE / 'users').glob('*/*.h')))
+    try:
+        info = qmk_tree.keyboard_info(keyboard, home) if keyboard else None
+        layers = load_layers(target, info, keycodes)
+    except (FileNotFoundError, ValueError, KeyError) as e:
+        print(f'{target}: {e}', file=sys.stderr)
+        return 2
+
+    if info:
+        keys = info['matrix_size']['rows'] * info['matrix_size']['cols']
+    else:
+        keys = len(layers[0])
+
+    if args.emulate:
+        initial = load_layers(args.emulate, info, keycodes)
+        device = via_hid.Emulator([[cells.get(key, 0) for key in range(keys)] for cells in initial])
+    else:
+        path = args.device
+        if path is None:
+            usb = (info or {}).get('usb', {})
+            vid, pid = (int(usb[k], 16) if k in usb else None for k in ('vid', 'pid'))
+            found = via_hid.find_devices(vid, pid)
+            if len(found) != 1:
+                print(f'{len(found)} VIA devices found, pass --device', file=sys.stderr)
+                return 2
+            path = found[0]
+        device = via_hid.HidDevice(path)
+
+    try:
+        device.negotiate()
+        device_layers = device.layer_count()
+        if len(layers) > device_layers:
+            print(f'target has {len(layers)} layers, the board {device_layers}; syncing the first {device_layers}', file=sys.stderr)
+            layers = layers[:device_layers]
+
+        device.commands = 0
+        start = time.perf_counter()
+        current = device.get_buffer(0, len(layers) * keys * 2)
+        read_commands, read_time = device.commands, time.perf_counter() - start
+
+        changes, writes = plan(current, layers, keys, device.chunk)
+        total = sum(len(cells) for cells in layers)
+        print(f'{len(changes)} of {total} keys differ')
+        for layer, key, old, new in changes:
+            where = f'row {key // info["matrix_size"]["cols"]} col {key % info["matrix_size"]["cols"]}' if info else f'key {key}'
+            print(f'  layer {layer} {where}: 0x{old:04X} -> 0x{new:04X}')
+        if not changes:
+            return 0
+
+        full_bytes = len(layers) * keys * 2
+        full_commands = -(-full_bytes // device.chunk)
+        sent = sum(len(data) for _, data in writes)
+        print(f'{len(writes)} set-buffer commands instead of {full_commands} for a full upload, {sent} bytes instead of {full_bytes}')
+        print(f'read {read_commands} commands in {read_time * 1000:.1f} ms')
+        if args.dry_run:
+            return 0
+
+        start = time.perf_counter()
+        device.set_buffer_ranges(writes)
+        write_time = time.perf_counter() - start
+
+        failed = [(offset, data) for offset, data in writes if device.get_buffer(offset, len(data)) != data]
+        print(f'wrote {len(writes)} commands in {write_time * 1000:.1f} ms, {len(changes)} keys instead of {total}')
+        if isinstance(device, via_hid.Emulator):
+            print(f'EEPROM bytes changed: {device.writes}')
+        for offset, data in failed:
+            print(f'  readback differs at buffer offset {offset} ({len(data) // 2} keys), the board dropped the write', file=sys.stderr)
+        return 1 if failed else 0
+    except via_hid.ViaError as e:
+        print(e, file=sys.stderr)
+        return 1
+    finally:
+        device.close()
+
+
+if __name__ == '__main__':
+    sys.exit(main())